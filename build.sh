@@ -6,17 +6,26 @@ set -e
 
 # Set compiler options
 CXX="g++"
-CXXFLAGS="-std=c++17 -Wall -Wextra -g -O2"
+CXXFLAGS="-std=c++17 -Wall -Wextra -g -O2 -pthread"
 
 # Source files
 SOURCES=(
     "main.cpp"
     "cpu/memory.cpp"
+    "cpu/decoder.cpp"
+    "cpu/jit.cpp"
+    "cpu/savestate.cpp"
+    "cpu/lockstep.cpp"
+    "cpu/scheduler.cpp"
     "cpu/instructions.cpp"
+    "cpu/intrinsics.cpp"
     "utils/utils.cpp"
     "io/io.cpp"
+    "io/pit.cpp"
+    "io/pic.cpp"
     "assembler/assembler.cpp"
     "disassembler/disassembler.cpp"
+    "runner/pool.cpp"
 )
 
 OUTPUT="emu8086"
@@ -27,7 +36,7 @@ cd build
 mkdir -p ../examples/output
 
 echo "Building emu8086..."
-${CXX} ${CXXFLAGS} -o ${OUTPUT} ../*.cpp ../cpu/*.cpp ../utils/*.cpp ../io/*.cpp ../assembler/*.cpp ../disassembler/*.cpp
+${CXX} ${CXXFLAGS} -o ${OUTPUT} ../*.cpp ../cpu/*.cpp ../utils/*.cpp ../io/*.cpp ../assembler/*.cpp ../disassembler/*.cpp ../runner/*.cpp
 
 if [ $? -eq 0 ]; then
     echo "Build successful! The executable is at ./build/${OUTPUT}"
@@ -5,14 +5,68 @@
 #ifndef CPU_HPP
 #define CPU_HPP
 
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <string>
 #include "memory.hpp"
 #include "registers.hpp"
 #include "flags.hpp"
 #include "instructions.hpp"
+#include "scheduler.hpp"
 #include "../io/io.hpp"
+#include "../io/pic.hpp"
+#include "../io/pit.hpp"
 
 namespace CPU {
 
+    // How CPU::step() and CPU::run() drive the instruction handlers
+    enum class ExecutionMode {
+        Interpreter,  // Decode and dispatch one instruction at a time
+        Threaded,     // Run cached basic blocks of pre-bound handlers
+        Jit           // Threaded, with hot blocks compiled to native code
+    };
+
+    // Budgets for CPU::run(const RunLimits&). Zero means no limit.
+    struct RunLimits {
+        uint64_t maxInstructions = 0;
+        uint64_t maxCycles = 0;
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    };
+
+    enum class StopReason {
+        Halted,            // HLT
+        InstructionLimit,  // Ran maxInstructions
+        CycleLimit,        // Spent maxCycles
+        Deadline,          // Wall clock passed the deadline
+        Fault              // An instruction threw (unknown opcode, bad register, ...)
+    };
+
+    struct RunResult {
+        StopReason reason = StopReason::Halted;
+        uint64_t instructions = 0;  // Executed by this call
+        uint64_t cycles = 0;        // Spent by this call
+        std::string fault;          // What went wrong, for StopReason::Fault
+        uint16_t faultCS = 0;       // CS:IP after the faulting instruction was fetched
+        uint16_t faultIP = 0;
+    };
+
+    // Machine state captured by CPU::snapshot(). Memory pages are shared
+    // with the CPU and with other snapshots until one of them writes to
+    // them, so keeping many snapshots is cheap.
+    struct Snapshot {
+        Registers registers;
+        Flags flags;
+        bool halted = false;
+        bool a20Enabled = false;
+        uint64_t totalCycles = 0;
+        uint64_t instructionCount = 0;
+        Memory::Image memory;
+        std::unordered_map<uint16_t, uint8_t> portValues;
+        IO::PIT::State timer;
+        IO::PIC::State interruptController;
+    };
+
     class CPU {
     private:
         Memory memory;
@@ -20,15 +74,152 @@ namespace CPU {
         Flags flags;
         IO::IOController ioController;
         Instructions instructions;
+        Scheduler scheduler;
+        IO::PIT pit;  // Clocked from total_cycles
+        IO::PIC pic;
         
         // Cycle counting
         uint64_t total_cycles;
         uint64_t instruction_count;
 
+        ExecutionMode executionMode;
+
+        // Polling loop detection. After each spin-safe block, the machine
+        // state is compared with the state the last time CS:IP was here. If
+        // a whole iteration of the loop changed nothing and read no port
+        // that isn't stable, every iteration after it will do the same
+        // until a device event runs, so they can be skipped.
+        static constexpr uint32_t MAX_SPIN_BLOCKS = 4;  // Longest loop looked for, in blocks
+        struct SpinCheck {
+            bool armed = false;
+            uint32_t blocks = 0;          // Run since the state was taken
+            Registers registers;
+            uint16_t flags = 0;
+            uint64_t cycles = 0;
+            uint64_t instructions = 0;
+            uint64_t volatileReads = 0;
+        };
+        SpinCheck spin;
+
+        // Fire the device events the last instruction or block brought due,
+        // then take any interrupt they raised
+        void runEvents() {
+            if (scheduler.isDue(total_cycles)) {
+                scheduler.runDue(total_cycles);
+                spin.armed = false;
+            }
+            if (instructions.getAttention()) {
+                total_cycles += instructions.serviceAttention(pic);
+                spin.armed = false;
+            }
+        }
+
+        void takeSpinState() {
+            spin.armed = true;
+            spin.blocks = 0;
+            spin.registers = registers;
+            spin.flags = flags.getValue();
+            spin.cycles = total_cycles;
+            spin.instructions = instruction_count;
+            spin.volatileReads = ioController.getVolatileReads();
+        }
+
+        bool isSpinStateUnchanged() const {
+            const Registers &r = spin.registers;
+            return registers.AX.value == r.AX.value && registers.BX.value == r.BX.value &&
+                   registers.CX.value == r.CX.value && registers.DX.value == r.DX.value &&
+                   registers.SI == r.SI && registers.DI == r.DI && registers.SP == r.SP && registers.BP == r.BP &&
+                   registers.CS == r.CS && registers.DS == r.DS && registers.SS == r.SS && registers.ES == r.ES &&
+                   registers.IP == r.IP && flags.getValue() == spin.flags;
+        }
+
+        // After a block: move the counters past the iterations of a polling
+        // loop that would end before the next device event, cycleLimit, or
+        // the point where no block may start after instructionLimit. The
+        // event then fires after the same block, on the same cycle, as if
+        // every iteration had been run. With no event scheduled and no
+        // limits there is nothing to skip to, and the loop runs on.
+        void skipSpin(uint64_t cycleLimit, uint64_t instructionLimit) {
+            if (!instructions.ranSpinSafeBlock()) {
+                spin.armed = false;
+                return;
+            }
+            if (spin.armed && ioController.getVolatileReads() == spin.volatileReads) {
+                if (registers.CS != spin.registers.CS || registers.IP != spin.registers.IP) {
+                    if (++spin.blocks < MAX_SPIN_BLOCKS) {
+                        return;
+                    }
+                } else if (isSpinStateUnchanged()) {
+                    uint64_t period = total_cycles - spin.cycles;
+                    uint64_t length = instruction_count - spin.instructions;
+                    uint64_t horizon = std::min(scheduler.nextDeadline(), cycleLimit);
+                    bool bounded = horizon != Scheduler::NEVER || instructionLimit != Scheduler::NEVER;
+                    if (bounded && period && horizon > total_cycles && instructionLimit >= instruction_count) {
+                        uint64_t iterations = std::min((horizon - total_cycles - 1) / period,
+                                                       (instructionLimit - instruction_count) / length);
+                        total_cycles += iterations * period;
+                        instruction_count += iterations * length;
+                    }
+                }
+            }
+            takeSpinState();
+        }
+
+        // HLT with IF set waits for an interrupt, which only a device event
+        // can bring, so the clock moves straight to the next event rather
+        // than idling towards it. False if the CPU stays halted: IF is
+        // clear, nothing is scheduled, or the next event isn't before
+        // cycleLimit, in which case the clock stops there. Also false,
+        // still halted, after maxEvents events, so the caller can look at
+        // its deadline (see isWaiting()).
+        bool waitForInterrupt(uint64_t cycleLimit, uint32_t maxEvents = std::numeric_limits<uint32_t>::max()) {
+            while (instructions.isHalted() && flags.getFlag(FLAGS::IF)) {
+                if (maxEvents-- == 0) {
+                    return false;
+                }
+                uint64_t due = scheduler.nextDeadline();
+                if (due == Scheduler::NEVER) {
+                    return false;
+                }
+                if (due >= cycleLimit) {
+                    total_cycles = std::max(total_cycles, cycleLimit);
+                    return false;
+                }
+                total_cycles = std::max(total_cycles, due);
+                runEvents();
+            }
+            return !instructions.isHalted();
+        }
+
+        // Halted, but an event before cycleLimit may still bring an interrupt
+        bool isWaiting(uint64_t cycleLimit) const {
+            return instructions.isHalted() && flags.getFlag(FLAGS::IF) && scheduler.nextDeadline() < cycleLimit;
+        }
+
+        // One block (or instruction), skipping ahead through polling loops
+        // without passing the limits (see skipSpin). An intrinsic run in
+        // place of the block keeps to the same limits.
+        void step(uint64_t cycleLimit, uint64_t instructionLimit) {
+            if (executionMode != ExecutionMode::Interpreter && !instructions.getAttention()) {
+                instructions.executeBlock(total_cycles, instruction_count,
+                                          std::min(scheduler.nextDeadline(), cycleLimit), instructionLimit);
+                skipSpin(cycleLimit, instructionLimit);
+                runEvents();
+            } else {
+                executeInstruction();
+            }
+        }
+
     public:
-        CPU() : memory(), registers(), flags(), ioController(), instructions(memory, registers, flags, ioController),
-                total_cycles(0), instruction_count(0) {
-            // Default initialization
+        // With sparseMemory, RAM pages are only allocated once written, for
+        // keeping many small instances resident at once
+        explicit CPU(bool sparseMemory = false)
+            : memory(sparseMemory), registers(), flags(), ioController(), instructions(memory, registers, flags, ioController),
+              pit(scheduler, total_cycles), total_cycles(0), instruction_count(0), executionMode(ExecutionMode::Threaded) {
+            pit.attach(ioController);
+            pic.attach(ioController);
+            pit.setOutputHandler(0, [this](bool high) { pic.setIRQ(0, high); });
+            pic.setRequestHandler([this](bool requesting) { instructions.setInterruptRequest(requesting); });
         }
 
         // Load binary into memory at specific address
@@ -53,12 +244,122 @@ namespace CPU {
             uint32_t cycles = instructions.executeNext();
             total_cycles += cycles;
             instruction_count++;
+            runEvents();
         }
 
-        // Run the CPU until HLT or error
+        // Guest routines run as host code, in threaded and JIT mode
+        void addIntrinsic(Instructions::Intrinsic intrinsic) { instructions.addIntrinsic(std::move(intrinsic)); }
+        void clearIntrinsics() { instructions.clearIntrinsics(); }
+
+        // Device events, on the same clock as getTotalCycles()
+        Scheduler& getScheduler() { return scheduler; }
+
+        // Interval timer on ports 40h-43h, channel 0 on IRQ0
+        IO::PIT& getTimer() { return pit; }
+
+        // Interrupt controllers on ports 20h/21h and A0h/A1h
+        IO::PIC& getInterruptController() { return pic; }
+
+        // Execution mode used by step() and run()
+        void setExecutionMode(ExecutionMode mode) {
+            executionMode = mode;
+            instructions.setJitEnabled(mode == ExecutionMode::Jit);
+        }
+        ExecutionMode getExecutionMode() const { return executionMode; }
+
+        // Send console output (BIOS/DOS teletype services and the serial
+        // port) to output and take keyboard input from input, instead of
+        // std::cout and a key that always reads 'A'
+        void setConsole(std::istream *input, std::ostream &output) {
+            instructions.setConsole(input, output);
+            std::ostream *out = &output;
+            ioController.registerOutputHandler(IO::SERIAL_DATA, [out](uint16_t, uint8_t value) {
+                *out << static_cast<char>(value);
+            });
+        }
+
+        // Gate address line 20 (off by default, as on the 8086)
+        void setA20Enabled(bool enabled) { memory.setA20Enabled(enabled); }
+        bool isA20Enabled() const { return memory.isA20Enabled(); }
+
+        // Make the current memory contents what reset() restores, so a
+        // program loaded once survives resets between runs
+        void setMemoryBaseline() { memory.setBaseline(); }
+
+        // Capture the machine state, copying only the memory pages written
+        // since the last snapshot or restore. Restoring rewrites only the
+        // pages that differ from the snapshot. Neither changes what reset()
+        // restores; that is only ever the baseline. The memory map, devices'
+        // handlers and the execution mode are configuration, not state, and
+        // are left alone. So are scheduled events, which are moved to stay
+        // as many cycles away from the restored cycle count; the timer's
+        // own are set up again from its restored state.
+        Snapshot snapshot() {
+            Snapshot state;
+            state.registers = registers;
+            state.flags = flags;
+            state.halted = instructions.isHalted();
+            state.a20Enabled = memory.isA20Enabled();
+            state.totalCycles = total_cycles;
+            state.instructionCount = instruction_count;
+            state.memory = memory.snapshot();
+            state.portValues = ioController.getPortValues();
+            state.timer = pit.getState();
+            state.interruptController = pic.getState();
+            return state;
+        }
+
+        void restore(const Snapshot &state) {
+            registers = state.registers;
+            flags = state.flags;
+            instructions.setHaltState(state.halted);
+            memory.setA20Enabled(state.a20Enabled);
+            scheduler.rebase(total_cycles, state.totalCycles);
+            total_cycles = state.totalCycles;
+            instruction_count = state.instructionCount;
+            memory.restore(state.memory);
+            ioController.setPortValues(state.portValues);
+            pit.setState(state.timer);
+            pic.setState(state.interruptController);
+            instructions.refreshAttention();
+            spin.armed = false;
+        }
+
+        // The machine's parts, for engines that keep the register file
+        // themselves and only step this CPU now and then (see Lockstep)
+        Registers& getRegisters() { return registers; }
+        Flags& getFlags() { return flags; }
+        Memory& getMemory() { return memory; }
+        bool isHalted() const { return instructions.isHalted(); }
+
+        // Bytes of guest RAM allocated, all of it unless memory is sparse
+        size_t getResidentMemory() const { return memory.getResidentSize(); }
+
+        // Memory map: RAM everywhere until something else is mapped over it
+        void mapRam(uint32_t start, size_t size) { memory.mapRam(start, size); }
+        void mapRom(uint32_t start, std::shared_ptr<const std::vector<uint8_t>> image) {
+            memory.mapRom(start, std::move(image));
+        }
+        void mapMmio(uint32_t start, size_t size, MemoryReadHandler read, MemoryWriteHandler write) {
+            memory.mapMmio(start, size, std::move(read), std::move(write));
+        }
+
+        // Execute one instruction, or one basic block in threaded mode.
+        // Interrupts are taken between blocks. With TF set, instructions are
+        // run one at a time so that each can trap. A block that turns out
+        // to be a polling loop which can't see anything change before the
+        // next device event is run up to that event in one go, with the
+        // counters as if its iterations had been executed. So is a routine
+        // that has an intrinsic (see addIntrinsic).
+        void step() {
+            step(Scheduler::NEVER, Scheduler::NEVER);
+        }
+
+        // Run the CPU until HLT or error. HLT with interrupts enabled waits
+        // for the next one while device events are scheduled.
         void run() {
-            while (!instructions.isHalted()) {
-                executeInstruction();
+            while (!instructions.isHalted() || waitForInterrupt(Scheduler::NEVER)) {
+                step();
             }
             
             // Display cycle information when execution ends
@@ -71,10 +372,95 @@ namespace CPU {
             }
         }
 
+        // Run until HLT or until a budget runs out, without printing anything.
+        // Faults are reported in the result rather than thrown. The
+        // instruction budget is exact: close to it, instructions are run one
+        // at a time. The cycle budget is checked between blocks, so it can be
+        // overrun by one block, and the deadline every few hundred blocks.
+        // HLT with interrupts enabled waits for the next one, as run() does;
+        // waiting past the cycle budget stops on the budget.
+        RunResult run(const RunLimits &limits) {
+            static constexpr uint32_t DEADLINE_INTERVAL = 256;  // Steps between clock reads
+
+            RunResult result;
+            uint64_t startInstructions = instruction_count;
+            uint64_t startCycles = total_cycles;
+            bool hasDeadline = limits.deadline != std::chrono::steady_clock::time_point::max();
+            uint32_t untilClock = DEADLINE_INTERVAL;
+
+            // Polling loops are only skipped as far as the budgets would
+            // have let them run block by block
+            uint64_t cycleLimit = limits.maxCycles ? startCycles + limits.maxCycles : Scheduler::NEVER;
+            uint64_t instructionLimit = Scheduler::NEVER;
+            if (limits.maxInstructions) {
+                instructionLimit = limits.maxInstructions >= Instructions::MAX_BLOCK_LENGTH
+                    ? startInstructions + limits.maxInstructions - Instructions::MAX_BLOCK_LENGTH
+                    : 0;
+            }
+
+            try {
+                while (true) {
+                    // A wait goes from event to event without running
+                    // anything, so the deadline is looked at after every
+                    // few hundred of them
+                    if (instructions.isHalted() && !waitForInterrupt(cycleLimit, DEADLINE_INTERVAL)) {
+                        if (!isWaiting(cycleLimit)) {
+                            if (limits.maxCycles && total_cycles - startCycles >= limits.maxCycles) {
+                                result.reason = StopReason::CycleLimit;
+                            }
+                            break;
+                        }
+                        if (hasDeadline && std::chrono::steady_clock::now() >= limits.deadline) {
+                            result.reason = StopReason::Deadline;
+                            break;
+                        }
+                        continue;
+                    }
+
+                    uint64_t executed = instruction_count - startInstructions;
+                    if (limits.maxInstructions && executed >= limits.maxInstructions) {
+                        result.reason = StopReason::InstructionLimit;
+                        break;
+                    }
+                    if (limits.maxCycles && total_cycles - startCycles >= limits.maxCycles) {
+                        result.reason = StopReason::CycleLimit;
+                        break;
+                    }
+                    if (hasDeadline && --untilClock == 0) {
+                        untilClock = DEADLINE_INTERVAL;
+                        if (std::chrono::steady_clock::now() >= limits.deadline) {
+                            result.reason = StopReason::Deadline;
+                            break;
+                        }
+                    }
+
+                    if (limits.maxInstructions &&
+                        limits.maxInstructions - executed < Instructions::MAX_BLOCK_LENGTH) {
+                        executeInstruction();
+                    } else {
+                        step(cycleLimit, instructionLimit);
+                    }
+                }
+            } catch (const std::exception& e) {
+                result.reason = StopReason::Fault;
+                result.fault = e.what();
+                result.faultCS = registers.CS;
+                result.faultIP = registers.IP;
+            }
+
+            result.instructions = instruction_count - startInstructions;
+            result.cycles = total_cycles - startCycles;
+            return result;
+        }
+
         // Get cycle and instruction count
         uint64_t getTotalCycles() const { return total_cycles; }
         uint64_t getInstructionCount() const { return instruction_count; }
 
+        // Cycles run for this CPU elsewhere (a Lockstep lane's vector path),
+        // so its devices keep time with them
+        void addCycles(uint64_t cycles) { total_cycles += cycles; }
+
         // Debug methods
         void dumpRegisters() const {
             std::cout << "AX: " << std::hex << registers.AX.value << " BX: " << registers.BX.value
@@ -96,18 +482,23 @@ namespace CPU {
             registers = Registers();
             flags = Flags();
             
-            // Reset memory
-            for (size_t i = 0; i < Memory::MEMORY_SIZE; i++) {
-                memory.writeByte(i, 0);
-            }
+            // Put the memory back to its baseline, whatever snapshots were
+            // taken or restored since
+            memory.clear();
+            instructions.installServices();
             
-            // Reset cycle counting
+            // Reset cycle counting, keeping device events as far off as they were
+            scheduler.rebase(total_cycles, 0);
             total_cycles = 0;
             instruction_count = 0;
+            ioController.reset();
+            pit.reset();
+            pic.reset();
             
             // We can't reassign instructions due to reference members,
             // so we'll ensure the CPU is not halted
             instructions.resetHaltState();
+            spin.armed = false;
         }
     };
 
@@ -0,0 +1,183 @@
+#include "decoder.hpp"
+#include <array>
+
+namespace CPU {
+
+    //--------------------------------------------------------------------------
+    // Operand formats
+    //--------------------------------------------------------------------------
+    // Which operand bytes follow each opcode. This mirrors what the handlers in
+    // instructions.cpp consume, so unassigned opcodes decode as a single byte.
+    enum OperandFormat : uint8_t {
+        NONE   = 0,
+        MODRM  = 1 << 0,  // ModR/M byte, plus displacement for memory forms
+        IMM8   = 1 << 1,  // 8-bit immediate
+        IMM16  = 1 << 2,  // 16-bit immediate
+        GROUP3 = 1 << 3,  // F6/F7: TEST (reg 0/1) carries an immediate sized by the w bit
+        PREFIX = 1 << 4,  // REP/REPNE prefix, decoded together with its string operation
+        SEXT   = 1 << 5,  // 8-bit immediate sign-extended to 16 bits
+    };
+
+    static constexpr std::array<uint8_t, 256> buildFormatTable() {
+        std::array<uint8_t, 256> f{};
+
+        // ALU operations (ADD, OR, ADC, SBB, AND, SUB, XOR, CMP): four
+        // r/m <-> reg forms, then AL, imm8 and AX, imm16
+        for (int base = 0x00; base < 0x40; base += 0x08) {
+            for (int op = base; op < base + 4; op++) {
+                f[op] = MODRM;
+            }
+            f[base + 4] = IMM8;
+            f[base + 5] = IMM16;
+        }
+
+        // Group 1 (immediate to r/m)
+        f[0x80] = MODRM | IMM8;
+        f[0x81] = MODRM | IMM16;
+        f[0x83] = MODRM | IMM8 | SEXT;
+
+        // MOV r/m <-> reg
+        for (int op = 0x88; op <= 0x8B; op++) {
+            f[op] = MODRM;
+        }
+
+        // MOV reg, imm
+        for (int op = 0xB0; op <= 0xB7; op++) {
+            f[op] = IMM8;
+        }
+        for (int op = 0xB8; op <= 0xBF; op++) {
+            f[op] = IMM16;
+        }
+
+        // Conditional jumps. JNE/JG/JGE/JL/JLE take a 16-bit offset in this
+        // emulator, see handleJNE and friends.
+        f[0x74] = IMM8;
+        f[0x75] = IMM16;
+        f[0x77] = IMM16;
+        f[0x7C] = IMM16;
+        f[0x7D] = IMM16;
+        f[0x7E] = IMM16;
+
+        // Shift/rotate group
+        for (int op = 0xD0; op <= 0xD3; op++) {
+            f[op] = MODRM;
+        }
+
+        // I/O with an immediate port
+        for (int op = 0xE4; op <= 0xE7; op++) {
+            f[op] = IMM8;
+        }
+
+        f[0xCD] = IMM8;   // INT imm8
+        f[0xF1] = IMM8;   // Host service trap, vector in the immediate
+        f[0xE8] = IMM16;  // CALL rel16
+        f[0xE9] = IMM16;  // JMP rel16
+        f[0xEB] = IMM8;   // JMP rel8
+
+        f[0xF2] = PREFIX;
+        f[0xF3] = PREFIX;
+        f[0xF6] = MODRM | GROUP3;
+        f[0xF7] = MODRM | GROUP3;
+
+        return f;
+    }
+
+    static constexpr std::array<uint8_t, 256> formatTable = buildFormatTable();
+
+    static bool isStringOpcode(uint8_t opcode) {
+        return (opcode >= 0xA4 && opcode <= 0xA7) || (opcode >= 0xAA && opcode <= 0xAF);
+    }
+
+    //--------------------------------------------------------------------------
+    // Decoder
+    //--------------------------------------------------------------------------
+    Decoder::Decoder(Memory &mem) : memory(mem), cache(CACHE_SIZE) {}
+
+    void Decoder::flush() {
+        for (auto &entry : cache) {
+            entry.address = INVALID_ADDRESS;
+        }
+    }
+
+    const DecodedInstruction& Decoder::refill(Entry &entry, uint16_t segment, uint16_t offset, uint32_t address) {
+        DecodedInstruction insn = decode(segment, offset);
+
+        // The bytes of an instruction that wraps past offset 0xFFFF aren't
+        // contiguous in physical memory, so don't cache it
+        if (static_cast<uint32_t>(offset) + insn.length > 0x10000) {
+            uncached = insn;
+            return uncached;
+        }
+
+        uint32_t last = address + insn.length - 1;
+        memory.markCodePage(address);
+        memory.markCodePage(last);
+
+        entry.address = address;
+        entry.firstVersion = memory.getCodePageVersion(address);
+        entry.lastVersion = memory.getCodePageVersion(last);
+        entry.insn = insn;
+        return entry.insn;
+    }
+
+    DecodedInstruction Decoder::decode(uint16_t segment, uint16_t offset) const {
+        DecodedInstruction insn;
+        uint16_t ip = offset;
+
+        auto nextByte = [&]() -> uint8_t {
+            return memory.readByte(memory.calculatePhysicalAddress(segment, ip++));
+        };
+        auto nextWord = [&]() -> uint16_t {
+            uint8_t low = nextByte();
+            return static_cast<uint16_t>(low | (nextByte() << 8));
+        };
+
+        insn.opcode = nextByte();
+        insn.isWord = (insn.opcode & 0x01) != 0;
+        uint8_t format = formatTable[insn.opcode];
+
+        if (format & PREFIX) {
+            // REP only repeats string operations; anything else runs on its own
+            uint8_t next = memory.readByte(memory.calculatePhysicalAddress(segment, ip));
+            if (isStringOpcode(next)) {
+                insn.stringOpcode = nextByte();
+                insn.isWord = (next & 0x01) != 0;
+            }
+        }
+
+        if (format & MODRM) {
+            insn.modrm = nextByte();
+            insn.mod = (insn.modrm >> 6) & 0x03;
+            insn.reg = (insn.modrm >> 3) & 0x07;
+            insn.rm = insn.modrm & 0x07;
+
+            if (insn.mod == 0b00 && insn.rm == 0b110) {
+                insn.disp = nextWord();  // Direct address
+            } else if (insn.mod == 0b01) {
+                insn.disp = static_cast<uint16_t>(static_cast<int8_t>(nextByte()));
+            } else if (insn.mod == 0b10) {
+                insn.disp = nextWord();
+            }
+
+            if ((format & GROUP3) && insn.reg <= 1) {
+                format |= insn.isWord ? IMM16 : IMM8;
+            }
+        }
+
+        if (format & SEXT) {
+            insn.imm = static_cast<uint16_t>(static_cast<int8_t>(nextByte()));
+        } else if (format & IMM8) {
+            insn.imm = nextByte();
+        } else if (format & IMM16) {
+            insn.imm = nextWord();
+        }
+
+        if (insn.opcode >= 0xB0 && insn.opcode <= 0xBF) {
+            insn.isWord = (insn.opcode >= 0xB8);
+        }
+
+        insn.length = static_cast<uint8_t>(static_cast<uint16_t>(ip - offset));
+        return insn;
+    }
+
+} // namespace CPU
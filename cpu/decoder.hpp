@@ -0,0 +1,74 @@
+#ifndef DECODER_HPP
+#define DECODER_HPP
+
+#include <cstdint>
+#include <vector>
+#include "memory.hpp"
+
+namespace CPU {
+
+    // An instruction with all of its operand bytes already pulled out of the
+    // instruction stream. Handlers read their ModR/M fields, displacement and
+    // immediate from here instead of fetching them at CS:IP.
+    struct DecodedInstruction {
+        uint8_t  opcode = 0;        // Primary opcode (the prefix byte for REP/REPNE)
+        uint8_t  stringOpcode = 0;  // String operation following a REP prefix, 0 if none
+        uint8_t  length = 0;        // Total length in bytes, including operands
+        bool     isWord = false;    // Operand width (w bit of the opcode)
+
+        // ModR/M byte and its fields (only valid when the opcode takes one)
+        uint8_t  modrm = 0;
+        uint8_t  mod = 0;
+        uint8_t  reg = 0;
+        uint8_t  rm = 0;
+
+        uint16_t disp = 0;          // Displacement (disp8 sign-extended) or direct address
+        uint16_t imm = 0;           // Immediate (sign-extended for 0x83), port, interrupt number or relative offset
+    };
+
+    // Predecode cache keyed by physical address. Entries remember the version
+    // of the code pages they were decoded from, so a write into those pages
+    // (self-modifying code, or a new program being loaded) forces a re-decode.
+    class Decoder {
+    public:
+        explicit Decoder(Memory &mem);
+
+        // Return the decoded instruction at segment:offset, decoding on a miss
+        const DecodedInstruction& fetch(uint16_t segment, uint16_t offset) {
+            uint32_t address = memory.calculatePhysicalAddress(segment, offset);
+            Entry &entry = cache[address & (CACHE_SIZE - 1)];
+            if (entry.address == address &&
+                entry.firstVersion == memory.getCodePageVersion(address) &&
+                entry.lastVersion == memory.getCodePageVersion(address + entry.insn.length - 1)) {
+                return entry.insn;
+            }
+            return refill(entry, segment, offset, address);
+        }
+
+        // Drop every cached instruction
+        void flush();
+
+    private:
+        static constexpr size_t CACHE_SIZE = 4096;  // Direct-mapped, must be a power of two
+        static constexpr uint32_t INVALID_ADDRESS = 0xFFFFFFFF;
+
+        struct Entry {
+            uint32_t address = INVALID_ADDRESS;
+            uint32_t firstVersion = 0;  // Version of the page holding the first byte
+            uint32_t lastVersion = 0;   // Version of the page holding the last byte
+            DecodedInstruction insn;
+        };
+
+        Memory &memory;
+        std::vector<Entry> cache;
+
+        // Instructions that wrap around the end of the code segment aren't cached
+        DecodedInstruction uncached;
+
+        const DecodedInstruction& refill(Entry &entry, uint16_t segment, uint16_t offset, uint32_t address);
+        DecodedInstruction decode(uint16_t segment, uint16_t offset) const;
+    };
+
+} // namespace CPU
+
+#endif // DECODER_HPP
@@ -9,15 +9,92 @@
 #include <iostream>
 
 namespace CPU {
+    enum FLAGS {
+        CF = 1 << 0, //Carry
+        PF = 1 << 2, //Parity - Bitwise
+        AF = 1 << 4, //Auxillary Carry Indicates a carry/borrow between the lower nibble (4 bits) during BCD (Binary-Coded Decimal) operations.
+        ZF = 1 << 6, //Zero
+        SF = 1 << 7, //Sign - Only necessary when distinguishing between signed and unsigned numbers /TODO
+        TF = 1 << 8, //Trap - Debugging
+        IF = 1 << 9, //Interrupt Enable
+        DF = 1 << 10, //Direction
+        OF = 1 << 11, //Overflow
+    };
+
+    // Flags written by an arithmetic or logic operation
+    constexpr uint16_t ARITHMETIC_FLAGS = CF | PF | AF | ZF | SF | OF;
+
+    // Kind of the last ALU operation, which decides how its flags are derived
+    enum class FlagOp : uint8_t {
+        Add,    // ADD, ADC
+        Sub,    // SUB, SBB, CMP, NEG, CMPS, SCAS
+        Inc,    // INC: like Add but CF is left alone
+        Dec,    // DEC: like Sub but CF is left alone
+        Logic,  // AND, OR, XOR: CF, OF and AF cleared
+    };
+
     class Flags {
     private:
-        uint16_t flags;
+        // Arithmetic flags are evaluated lazily: an ALU operation only records
+        // its operands and result, and the bits listed in `pending` are worked
+        // out from that record the first time one of them is read.
+        mutable uint16_t flags;
+        mutable uint16_t pending;
+
+        FlagOp   lastOp;
+        bool     lastIsWord;
+        uint32_t lastResult;  // Unmasked, so a carry or borrow shows past the operand width
+        uint16_t lastDest;
+        uint16_t lastSrc;
+
+        bool carryOut() const {
+            return lastResult > (lastIsWord ? 0xFFFFu : 0xFFu);
+        }
+
+        void materialize() const {
+            uint16_t signBit = lastIsWord ? 0x8000 : 0x80;
+            uint16_t result = static_cast<uint16_t>(lastResult & (lastIsWord ? 0xFFFF : 0xFF));
+            uint16_t value = 0;
+
+            if (result == 0) value |= ZF;
+            if (result & signBit) value |= SF;
+
+            // Parity of the low byte
+            uint8_t parity = static_cast<uint8_t>(result);
+            parity ^= parity >> 4;
+            parity ^= parity >> 2;
+            parity ^= parity >> 1;
+            if (!(parity & 1)) value |= PF;
+
+            switch (lastOp) {
+                case FlagOp::Add:
+                case FlagOp::Inc:
+                    if (carryOut()) value |= CF;
+                    if ((lastDest ^ result) & (lastSrc ^ result) & signBit) value |= OF;
+                    if ((lastDest ^ lastSrc ^ result) & 0x10) value |= AF;
+                    break;
+                case FlagOp::Sub:
+                case FlagOp::Dec:
+                    if (carryOut()) value |= CF;
+                    if ((lastDest ^ lastSrc) & (lastDest ^ result) & signBit) value |= OF;
+                    if ((lastDest ^ lastSrc ^ result) & 0x10) value |= AF;
+                    break;
+                case FlagOp::Logic:
+                    break;
+            }
+
+            flags = static_cast<uint16_t>((flags & ~pending) | (value & pending));
+            pending = 0;
+        }
+
     public:
-        Flags(): flags(0){}
+        Flags(): flags(0), pending(0), lastOp(FlagOp::Logic), lastIsWord(false),
+                 lastResult(0), lastDest(0), lastSrc(0) {}
 
-        void reset(){flags = 0;}
+        void reset(){flags = 0; pending = 0;}
 
         void setFlag(uint16_t flagMask, bool value) {
+            pending &= ~flagMask;
             if(value)
                 flags |= flagMask;
             else
@@ -25,24 +102,51 @@ namespace CPU {
         }
 
         bool getFlag(uint16_t flagMask) const {
+            if (pending & flagMask) {
+                materialize();
+            }
             return (flags & flagMask) != 0;
         }
 
-        void dumpFlags() const {
-            std::cout << "Flags: " << std::hex << flags << std::endl;
+        // Record an ALU operation; its flags are computed when first read.
+        // result is the unmasked result (dest + src, dest - src, ...).
+        void setResult(FlagOp op, uint32_t result, uint16_t dest, uint16_t src, bool isWord) {
+            uint16_t written = ARITHMETIC_FLAGS;
+            if (op == FlagOp::Inc || op == FlagOp::Dec) {
+                // CF survives INC/DEC, so settle it before the record is replaced
+                written &= ~CF;
+                if (pending & CF) {
+                    setFlag(CF, carryOut());
+                }
+            }
+
+            lastOp = op;
+            lastIsWord = isWord;
+            lastResult = result;
+            lastDest = dest;
+            lastSrc = src;
+            pending |= written;
         }
-    };
 
-    enum FLAGS {
-        CF = 1 << 0, //Carry
-        PF = 1 << 2, //Parity - Bitwise
-        AF = 1 << 4, //Auxillary Carry Indicates a carry/borrow between the lower nibble (4 bits) during BCD (Binary-Coded Decimal) operations.
-        ZF = 1 << 6, //Zero
-        SF = 1 << 7, //Sign - Only necessary when distinguishing between signed and unsigned numbers /TODO
-        TF = 1 << 8, //Trap - Debugging
-        IF = 1 << 9, //Interrupt Enable
-        DF = 1 << 10, //Direction
-        OF = 1 << 11, //Overflow
+        // Whole FLAGS word
+        uint16_t getValue() const {
+            if (pending) {
+                materialize();
+            }
+            return flags;
+        }
+        void setValue(uint16_t value) { flags = value; pending = 0; }
+
+        // Stored bits and the mask of bits still owed by the recorded
+        // operation, for carrying the flags through compiled code without
+        // evaluating them
+        uint16_t getRawValue() const { return flags; }
+        uint16_t getPendingMask() const { return pending; }
+        void setRawValue(uint16_t value, uint16_t pendingMask) { flags = value; pending = pendingMask; }
+
+        void dumpFlags() const {
+            std::cout << "Flags: " << std::hex << getValue() << std::endl;
+        }
     };
 }
 
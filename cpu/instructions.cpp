@@ -1,4 +1,5 @@
 #include "instructions.hpp"
+#include <algorithm>
 #include <stdexcept>
 #include <iostream>
 #include "../utils/utils.h"
@@ -7,189 +8,277 @@ namespace CPU {
 
     static cpu::UTILS utils; 
 
+    // Page of service stubs, one per vector: SERVICE_TRAP n, IRET. Shared
+    // by every instance, as ROM images are never written.
+    static std::shared_ptr<const std::vector<uint8_t>> serviceRom() {
+        static const auto image = [] {
+            auto rom = std::make_shared<std::vector<uint8_t>>(Memory::PAGE_SIZE, 0);
+            for (int vector = 0; vector < 256; vector++) {
+                (*rom)[vector * 4] = Instructions::SERVICE_TRAP;
+                (*rom)[vector * 4 + 1] = static_cast<uint8_t>(vector);
+                (*rom)[vector * 4 + 2] = 0xCF;  // IRET
+            }
+            return std::shared_ptr<const std::vector<uint8_t>>(std::move(rom));
+        }();
+        return image;
+    }
+
     //--------------------------------------------------------------------------
-    // Constructor: populate opcodeTable
+    // Constructor
     //--------------------------------------------------------------------------
     Instructions::Instructions(Memory &mem, Registers &reg, Flags &flg, IO::IOController &ioController)
-        : memory(mem), registers(reg), flags(flg), io(ioController), halted(false)
+        : memory(mem), registers(reg), flags(flg), io(ioController), halted(false), decoder(mem)
     {
-        // MOV instructions (a subset of them: 88, 89, 8A, 8B)
-        opcodeTable[0x88] = std::bind(&Instructions::handleMOV, this);
-        opcodeTable[0x89] = std::bind(&Instructions::handleMOV, this);
-        opcodeTable[0x8A] = std::bind(&Instructions::handleMOV, this);
-        opcodeTable[0x8B] = std::bind(&Instructions::handleMOV, this);
+        memory.mapRom(static_cast<uint32_t>(SERVICE_SEGMENT) << 4, serviceRom());
+        setService(0x10, [this] { videoService(); });
+        setService(0x16, [this] { keyboardService(); });
+        setService(0x21, [this] { dosService(); });
+        addBuiltinIntrinsics();
+    }
+
+    //--------------------------------------------------------------------------
+    // Dispatch tables
+    //--------------------------------------------------------------------------
+    constexpr std::array<Instructions::InstructionHandler, 256> Instructions::buildOpcodeTable() {
+        std::array<InstructionHandler, 256> t{};
+        for (auto &entry : t) {
+            entry = &Instructions::handleUnknown;
+        }
+
+        // MOV r/m <-> reg (88, 89, 8A, 8B)
+        t[0x88] = &Instructions::dispatchModRM<&Instructions::handleMOV<false, false, Operand::Reg>,
+                                               &Instructions::handleMOV<false, false, Operand::Mem>>;
+        t[0x89] = &Instructions::dispatchModRM<&Instructions::handleMOV<true, false, Operand::Reg>,
+                                               &Instructions::handleMOV<true, false, Operand::Mem>>;
+        t[0x8A] = &Instructions::dispatchModRM<&Instructions::handleMOV<false, true, Operand::Reg>,
+                                               &Instructions::handleMOV<false, true, Operand::Mem>>;
+        t[0x8B] = &Instructions::dispatchModRM<&Instructions::handleMOV<true, true, Operand::Reg>,
+                                               &Instructions::handleMOV<true, true, Operand::Mem>>;
 
         // MOV register, immediate instructions (0xB0-0xBF)
         // 8-bit registers (AL, CL, DL, BL, AH, CH, DH, BH)
         for (uint8_t op = 0xB0; op <= 0xB7; ++op) {
-            opcodeTable[op] = std::bind(&Instructions::handleMOVRegImm, this);
+            t[op] = &Instructions::handleMOVRegImm<false>;
         }
         // 16-bit registers (AX, CX, DX, BX, SP, BP, SI, DI)
         for (uint8_t op = 0xB8; op <= 0xBF; ++op) {
-            opcodeTable[op] = std::bind(&Instructions::handleMOVRegImm, this);
+            t[op] = &Instructions::handleMOVRegImm<true>;
         }
 
-        // ADD instructions
-        opcodeTable[0x00] = std::bind(&Instructions::handleADD8, this);  // ADD r/m8, r8
-        opcodeTable[0x01] = std::bind(&Instructions::handleADD, this);   // ADD r/m16, r16
-        opcodeTable[0x02] = std::bind(&Instructions::handleADD8, this);  // ADD r8, r/m8
-        opcodeTable[0x03] = std::bind(&Instructions::handleADD, this);   // ADD r16, r/m16
-        opcodeTable[0x04] = std::bind(&Instructions::handleADDImm8, this); // ADD AL, imm8
-        opcodeTable[0x05] = std::bind(&Instructions::handleADDImm16, this); // ADD AX, imm16
-        
-        // ADC instructions (Add with Carry)
-        opcodeTable[0x10] = std::bind(&Instructions::handleADC8, this);  // ADC r/m8, r8
-        opcodeTable[0x11] = std::bind(&Instructions::handleADC, this);   // ADC r/m16, r16
-        opcodeTable[0x12] = std::bind(&Instructions::handleADC8, this);  // ADC r8, r/m8
-        opcodeTable[0x13] = std::bind(&Instructions::handleADC, this);   // ADC r16, r/m16
-        
-        // SUB
-        opcodeTable[0x29] = std::bind(&Instructions::handleSUB, this);  // SUB r/m16, r16
-        opcodeTable[0x2B] = std::bind(&Instructions::handleSUB, this);  // SUB r16, r/m16
-        
-        // SBB instructions (Subtract with Borrow)
-        opcodeTable[0x18] = std::bind(&Instructions::handleSBB8, this);  // SBB r/m8, r8
-        opcodeTable[0x19] = std::bind(&Instructions::handleSBB, this);   // SBB r/m16, r16
-        opcodeTable[0x1A] = std::bind(&Instructions::handleSBB8, this);  // SBB r8, r/m8
-        opcodeTable[0x1B] = std::bind(&Instructions::handleSBB, this);   // SBB r16, r/m16
+        // ALU operations: op r/m8, r8 / op r/m16, r16 / op r8, r/m8 /
+        // op r16, r/m16 / op AL, imm8 / op AX, imm16 at (op << 3) + 0..5
+        setALUHandlers<AluOp::Add>(t);
+        setALUHandlers<AluOp::Or>(t);
+        setALUHandlers<AluOp::Adc>(t);
+        setALUHandlers<AluOp::Sbb>(t);
+        setALUHandlers<AluOp::And>(t);
+        setALUHandlers<AluOp::Sub>(t);
+        setALUHandlers<AluOp::Xor>(t);
+        setALUHandlers<AluOp::Cmp>(t);
 
         // INC and DEC (0x40-0x4F in many forms)
         for(uint8_t op = 0x40; op <= 0x47; ++op) {
-            opcodeTable[op] = std::bind(&Instructions::handleINC, this);
+            t[op] = &Instructions::handleINC;
         }
         for(uint8_t op = 0x48; op <= 0x4F; ++op) {
-            opcodeTable[op] = std::bind(&Instructions::handleDEC, this);
+            t[op] = &Instructions::handleDEC;
         }
 
         // Flag Control Instructions
-        opcodeTable[0xF8] = std::bind(&Instructions::handleCLC, this);  // CLC - Clear Carry Flag
-        opcodeTable[0xF9] = std::bind(&Instructions::handleSTC, this);  // STC - Set Carry Flag
-        opcodeTable[0xF5] = std::bind(&Instructions::handleCMC, this);  // CMC - Complement Carry Flag
-        opcodeTable[0xFC] = std::bind(&Instructions::handleCLD, this);  // CLD - Clear Direction Flag
-        opcodeTable[0xFD] = std::bind(&Instructions::handleSTD, this);  // STD - Set Direction Flag
-        opcodeTable[0xFA] = std::bind(&Instructions::handleCLI, this);  // CLI - Clear Interrupt Flag
-        opcodeTable[0xFB] = std::bind(&Instructions::handleSTI, this);  // STI - Set Interrupt Flag
-
-        // CMP instructions
-        opcodeTable[0x38] = std::bind(&Instructions::handleCMP, this);  // CMP r/m8, r8
-        opcodeTable[0x39] = std::bind(&Instructions::handleCMP, this);  // CMP r/m16, r16
-        opcodeTable[0x3A] = std::bind(&Instructions::handleCMP, this);  // CMP r8, r/m8
-        opcodeTable[0x3B] = std::bind(&Instructions::handleCMP, this);  // CMP r16, r/m16
-        opcodeTable[0x3C] = std::bind(&Instructions::handleCMPImm, this); // CMP AL, imm8
-        opcodeTable[0x3D] = std::bind(&Instructions::handleCMPImm, this); // CMP AX, imm16
-        
-        // Group 1 instructions (including CMP r/m, imm)
-        opcodeTable[0x80] = std::bind(&Instructions::handleGroup1, this); // CMP r/m8, imm8
-        opcodeTable[0x81] = std::bind(&Instructions::handleGroup1, this); // CMP r/m16, imm16
-        opcodeTable[0x83] = std::bind(&Instructions::handleGroup1, this); // CMP r/m16, imm8 (sign-extended)
+        t[0xF8] = &Instructions::handleCLC;  // CLC - Clear Carry Flag
+        t[0xF9] = &Instructions::handleSTC;  // STC - Set Carry Flag
+        t[0xF5] = &Instructions::handleCMC;  // CMC - Complement Carry Flag
+        t[0xFC] = &Instructions::handleCLD;  // CLD - Clear Direction Flag
+        t[0xFD] = &Instructions::handleSTD;  // STD - Set Direction Flag
+        t[0xFA] = &Instructions::handleCLI;  // CLI - Clear Interrupt Flag
+        t[0xFB] = &Instructions::handleSTI;  // STI - Set Interrupt Flag
+
+        // Group 1 instructions (ALU operation r/m, imm)
+        t[0x80] = &Instructions::handleGroup1; // op r/m8, imm8
+        t[0x81] = &Instructions::handleGroup1; // op r/m16, imm16
+        t[0x83] = &Instructions::handleGroup1; // op r/m16, imm8 (sign-extended)
 
         // String operations
-        opcodeTable[0xA4] = std::bind(&Instructions::handleMOVS, this); // MOVSB
-        opcodeTable[0xA5] = std::bind(&Instructions::handleMOVS, this); // MOVSW
-        opcodeTable[0xA6] = std::bind(&Instructions::handleCMPS, this); // CMPSB
-        opcodeTable[0xA7] = std::bind(&Instructions::handleCMPS, this); // CMPSW
-        opcodeTable[0xAA] = std::bind(&Instructions::handleSTOS, this); // STOSB
-        opcodeTable[0xAB] = std::bind(&Instructions::handleSTOS, this); // STOSW
-        opcodeTable[0xAC] = std::bind(&Instructions::handleLODS, this); // LODSB
-        opcodeTable[0xAD] = std::bind(&Instructions::handleLODS, this); // LODSW
-        opcodeTable[0xAE] = std::bind(&Instructions::handleSCAS, this); // SCASB
-        opcodeTable[0xAF] = std::bind(&Instructions::handleSCAS, this); // SCASW
-        opcodeTable[0xF2] = std::bind(&Instructions::handleREP, this);  // REPNE/REPNZ
-        opcodeTable[0xF3] = std::bind(&Instructions::handleREP, this);  // REP/REPE/REPZ
+        t[0xA4] = &Instructions::handleMOVS; // MOVSB
+        t[0xA5] = &Instructions::handleMOVS; // MOVSW
+        t[0xA6] = &Instructions::handleCMPS; // CMPSB
+        t[0xA7] = &Instructions::handleCMPS; // CMPSW
+        t[0xAA] = &Instructions::handleSTOS; // STOSB
+        t[0xAB] = &Instructions::handleSTOS; // STOSW
+        t[0xAC] = &Instructions::handleLODS; // LODSB
+        t[0xAD] = &Instructions::handleLODS; // LODSW
+        t[0xAE] = &Instructions::handleSCAS; // SCASB
+        t[0xAF] = &Instructions::handleSCAS; // SCASW
+        t[0xF2] = &Instructions::handleREP;  // REPNE/REPNZ
+        t[0xF3] = &Instructions::handleREP;  // REP/REPE/REPZ
 
         // I/O operations
-        opcodeTable[0xE4] = std::bind(&Instructions::handleIN, this);   // IN AL, imm8
-        opcodeTable[0xE5] = std::bind(&Instructions::handleIN, this);   // IN AX, imm8
-        opcodeTable[0xEC] = std::bind(&Instructions::handleIN, this);   // IN AL, DX
-        opcodeTable[0xED] = std::bind(&Instructions::handleIN, this);   // IN AX, DX
-        opcodeTable[0xE6] = std::bind(&Instructions::handleOUT, this);  // OUT imm8, AL
-        opcodeTable[0xE7] = std::bind(&Instructions::handleOUT, this);  // OUT imm8, AX
-        opcodeTable[0xEE] = std::bind(&Instructions::handleOUT, this);  // OUT DX, AL
-        opcodeTable[0xEF] = std::bind(&Instructions::handleOUT, this);  // OUT DX, AX
+        t[0xE4] = &Instructions::handleIN;   // IN AL, imm8
+        t[0xE5] = &Instructions::handleIN;   // IN AX, imm8
+        t[0xEC] = &Instructions::handleIN;   // IN AL, DX
+        t[0xED] = &Instructions::handleIN;   // IN AX, DX
+        t[0xE6] = &Instructions::handleOUT;  // OUT imm8, AL
+        t[0xE7] = &Instructions::handleOUT;  // OUT imm8, AX
+        t[0xEE] = &Instructions::handleOUT;  // OUT DX, AL
+        t[0xEF] = &Instructions::handleOUT;  // OUT DX, AX
 
         // Jumps
-        opcodeTable[0xEB] = std::bind(&Instructions::handleJMP, this);  // Short jump
-        opcodeTable[0xE9] = std::bind(&Instructions::handleJMP, this);  // Near jump
-        opcodeTable[0x74] = std::bind(&Instructions::handleJE, this);
-        opcodeTable[0x75] = std::bind(&Instructions::handleJNE, this);
-        opcodeTable[0x77] = std::bind(&Instructions::handleJG, this);
-        opcodeTable[0x7D] = std::bind(&Instructions::handleJGE, this);
-        opcodeTable[0x7C] = std::bind(&Instructions::handleJL, this);
-        opcodeTable[0x7E] = std::bind(&Instructions::handleJLE, this);
+        t[0xEB] = &Instructions::handleJMP;  // Short jump
+        t[0xE9] = &Instructions::handleJMP;  // Near jump
+        t[0x74] = &Instructions::handleJE;
+        t[0x75] = &Instructions::handleJNE;
+        t[0x77] = &Instructions::handleJG;
+        t[0x7D] = &Instructions::handleJGE;
+        t[0x7C] = &Instructions::handleJL;
+        t[0x7E] = &Instructions::handleJLE;
 
         // INT and HLT
-        opcodeTable[0xCD] = std::bind(&Instructions::handleINT, this);
-        opcodeTable[0xF4] = std::bind(&Instructions::handleHLT, this);
-
-        // Logical ops: AND, OR, XOR, NOT
-        opcodeTable[0x20] = std::bind(&Instructions::handleAND, this);
-        opcodeTable[0x21] = std::bind(&Instructions::handleAND, this);
-        opcodeTable[0x22] = std::bind(&Instructions::handleAND, this);
-        opcodeTable[0x23] = std::bind(&Instructions::handleAND, this);
-        opcodeTable[0x24] = std::bind(&Instructions::handleANDImm, this); // AND AL, imm8
-        opcodeTable[0x25] = std::bind(&Instructions::handleANDImm, this); // AND AX, imm16
-        
-        opcodeTable[0x08] = std::bind(&Instructions::handleOR,  this);
-        opcodeTable[0x09] = std::bind(&Instructions::handleOR,  this);
-        opcodeTable[0x0A] = std::bind(&Instructions::handleOR,  this);
-        opcodeTable[0x0B] = std::bind(&Instructions::handleOR,  this);
-        opcodeTable[0x0C] = std::bind(&Instructions::handleORImm,  this); // OR AL, imm8
-        opcodeTable[0x0D] = std::bind(&Instructions::handleORImm,  this); // OR AX, imm16
-        
-        opcodeTable[0x30] = std::bind(&Instructions::handleXOR, this);
-        opcodeTable[0x31] = std::bind(&Instructions::handleXOR, this);
-        opcodeTable[0x32] = std::bind(&Instructions::handleXOR, this);
-        opcodeTable[0x33] = std::bind(&Instructions::handleXOR, this);
-        opcodeTable[0x34] = std::bind(&Instructions::handleXORImm, this); // XOR AL, imm8
-        opcodeTable[0x35] = std::bind(&Instructions::handleXORImm, this); // XOR AX, imm16
+        t[0xCD] = &Instructions::handleINT;
+        t[0xF4] = &Instructions::handleHLT;
+        t[Instructions::SERVICE_TRAP] = &Instructions::handleServiceTrap;
 
         // SHIFT/ROTATE (D0, D1, D2, D3 for certain ops)
-        opcodeTable[0xD0] = std::bind(&Instructions::handleROL, this); // 8-bit shift/rotate by 1
-        opcodeTable[0xD1] = std::bind(&Instructions::handleROL, this); // 16-bit shift/rotate by 1
-        opcodeTable[0xD2] = std::bind(&Instructions::handleROL, this); // 8-bit shift/rotate by CL
-        opcodeTable[0xD3] = std::bind(&Instructions::handleROL, this); // 16-bit shift/rotate by CL
+        t[0xD0] = &Instructions::handleShiftGroup; // 8-bit shift/rotate by 1
+        t[0xD1] = &Instructions::handleShiftGroup; // 16-bit shift/rotate by 1
+        t[0xD2] = &Instructions::handleShiftGroup; // 8-bit shift/rotate by CL
+        t[0xD3] = &Instructions::handleShiftGroup; // 16-bit shift/rotate by CL
 
         // PUSH/POP (examples: 0x50-0x5F for push/pop reg)
         // CALL/RET (0xE8, 0xC3, etc.)
         // For brevity, we'll just map a couple:
-        opcodeTable[0x50] = std::bind(&Instructions::handlePUSH, this); // PUSH AX
-        opcodeTable[0x51] = std::bind(&Instructions::handlePUSH, this); // PUSH CX
-        opcodeTable[0x58] = std::bind(&Instructions::handlePOP,  this); // POP AX
-        opcodeTable[0x59] = std::bind(&Instructions::handlePOP,  this); // POP CX
-        opcodeTable[0xE8] = std::bind(&Instructions::handleCALL, this);
-        opcodeTable[0xC3] = std::bind(&Instructions::handleRET,  this);
-        opcodeTable[0xCF] = std::bind(&Instructions::handleIRET, this); // Add IRET (0xCF)
+        t[0x50] = &Instructions::handlePUSH; // PUSH AX
+        t[0x51] = &Instructions::handlePUSH; // PUSH CX
+        t[0x58] = &Instructions::handlePOP; // POP AX
+        t[0x59] = &Instructions::handlePOP; // POP CX
+        t[0xE8] = &Instructions::handleCALL;
+        t[0xC3] = &Instructions::handleRET;
+        t[0xCF] = &Instructions::handleIRET; // Add IRET (0xCF)
 
         // 0xF6 (8-bit) / 0xF7 (16-bit): TEST, NOT, NEG, MUL, IMUL, DIV, IDIV
-        opcodeTable[0xF6] = std::bind(&Instructions::handleF6, this);
-        opcodeTable[0xF7] = std::bind(&Instructions::handleF7, this);
+        t[0xF6] = &Instructions::handleF6;
+        t[0xF7] = &Instructions::handleF7;
+
+        return t;
+    }
+
+    template<Instructions::AluOp Op>
+    constexpr void Instructions::setALUHandlers(std::array<InstructionHandler, 256> &t) {
+        uint8_t base = static_cast<uint8_t>(Op) << 3;
+        t[base + 0] = &Instructions::dispatchModRM<&Instructions::handleALU<Op, false, false, Operand::Reg>,
+                                                   &Instructions::handleALU<Op, false, false, Operand::Mem>>;
+        t[base + 1] = &Instructions::dispatchModRM<&Instructions::handleALU<Op, true, false, Operand::Reg>,
+                                                   &Instructions::handleALU<Op, true, false, Operand::Mem>>;
+        t[base + 2] = &Instructions::dispatchModRM<&Instructions::handleALU<Op, false, true, Operand::Reg>,
+                                                   &Instructions::handleALU<Op, false, true, Operand::Mem>>;
+        t[base + 3] = &Instructions::dispatchModRM<&Instructions::handleALU<Op, true, true, Operand::Reg>,
+                                                   &Instructions::handleALU<Op, true, true, Operand::Mem>>;
+        t[base + 4] = &Instructions::handleALU<Op, false, true, Operand::Imm>;
+        t[base + 5] = &Instructions::handleALU<Op, true, true, Operand::Imm>;
+    }
+
+    template<Instructions::AluOp Op>
+    constexpr void Instructions::setALUForms(std::array<InstructionHandler, 256> &t, Operand kind) {
+        uint8_t base = static_cast<uint8_t>(Op) << 3;
+        if (kind == Operand::Reg) {
+            t[base + 0] = &Instructions::handleALU<Op, false, false, Operand::Reg>;
+            t[base + 1] = &Instructions::handleALU<Op, true, false, Operand::Reg>;
+            t[base + 2] = &Instructions::handleALU<Op, false, true, Operand::Reg>;
+            t[base + 3] = &Instructions::handleALU<Op, true, true, Operand::Reg>;
+        } else {
+            t[base + 0] = &Instructions::handleALU<Op, false, false, Operand::Mem>;
+            t[base + 1] = &Instructions::handleALU<Op, true, false, Operand::Mem>;
+            t[base + 2] = &Instructions::handleALU<Op, false, true, Operand::Mem>;
+            t[base + 3] = &Instructions::handleALU<Op, true, true, Operand::Mem>;
+        }
     }
 
+    constexpr std::array<Instructions::InstructionHandler, 256> Instructions::buildFormTable(Operand kind) {
+        std::array<InstructionHandler, 256> t{};
+
+        if (kind == Operand::Reg) {
+            t[0x88] = &Instructions::handleMOV<false, false, Operand::Reg>;
+            t[0x89] = &Instructions::handleMOV<true, false, Operand::Reg>;
+            t[0x8A] = &Instructions::handleMOV<false, true, Operand::Reg>;
+            t[0x8B] = &Instructions::handleMOV<true, true, Operand::Reg>;
+        } else {
+            t[0x88] = &Instructions::handleMOV<false, false, Operand::Mem>;
+            t[0x89] = &Instructions::handleMOV<true, false, Operand::Mem>;
+            t[0x8A] = &Instructions::handleMOV<false, true, Operand::Mem>;
+            t[0x8B] = &Instructions::handleMOV<true, true, Operand::Mem>;
+        }
+
+        setALUForms<AluOp::Add>(t, kind);
+        setALUForms<AluOp::Or>(t, kind);
+        setALUForms<AluOp::Adc>(t, kind);
+        setALUForms<AluOp::Sbb>(t, kind);
+        setALUForms<AluOp::And>(t, kind);
+        setALUForms<AluOp::Sub>(t, kind);
+        setALUForms<AluOp::Xor>(t, kind);
+        setALUForms<AluOp::Cmp>(t, kind);
+
+        return t;
+    }
+
+    template<Instructions::AluOp Op>
+    constexpr void Instructions::setGroup1Handlers(std::array<InstructionHandler, 32> &t) {
+        uint8_t reg = static_cast<uint8_t>(Op);
+        t[0x00 | reg] = &Instructions::handleALUImm<Op, false, Operand::Reg>;
+        t[0x08 | reg] = &Instructions::handleALUImm<Op, false, Operand::Mem>;
+        t[0x10 | reg] = &Instructions::handleALUImm<Op, true, Operand::Reg>;
+        t[0x18 | reg] = &Instructions::handleALUImm<Op, true, Operand::Mem>;
+    }
+
+    constexpr std::array<Instructions::InstructionHandler, 32> Instructions::buildGroup1Table() {
+        std::array<InstructionHandler, 32> t{};
+        setGroup1Handlers<AluOp::Add>(t);
+        setGroup1Handlers<AluOp::Or>(t);
+        setGroup1Handlers<AluOp::Adc>(t);
+        setGroup1Handlers<AluOp::Sbb>(t);
+        setGroup1Handlers<AluOp::And>(t);
+        setGroup1Handlers<AluOp::Sub>(t);
+        setGroup1Handlers<AluOp::Xor>(t);
+        setGroup1Handlers<AluOp::Cmp>(t);
+        return t;
+    }
+
+    const std::array<Instructions::InstructionHandler, 256> Instructions::opcodeTable = Instructions::buildOpcodeTable();
+    const std::array<Instructions::InstructionHandler, 256> Instructions::registerFormTable = Instructions::buildFormTable(Operand::Reg);
+    const std::array<Instructions::InstructionHandler, 256> Instructions::memoryFormTable = Instructions::buildFormTable(Operand::Mem);
+
+    // Group 1 (0x80/0x81/0x83): ADD, OR, ADC, SBB, AND, SUB, XOR, CMP with an
+    // immediate, for byte and word, register and memory destinations
+    const std::array<Instructions::InstructionHandler, 32> Instructions::group1Table = Instructions::buildGroup1Table();
+
+    // Shift/rotate group (D0-D3), reg field 6 is undefined on the 8086
+    const std::array<Instructions::ShiftHandler, 8> Instructions::shiftTable8 = {
+        &Instructions::handleROL8, &Instructions::handleROR8, &Instructions::handleRCL8, &Instructions::handleRCR8,
+        &Instructions::handleSAL8, &Instructions::handleSHR8, &Instructions::handleShiftUnknown, &Instructions::handleSAR8,
+    };
+    const std::array<Instructions::ShiftHandler, 8> Instructions::shiftTable16 = {
+        &Instructions::handleROL16, &Instructions::handleROR16, &Instructions::handleRCL16, &Instructions::handleRCR16,
+        &Instructions::handleSAL16, &Instructions::handleSHR16, &Instructions::handleShiftUnknown, &Instructions::handleSAR16,
+    };
+
+    // Group 3 (F6/F7): TEST, (TEST alias), NOT, NEG, MUL, IMUL, DIV, IDIV
+    const std::array<Instructions::Group3Handler, 8> Instructions::group3Table8 = {
+        &Instructions::handleTest8, &Instructions::handleTest8, &Instructions::handleNot8, &Instructions::handleNeg8,
+        &Instructions::handleMul8, &Instructions::handleIMul8, &Instructions::handleDiv8, &Instructions::handleIDiv8,
+    };
+    const std::array<Instructions::Group3Handler, 8> Instructions::group3Table16 = {
+        &Instructions::handleTest16, &Instructions::handleTest16, &Instructions::handleNot16, &Instructions::handleNeg16,
+        &Instructions::handleMul16, &Instructions::handleIMul16, &Instructions::handleDiv16, &Instructions::handleIDiv16,
+    };
+
     //--------------------------------------------------------------------------
     // Fetch + Decode
     //--------------------------------------------------------------------------
-    uint8_t Instructions::fetchByte() {
-        uint32_t phys = memory.calculatePhysicalAddress(registers.CS, registers.IP);
-        uint8_t val   = memory.readByte(phys);
-        registers.IP++;
-        return val;
+    uint32_t Instructions::decodeAndExecute(uint8_t opcode) {
+        currentOpcode = opcode;
+        return (this->*opcodeTable[opcode])();
     }
 
-    uint16_t Instructions::fetchWord() {
-        uint32_t phys = memory.calculatePhysicalAddress(registers.CS, registers.IP);
-        uint16_t val  = memory.readWord(phys);
-        registers.IP += 2;
-        return val;
-    }
-
-    // Update decodeAndExecute to return cycle count
-    uint32_t Instructions::decodeAndExecute(uint8_t opcode) {
-        auto it = opcodeTable.find(opcode);
-        if(it != opcodeTable.end()) {
-            return it->second();
-        } else {
-            throw std::runtime_error("Unknown opcode: " + std::to_string(opcode));
-        }
+    uint32_t Instructions::handleUnknown() {
+        throw std::runtime_error("Unknown opcode: " + std::to_string(currentOpcode));
     }
 
     // Update executeNext to return cycle count
@@ -197,12 +286,590 @@ namespace CPU {
         if(halted) {
             return 0;
         }
-        uint8_t opcode = fetchByte();
-        return decodeAndExecute(opcode);
+        // Operands are decoded up front, so IP moves past the whole
+        // instruction before the handler runs
+        insn = &decoder.fetch(registers.CS, registers.IP);
+        registers.IP += insn->length;
+        return decodeAndExecute(insn->opcode);
+    }
+
+    //--------------------------------------------------------------------------
+    // Threaded-code blocks
+    //--------------------------------------------------------------------------
+    bool Instructions::endsBlock(uint8_t opcode) {
+        switch (opcode) {
+            case 0x74: case 0x75: case 0x77:  // Conditional jumps
+            case 0x7C: case 0x7D: case 0x7E:
+            case 0xE8: case 0xE9: case 0xEB:  // CALL, JMP
+            case 0xC3: case 0xCF:             // RET, IRET
+            case 0xCD: case 0xF4:             // INT, HLT
+            case SERVICE_TRAP:                // A service may halt or move CS:IP
+            case 0xE4: case 0xE5: case 0xE6:  // IN, OUT: the device may have
+            case 0xE7: case 0xEC: case 0xED:  // raised an interrupt
+            case 0xEE: case 0xEF:
+                return true;
+            default:
+                // Unknown opcodes throw, so nothing after them runs
+                return opcodeTable[opcode] == &Instructions::handleUnknown;
+        }
+    }
+
+    // Instructions that can't change anything but registers and flags, and
+    // IN, whose port may not be stable but is checked as it is read. A
+    // loop made of nothing else is a polling loop.
+    bool Instructions::isSpinSafe(const DecodedInstruction &insn) {
+        uint8_t opcode = insn.opcode;
+        if (opcode < 0x40 && (opcode & 0x07) <= 5) {     // ALU block
+            return (opcode & 0x07) >= 4 || insn.mod == 0b11;
+        }
+        if ((opcode >= 0x40 && opcode <= 0x4F) ||        // INC, DEC reg
+            (opcode >= 0xB0 && opcode <= 0xBF)) {        // MOV reg, imm
+            return true;
+        }
+
+        switch (opcode) {
+            case 0x80: case 0x81: case 0x83:             // Group 1
+            case 0x88: case 0x89: case 0x8A: case 0x8B:  // MOV
+            case 0xD0: case 0xD1: case 0xD2: case 0xD3:  // Shifts and rotates
+                return insn.mod == 0b11;
+            case 0xF6: case 0xF7:                        // TEST r, imm
+                return insn.mod == 0b11 && insn.reg == 0;
+            case 0x74: case 0x75: case 0x77:             // Conditional jumps
+            case 0x7C: case 0x7D: case 0x7E:
+            case 0xE9: case 0xEB:                        // JMP
+            case 0xE4: case 0xE5: case 0xEC: case 0xED:  // IN
+            case 0xF5: case 0xF8: case 0xF9:             // CMC, CLC, STC
+            case 0xFC: case 0xFD:                        // CLD, STD
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Arithmetic flags an instruction reads and writes. Returns false for
+    // instructions whose flag behaviour isn't tracked; those, and anything
+    // that touches memory (and so may throw), are treated as reading every
+    // flag so nothing is ever left stale where it could be observed.
+    bool Instructions::getFlagUsage(const DecodedInstruction &insn, uint16_t &reads, uint16_t &writes) {
+        uint8_t opcode = insn.opcode;
+        reads = 0;
+        writes = 0;
+
+        if (opcode < 0x40 && (opcode & 0x07) <= 5) {     // ALU block, ADC/SBB read CF
+            AluOp op = static_cast<AluOp>(opcode >> 3);
+            reads = (op == AluOp::Adc || op == AluOp::Sbb) ? CF : 0;
+            writes = ARITHMETIC_FLAGS;
+            return (opcode & 0x07) >= 4 || insn.mod == 0b11;
+        }
+
+        switch (opcode) {
+            case 0x80: case 0x81: case 0x83:             // Group 1
+                reads = (insn.reg == 2 || insn.reg == 3) ? CF : 0;
+                writes = ARITHMETIC_FLAGS;
+                return insn.mod == 0b11;
+            case 0x88: case 0x89: case 0x8A: case 0x8B:  // MOV
+                return insn.mod == 0b11;
+            case 0x74: case 0x75:                        // JE, JNE
+                reads = ZF;
+                return true;
+            case 0x77: case 0x7E:                        // JG, JLE
+                reads = ZF | SF | OF;
+                return true;
+            case 0x7C: case 0x7D:                        // JL, JGE
+                reads = SF | OF;
+                return true;
+            case 0xF5:                                   // CMC
+                reads = CF;
+                writes = CF;
+                return true;
+            case 0xF8: case 0xF9:                        // CLC, STC
+                writes = CF;
+                return true;
+            case 0xFA: case 0xFB: case 0xFC: case 0xFD:  // CLI, STI, CLD, STD
+            case 0xE9: case 0xEB: case 0xF4:             // JMP, HLT
+                return true;
+            default:
+                if (opcode >= 0x40 && opcode <= 0x4F) {  // INC, DEC
+                    writes = ARITHMETIC_FLAGS & ~CF;
+                    return true;
+                }
+                return opcode >= 0xB0 && opcode <= 0xBF;  // MOV reg, imm
+        }
+    }
+
+    void Instructions::buildBlock(Block &block) {
+        uint16_t cs = static_cast<uint16_t>(block.key >> 16);
+        uint16_t ip = static_cast<uint16_t>(block.key);
+        uint32_t start = memory.calculatePhysicalAddress(cs, ip);
+        uint32_t end = start;
+
+        block.ops.clear();
+        block.successors[0] = nullptr;
+        block.successors[1] = nullptr;
+        block.executionCount = 0;
+        block.native = nullptr;
+
+        while (block.ops.size() < MAX_BLOCK_LENGTH) {
+            const DecodedInstruction *next = &decoder.fetch(cs, ip);
+
+            // Instructions that wrap past offset 0xFFFF are left to executeNext()
+            if (static_cast<uint32_t>(ip) + next->length > 0x10000) {
+                break;
+            }
+            // Port handlers read the clock, which only moves between
+            // blocks, so I/O starts one (and ends it, see endsBlock())
+            if (!block.ops.empty() && isIOOpcode(next->opcode)) {
+                break;
+            }
+
+            block.ops.push_back({selectHandler(*next), *next, ARITHMETIC_FLAGS});
+            ip += next->length;
+            end += next->length;
+
+            if (endsBlock(next->opcode)) {
+                break;
+            }
+        }
+
+        // A routine's code goes on past its first block, and all of it has
+        // to stay as it was matched
+        block.intrinsic = matchIntrinsic(static_cast<uint16_t>(block.key), start);
+        if (block.intrinsic) {
+            end = std::max<uint32_t>(end, start + static_cast<uint32_t>(block.intrinsic->pattern.size()));
+            for (uint32_t address = start; address < end; address += 1u << Memory::CODE_PAGE_SHIFT) {
+                memory.markCodePage(address);
+            }
+            memory.markCodePage(end - 1);
+        }
+
+        block.spinSafe = !block.intrinsic &&
+                         std::all_of(block.ops.begin(), block.ops.end(),
+                                     [](const ThreadedOp &op) { return isSpinSafe(op.insn); });
+
+        // Flag liveness, walking backwards from the end of the block where
+        // every flag is live
+        uint16_t live = ARITHMETIC_FLAGS;
+        for (auto op = block.ops.rbegin(); op != block.ops.rend(); ++op) {
+            uint16_t reads, writes;
+            if (getFlagUsage(op->insn, reads, writes)) {
+                op->liveFlags = writes & live;
+                live = static_cast<uint16_t>((live & ~writes) | reads);
+            } else {
+                op->liveFlags = ARITHMETIC_FLAGS;
+                live = ARITHMETIC_FLAGS;
+            }
+        }
+
+        for (size_t i = 0; i < block.ops.size();) {
+            ThreadedOp &op = block.ops[i];
+            op.run = fuse(&op, block.ops.size() - i, op.span);
+            if (!op.run) {
+                op.run = op.handler;
+                op.span = 1;
+            }
+            i += op.span;
+        }
+
+        // Remember the code pages the block was built from
+        block.firstPage = start >> Memory::CODE_PAGE_SHIFT;
+        uint32_t lastPage = (end > start ? end - 1 : start) >> Memory::CODE_PAGE_SHIFT;
+        block.pageVersions.clear();
+        for (uint32_t page = block.firstPage; page <= lastPage; page++) {
+            block.pageVersions.push_back(memory.getCodePageVersion(page << Memory::CODE_PAGE_SHIFT));
+        }
+    }
+
+    bool Instructions::isBlockCurrent(const Block &block) const {
+        for (size_t i = 0; i < block.pageVersions.size(); i++) {
+            uint32_t address = static_cast<uint32_t>(block.firstPage + i) << Memory::CODE_PAGE_SHIFT;
+            if (memory.getCodePageVersion(address) != block.pageVersions[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void Instructions::flushBlocks() {
+        blocks.clear();
+        lastBlock = nullptr;
+        if (jit) {
+            jit->reset();
+        }
+    }
+
+    Instructions::Block* Instructions::lookupBlock() {
+        uint32_t key = (static_cast<uint32_t>(registers.CS) << 16) | registers.IP;
+        Block *block = nullptr;
+
+        // Fast path: follow a chained exit of the block that just ran
+        if (lastBlock) {
+            if (lastBlock->successors[0] && lastBlock->successors[0]->key == key) {
+                block = lastBlock->successors[0];
+            } else if (lastBlock->successors[1] && lastBlock->successors[1]->key == key) {
+                block = lastBlock->successors[1];
+            }
+        }
+
+        if (!block) {
+            auto it = blocks.find(key);
+            if (it == blocks.end()) {
+                if (blocks.size() >= MAX_BLOCKS) {
+                    flushBlocks();
+                }
+                it = blocks.emplace(key, Block{}).first;
+                it->second.key = key;
+                try {
+                    buildBlock(it->second);
+                } catch (...) {
+                    blocks.erase(it);
+                    throw;
+                }
+            }
+            block = &it->second;
+
+            // Chain it to its predecessor so the next visit skips the lookup
+            if (lastBlock) {
+                lastBlock->successors[1] = lastBlock->successors[0];
+                lastBlock->successors[0] = block;
+            }
+        }
+
+        // The code underneath may have been modified since the block was built
+        if (!isBlockCurrent(*block)) {
+            buildBlock(*block);
+        }
+        return block;
+    }
+
+    void Instructions::executeBlock(uint64_t &cycleCount, uint64_t &instructionCount,
+                                    uint64_t cycleHorizon, uint64_t instructionLimit) {
+        if (halted) {
+            return;
+        }
+
+        Block *block = lookupBlock();
+        if (block->ops.empty()) {
+            // Only happens for an instruction that wraps the code segment
+            lastBlock = nullptr;
+            cycleCount += executeNext();
+            instructionCount++;
+            return;
+        }
+
+        if (block->intrinsic && runIntrinsic(*block, cycleCount, instructionCount, cycleHorizon, instructionLimit)) {
+            return;
+        }
+
+        if (jit) {
+            if (!block->native && block->executionCount < JIT_THRESHOLD &&
+                ++block->executionCount == JIT_THRESHOLD) {
+                compileBlock(*block);
+            }
+            if (block->native) {
+                runCompiledBlock(*block, cycleCount, instructionCount);
+                return;
+            }
+        }
+
+        uint32_t blockCycles = 0;
+        uint32_t executed = 0;
+        uint32_t codeWrites = memory.getCodeWriteCount();
+
+        try {
+            const ThreadedOp *end = block->ops.data() + block->ops.size();
+            for (const ThreadedOp *op = block->ops.data(); op != end; op += op->span) {
+                insn = &op->insn;
+                currentOpcode = op->insn.opcode;
+                liveFlags = op->liveFlags;
+                fusedOp = op;
+                registers.IP += op->insn.length;
+                blockCycles += (this->*op->run)();
+                executed += op->span;
+
+                // A write into code may have changed the rest of this block
+                if (memory.getCodeWriteCount() != codeWrites) {
+                    break;
+                }
+            }
+        } catch (...) {
+            // Keep the counters exact for the instructions that did complete
+            liveFlags = ARITHMETIC_FLAGS;
+            cycleCount += blockCycles;
+            instructionCount += executed;
+            lastBlock = nullptr;
+            throw;
+        }
+
+        liveFlags = ARITHMETIC_FLAGS;
+        cycleCount += blockCycles;
+        instructionCount += executed;
+        lastBlock = block;
+    }
+
+    //--------------------------------------------------------------------------
+    // Superinstructions
+    //--------------------------------------------------------------------------
+    template<Instructions::InstructionHandler First, Instructions::InstructionHandler... Rest>
+    uint32_t Instructions::handleFused() {
+        uint32_t spent = (this->*First)();
+        if constexpr (sizeof...(Rest) > 0) {
+            // On to the next instruction, as the block loop would
+            ++fusedOp;
+            insn = &fusedOp->insn;
+            currentOpcode = insn->opcode;
+            liveFlags = fusedOp->liveFlags;
+            registers.IP += insn->length;
+            spent += handleFused<Rest...>();
+        }
+        return spent;
+    }
+
+    // Flag-setting instructions a conditional jump is fused onto: the
+    // register and immediate forms of CMP (the first eight), INC and DEC
+    constexpr std::array<Instructions::InstructionHandler, 10> Instructions::fusedFlagSetters() {
+        return {&Instructions::handleALU<AluOp::Cmp, false, false, Operand::Reg>,
+                &Instructions::handleALU<AluOp::Cmp, true, false, Operand::Reg>,
+                &Instructions::handleALU<AluOp::Cmp, false, true, Operand::Reg>,
+                &Instructions::handleALU<AluOp::Cmp, true, true, Operand::Reg>,
+                &Instructions::handleALU<AluOp::Cmp, false, true, Operand::Imm>,
+                &Instructions::handleALU<AluOp::Cmp, true, true, Operand::Imm>,
+                &Instructions::handleALUImm<AluOp::Cmp, false, Operand::Reg>,
+                &Instructions::handleALUImm<AluOp::Cmp, true, Operand::Reg>,
+                &Instructions::handleINC,
+                &Instructions::handleDEC};
+    }
+
+    constexpr std::array<Instructions::InstructionHandler, Instructions::FUSED_BRANCHES> Instructions::fusedBranches() {
+        return {&Instructions::handleJE, &Instructions::handleJNE, &Instructions::handleJG,
+                &Instructions::handleJGE, &Instructions::handleJL, &Instructions::handleJLE};
+    }
+
+    // MOV reg, [mem], byte then word, and the ALU register forms that can
+    // follow it: for each width, op r, r in both directions and op AL/AX, imm
+    constexpr std::array<Instructions::InstructionHandler, 2> Instructions::fusedLoads() {
+        return {&Instructions::handleMOV<false, true, Operand::Mem>,
+                &Instructions::handleMOV<true, true, Operand::Mem>};
+    }
+
+    template<Instructions::AluOp Op, bool Word>
+    constexpr std::array<Instructions::InstructionHandler, 3> Instructions::aluRegisterForms() {
+        return {&Instructions::handleALU<Op, Word, false, Operand::Reg>,
+                &Instructions::handleALU<Op, Word, true, Operand::Reg>,
+                &Instructions::handleALU<Op, Word, true, Operand::Imm>};
+    }
+
+    template<size_t... I>
+    constexpr std::array<Instructions::InstructionHandler, sizeof...(I)>
+    Instructions::buildLoadUsers(std::index_sequence<I...>) {
+        return {aluRegisterForms<static_cast<AluOp>(I % 24 / 3), (I >= 24)>()[I % 3]...};
+    }
+
+    constexpr std::array<Instructions::InstructionHandler, 48> Instructions::fusedLoadUsers() {
+        return buildLoadUsers(std::make_index_sequence<48>{});
+    }
+
+    template<size_t... I>
+    constexpr std::array<Instructions::InstructionHandler, sizeof...(I)>
+    Instructions::buildSetBranchTable(std::index_sequence<I...>) {
+        return {&Instructions::handleFused<fusedFlagSetters()[I / FUSED_BRANCHES], fusedBranches()[I % FUSED_BRANCHES]>...};
+    }
+
+    template<size_t... I>
+    constexpr std::array<Instructions::InstructionHandler, sizeof...(I)>
+    Instructions::buildIncCompareBranchTable(std::index_sequence<I...>) {
+        return {&Instructions::handleFused<&Instructions::handleINC, fusedFlagSetters()[I / FUSED_BRANCHES],
+                                           fusedBranches()[I % FUSED_BRANCHES]>...};
+    }
+
+    template<size_t... I>
+    constexpr std::array<Instructions::InstructionHandler, sizeof...(I)>
+    Instructions::buildLoadUseTable(std::index_sequence<I...>) {
+        return {&Instructions::handleFused<fusedLoads()[I / 24], fusedLoadUsers()[I]>...};
+    }
+
+    const std::array<Instructions::InstructionHandler, 10 * Instructions::FUSED_BRANCHES> Instructions::setBranchTable =
+        Instructions::buildSetBranchTable(std::make_index_sequence<10 * FUSED_BRANCHES>{});
+    const std::array<Instructions::InstructionHandler, 8 * Instructions::FUSED_BRANCHES> Instructions::incCompareBranchTable =
+        Instructions::buildIncCompareBranchTable(std::make_index_sequence<8 * FUSED_BRANCHES>{});
+    const std::array<Instructions::InstructionHandler, 48> Instructions::loadUseTable =
+        Instructions::buildLoadUseTable(std::make_index_sequence<48>{});
+
+    template<typename Handler, size_t N>
+    static int indexOf(const std::array<Handler, N> &handlers, Handler handler) {
+        for (size_t i = 0; i < N; i++) {
+            if (handlers[i] == handler) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    Instructions::InstructionHandler Instructions::fuse(const ThreadedOp *ops, size_t count, uint8_t &span) {
+        static constexpr auto setters = fusedFlagSetters();
+        static constexpr auto branches = fusedBranches();
+        static constexpr auto loads = fusedLoads();
+        static constexpr auto users = fusedLoadUsers();
+        if (count < 2) {
+            return nullptr;
+        }
+
+        // INC reg, CMP, Jcc
+        if (count >= 3 && ops[0].handler == &Instructions::handleINC) {
+            int compare = indexOf(setters, ops[1].handler);
+            int branch = indexOf(branches, ops[2].handler);
+            if (compare >= 0 && compare < 8 && branch >= 0) {
+                span = 3;
+                return incCompareBranchTable[compare * FUSED_BRANCHES + branch];
+            }
+        }
+
+        // CMP, INC or DEC, then Jcc
+        int setter = indexOf(setters, ops[0].handler);
+        int branch = indexOf(branches, ops[1].handler);
+        if (setter >= 0 && branch >= 0) {
+            span = 2;
+            return setBranchTable[setter * FUSED_BRANCHES + branch];
+        }
+
+        // MOV reg, [mem] then ALU of the same width
+        int load = indexOf(loads, ops[0].handler);
+        int user = indexOf(users, ops[1].handler);
+        if (load >= 0 && user >= 0 && user / 24 == load) {
+            span = 2;
+            return loadUseTable[user];
+        }
+        return nullptr;
+    }
+
+    //--------------------------------------------------------------------------
+    // JIT
+    //--------------------------------------------------------------------------
+    void Instructions::setJitEnabled(bool enabled) {
+        if (!enabled) {
+            for (auto &entry : blocks) {
+                entry.second.native = nullptr;
+            }
+            jit.reset();
+            return;
+        }
+        if (jit) {
+            return;
+        }
+
+        jit = std::make_unique<Jit>(&Instructions::jitHelper, &Instructions::jitFlagsHelper, nativeCycles());
+        if (!jit->isAvailable()) {
+            jit.reset();
+        }
+    }
+
+    JitCycles Instructions::nativeCycles() {
+        const CycleCounts counts;
+        return {counts.MOV_REG_REG, counts.MOV_IMM_REG, counts.ALU_REG_REG, counts.INC_REG, counts.FLAG_OP,
+                counts.JMP_SHORT, counts.JMP_NEAR, counts.JCOND_TAKEN, counts.JCOND_NOT_TAKEN};
+    }
+
+    bool Instructions::isIOOpcode(uint8_t opcode) {
+        return (opcode >= 0xE4 && opcode <= 0xE7) || (opcode >= 0xEC && opcode <= 0xEF);
+    }
+
+    void Instructions::compileBlock(Block &block) {
+        std::vector<const DecodedInstruction*> code;
+        std::vector<uint16_t> live;
+        size_t native = 0;
+        for (const ThreadedOp &op : block.ops) {
+            code.push_back(&op.insn);
+            live.push_back(op.liveFlags);
+            if (Jit::isNative(op.insn)) {
+                native++;
+            }
+        }
+
+        // Every other instruction costs a round trip through the helper, so
+        // blocks that are mostly helper calls stay threaded
+        if (native * 2 < code.size()) {
+            return;
+        }
+
+        uint16_t ip = static_cast<uint16_t>(block.key);
+        block.native = jit->compile(code, live, ip);
+        if (!block.native) {
+            // Code buffer is full: drop everything compiled so far
+            for (auto &entry : blocks) {
+                entry.second.native = nullptr;
+            }
+            jit->reset();
+            block.native = jit->compile(code, live, ip);
+        }
+    }
+
+    void Instructions::runCompiledBlock(Block &block, uint64_t &cycleCount, uint64_t &instructionCount) {
+        JitContext ctx;
+        ctx.registers = &registers;
+        ctx.owner = this;
+        ctx.block = &block;
+        ctx.flags = flags.getRawValue();
+        ctx.pending = flags.getPendingMask();
+
+        block.native(&ctx);
+
+        flags.setRawValue(ctx.flags, ctx.pending);
+        cycleCount += ctx.cycles;
+        instructionCount += ctx.executed;
+
+        if (jitError) {
+            std::exception_ptr error = jitError;
+            jitError = nullptr;
+            lastBlock = nullptr;
+            std::rethrow_exception(error);
+        }
+        lastBlock = &block;
+    }
+
+    uint32_t Instructions::jitHelper(JitContext *ctx, uint32_t index) {
+        return static_cast<Instructions*>(ctx->owner)->runJitOp(*ctx, index);
+    }
+
+    uint32_t Instructions::runJitOp(JitContext &ctx, uint32_t index) {
+        // Compiled code has already written the registers back and set IP
+        // past this instruction
+        const ThreadedOp &op = static_cast<const Block*>(ctx.block)->ops[index];
+        uint32_t codeWrites = memory.getCodeWriteCount();
+        uint32_t leave = 0;
+
+        flags.setRawValue(ctx.flags, ctx.pending);
+        insn = &op.insn;
+        currentOpcode = op.insn.opcode;
+        liveFlags = op.liveFlags;
+
+        try {
+            ctx.cycles += (this->*op.handler)();
+            ctx.executed = index + 1;
+
+            // Give control back after I/O, or a write that may have hit this block
+            leave = (isIOOpcode(currentOpcode) || memory.getCodeWriteCount() != codeWrites) ? 1 : 0;
+        } catch (...) {
+            jitError = std::current_exception();
+            ctx.executed = index;
+            leave = 1;
+        }
+
+        liveFlags = ARITHMETIC_FLAGS;
+        ctx.flags = flags.getRawValue();
+        ctx.pending = flags.getPendingMask();
+        return leave;
+    }
+
+    void Instructions::jitFlagsHelper(JitContext *ctx) {
+        // Native code only ever changes the stored bits, so the operation
+        // recorded in flags still matches ctx->pending
+        Flags &state = static_cast<Instructions*>(ctx->owner)->flags;
+        state.setRawValue(ctx->flags, ctx->pending);
+        ctx->flags = state.getValue();
+        ctx->pending = 0;
     }
 
     //--------------------------------------------------------------------------
-    // Helpers: getRegisterReference, getMemoryReference, setArithmeticFlags
+    // Helpers: getRegisterReference, setArithmeticFlags
     //--------------------------------------------------------------------------
     uint16_t* Instructions::getRegisterReference(uint8_t reg) {
         // 8086 uses AX=0, CX=1, DX=2, BX=3, SP=4, BP=5, SI=6, DI=7
@@ -220,627 +887,211 @@ namespace CPU {
         }
     }
 
-    uint16_t* Instructions::getMemoryReference(uint8_t mod, uint8_t rm) {
-        /*
-         * 16-bit addressing modes (8086):
-         *   rm=000 => BX + SI
-         *   rm=001 => BX + DI
-         *   rm=010 => BP + SI
-         *   rm=011 => BP + DI
-         *   rm=100 => SI
-         *   rm=101 => DI
-         *   rm=110 => (if mod==00 => disp16) else BP + disp8/16
-         *   rm=111 => BX
-         *
-         * 'mod' indicates how we interpret displacement:
-         *   00 => no disp, except if rm=110 => disp16
-         *   01 => disp8
-         *   10 => disp16
-         */
-        uint16_t base = 0;
-        uint16_t disp = 0;
-
-        switch(rm) {
-            case 0b000: base = registers.BX.value + registers.SI; break;
-            case 0b001: base = registers.BX.value + registers.DI; break;
-            case 0b010: base = registers.BP + registers.SI;        break;
-            case 0b011: base = registers.BP + registers.DI;        break;
-            case 0b100: base = registers.SI;                       break;
-            case 0b101: base = registers.DI;                       break;
-            case 0b110:
-                if(mod == 0b00) {
-                    // Direct address
-                    disp = fetchWord();
-                } else {
-                    base = registers.BP;
-                }
-                break;
-            case 0b111: base = registers.BX.value; break;
+    void Instructions::setArithmeticFlags(FlagOp op, uint32_t result, uint16_t dest, uint16_t src) {
+        // Only record the operation; Flags works out CF, PF, AF, ZF, SF and OF
+        // when one of them is read. Nothing to record if a later instruction
+        // in the block overwrites them all first.
+        if (liveFlags) {
+            flags.setResult(op, result, dest, src, true);
         }
+    }
 
-        if(mod == 0b01) {
-            disp += static_cast<int8_t>(fetchByte());  // 8-bit displacement
-        } else if(mod == 0b10) {
-            disp += fetchWord();  // 16-bit displacement
+    void Instructions::setArithmeticFlags8(FlagOp op, uint16_t result, uint8_t dest, uint8_t src) {
+        if (liveFlags) {
+            flags.setResult(op, result, dest, src, false);
         }
-
-        uint32_t phys = memory.calculatePhysicalAddress(base, disp);
-        // getPointer returns a pointer to memory at address, interpreted as 16-bit
-        return memory.getPointer(static_cast<uint16_t>(phys));
     }
 
-    void Instructions::setArithmeticFlags(uint32_t result, uint16_t dest, uint16_t src) {
-        // Typical 16-bit arithmetic flags:
-        uint16_t res16 = static_cast<uint16_t>(result);
-
-        // Zero
-        flags.setFlag(FLAGS::ZF, (res16 == 0));
-
-        // Carry if result didn't fit in 16 bits
-        flags.setFlag(FLAGS::CF, (result > 0xFFFF));
-
-        // Sign
-        flags.setFlag(FLAGS::SF, (res16 & 0x8000) != 0);
-
-        // Overflow (for signed)
-        // 16-bit signed overflow check:
-        // For addition: If both operands have the same sign but the result has a different sign
-        // For subtraction: If the operands have different signs and the result has the same sign as the source
-        bool isAddition = ((result & 0x10000) == (result & 0xFFFF)); // Check if carry matches highest bit
-        
-        if (isAddition) {
-            // Addition: Both operands have same sign bit but result has different sign bit
-            bool of = ((dest & 0x8000) == (src & 0x8000)) && ((dest & 0x8000) != (res16 & 0x8000));
-            flags.setFlag(FLAGS::OF, of);
+    template<bool Word>
+    uint16_t Instructions::readRegister(uint8_t reg) {
+        if constexpr (Word) {
+            return *getRegisterReference(reg);
         } else {
-            // Subtraction: Operands have different sign bit, and result sign bit equals subtrahend
-            bool of = ((dest & 0x8000) != (src & 0x8000)) && ((src & 0x8000) == (res16 & 0x8000));
-            flags.setFlag(FLAGS::OF, of);
+            return *get8BitRegisterRef(reg);
         }
+    }
 
-        // Parity (number of 1-bits in low 8 bits is even)
-        uint8_t lowByte = res16 & 0xFF;
-        uint8_t count = 0;
-        for (int i = 0; i < 8; i++) {
-            if (lowByte & (1 << i)) count++;
+    template<bool Word>
+    void Instructions::writeRegister(uint8_t reg, uint16_t value) {
+        if constexpr (Word) {
+            *getRegisterReference(reg) = value;
+        } else {
+            *get8BitRegisterRef(reg) = static_cast<uint8_t>(value);
         }
-        flags.setFlag(FLAGS::PF, (count % 2) == 0);
+    }
 
-        // Auxiliary Carry (carry from bit 3 to bit 4)
-        // For addition: ((op1 & 0xF) + (op2 & 0xF)) > 0xF
-        // For subtraction: ((op1 & 0xF) - (op2 & 0xF)) < 0
-        if (isAddition) {
-            flags.setFlag(FLAGS::AF, ((dest & 0xF) + (src & 0xF)) > 0xF);
+    template<bool Word>
+    uint16_t Instructions::readMemory(uint32_t addr) {
+        if constexpr (Word) {
+            return memory.readWord(addr);
         } else {
-            flags.setFlag(FLAGS::AF, ((dest & 0xF) - (src & 0xF)) & 0x10);
+            return memory.readByte(addr);
         }
     }
 
-    void Instructions::setArithmeticFlags8(uint16_t result, uint8_t dest, uint8_t src) {
-        // Flags for 8-bit arithmetic
-        uint8_t res8 = static_cast<uint8_t>(result);
-
-        // Zero
-        flags.setFlag(FLAGS::ZF, (res8 == 0));
-
-        // Carry if result didn't fit in 8 bits
-        flags.setFlag(FLAGS::CF, (result > 0xFF));
-
-        // Sign
-        flags.setFlag(FLAGS::SF, (res8 & 0x80) != 0);
-
-        // Overflow (for signed)
-        // 8-bit signed overflow check
-        bool isAddition = ((result & 0x100) == (result & 0xFF)); // Check if carry matches highest bit
-        
-        if (isAddition) {
-            // Addition: Both operands have same sign bit but result has different sign bit
-            bool of = ((dest & 0x80) == (src & 0x80)) && ((dest & 0x80) != (res8 & 0x80));
-            flags.setFlag(FLAGS::OF, of);
+    template<bool Word>
+    void Instructions::writeMemory(uint32_t addr, uint16_t value) {
+        if constexpr (Word) {
+            memory.writeWord(addr, value);
         } else {
-            // Subtraction: Operands have different sign bit, and result sign bit equals subtrahend
-            bool of = ((dest & 0x80) != (src & 0x80)) && ((src & 0x80) == (res8 & 0x80));
-            flags.setFlag(FLAGS::OF, of);
+            memory.writeByte(addr, static_cast<uint8_t>(value));
         }
+    }
 
-        // Parity (number of 1-bits is even)
-        uint8_t count = 0;
-        for (int i = 0; i < 8; i++) {
-            if (res8 & (1 << i)) count++;
-        }
-        flags.setFlag(FLAGS::PF, (count % 2) == 0);
+    template<Instructions::InstructionHandler RegisterForm, Instructions::InstructionHandler MemoryForm>
+    uint32_t Instructions::dispatchModRM() {
+        return (insn->mod == 0b11) ? (this->*RegisterForm)() : (this->*MemoryForm)();
+    }
 
-        // Auxiliary Carry (carry from bit 3 to bit 4)
-        if (isAddition) {
-            flags.setFlag(FLAGS::AF, ((dest & 0xF) + (src & 0xF)) > 0xF);
-        } else {
-            flags.setFlag(FLAGS::AF, ((dest & 0xF) - (src & 0xF)) & 0x10);
+    Instructions::InstructionHandler Instructions::selectHandler(const DecodedInstruction &insn) {
+        uint8_t opcode = insn.opcode;
+        if (opcode == 0x80 || opcode == 0x81 || opcode == 0x83) {
+            return group1Table[group1Index(insn)];
         }
+
+        // Opcodes without a ModR/M byte have no entry in either form table
+        InstructionHandler form = (insn.mod == 0b11) ? registerFormTable[opcode] : memoryFormTable[opcode];
+        return form ? form : opcodeTable[opcode];
     }
 
     //--------------------------------------------------------------------------
     // Data Movement: MOV
     //--------------------------------------------------------------------------
+    template<bool Word, bool ToReg, Instructions::Operand Kind>
     uint32_t Instructions::handleMOV() {
-        uint8_t modrm = fetchByte();
-        uint8_t mod = (modrm >> 6) & 0x03;
-        uint8_t reg = (modrm >> 3) & 0x07;
-        uint8_t rm = modrm & 0x07;
-        
-        uint8_t lastOpcode = memory.readByte(memory.calculatePhysicalAddress(registers.CS, registers.IP - 2));
-        bool isWord = (lastOpcode & 0x01) != 0;
-        bool direction = (lastOpcode & 0x02) != 0;
-        
-        uint32_t cycleCount = 0;
-        
-        if (direction) {
-            // MOV reg, r/m (8A/8B)
-            if (mod == 0b11) {
-                // Register to register (shorter cycle time)
-                if (isWord) {
-                    uint16_t* dest = getRegisterReference(reg);
-                    uint16_t* src = getRegisterReference(rm);
-                    *dest = *src;
-                } else {
-                    uint8_t* dest = get8BitRegisterRef(reg);
-                    uint8_t* src = get8BitRegisterRef(rm);
-                    *dest = *src;
-                }
-                cycleCount = cycles.MOV_REG_REG;
-            } else {
-                // Memory to register
-                if (isWord) {
-                    uint16_t* dest = getRegisterReference(reg);
-                    uint32_t addr = getEffectiveAddress(mod, rm);
-                    *dest = memory.readWord(addr);
-                } else {
-                    uint8_t* dest = get8BitRegisterRef(reg);
-                    uint32_t addr = getEffectiveAddress(mod, rm);
-                    *dest = memory.readByte(addr);
-                }
-                cycleCount = cycles.MOV_MEM_REG;
-            }
+        if constexpr (Kind == Operand::Reg) {
+            // Register to register (shorter cycle time)
+            uint8_t dest = ToReg ? insn->reg : insn->rm;
+            uint8_t src = ToReg ? insn->rm : insn->reg;
+            writeRegister<Word>(dest, readRegister<Word>(src));
+            return cycles.MOV_REG_REG;
         } else {
-            // MOV r/m, reg (88/89)
-            if (mod == 0b11) {
-                // Register to register
-                if (isWord) {
-                    uint16_t* dest = getRegisterReference(rm);
-                    uint16_t* src = getRegisterReference(reg);
-                    *dest = *src;
-                } else {
-                    uint8_t* dest = get8BitRegisterRef(rm);
-                    uint8_t* src = get8BitRegisterRef(reg);
-                    *dest = *src;
-                }
-                cycleCount = cycles.MOV_REG_REG;
+            uint32_t addr = getEffectiveAddress(insn->mod, insn->rm);
+            if constexpr (ToReg) {
+                // Memory to register
+                writeRegister<Word>(insn->reg, readMemory<Word>(addr));
+                return cycles.MOV_MEM_REG;
             } else {
                 // Register to memory
-                if (isWord) {
-                    uint16_t* src = getRegisterReference(reg);
-                    uint32_t addr = getEffectiveAddress(mod, rm);
-                    memory.writeWord(addr, *src);
-                } else {
-                    uint8_t* src = get8BitRegisterRef(reg);
-                    uint32_t addr = getEffectiveAddress(mod, rm);
-                    memory.writeByte(addr, *src);
-                }
-                cycleCount = cycles.MOV_REG_MEM;
+                writeMemory<Word>(addr, readRegister<Word>(insn->reg));
+                return cycles.MOV_REG_MEM;
             }
         }
-        
-        return cycleCount;
     }
 
     //--------------------------------------------------------------------------
     // MOV register, immediate
     //--------------------------------------------------------------------------
+    template<bool Word>
     uint32_t Instructions::handleMOVRegImm() {
-        uint8_t lastOpcode = memory.readByte(memory.calculatePhysicalAddress(registers.CS, registers.IP - 1));
-        uint8_t regCode = lastOpcode & 0x07;
-        bool isWord = (lastOpcode >= 0xB8);
-        
-        if (isWord) {
-            // 16-bit
-            uint16_t* reg = getRegisterReference(regCode);
-            uint16_t imm = fetchWord();
-            *reg = imm;
-        } else {
-            // 8-bit
-            uint8_t* reg = get8BitRegisterRef(regCode);
-            uint8_t imm = fetchByte();
-            *reg = imm;
-        }
-        
-        return cycles.MOV_IMM_REG; // Return cycle count
+        writeRegister<Word>(currentOpcode & 0x07, insn->imm);
+        return cycles.MOV_IMM_REG;
     }
 
     //--------------------------------------------------------------------------
-    // Arithmetic: ADD, SUB, CMP, INC, DEC
+    // ALU: ADD, OR, ADC, SBB, AND, SUB, XOR, CMP
     //--------------------------------------------------------------------------
-    uint32_t Instructions::handleADD() {
-        uint8_t modrm = fetchByte();
-        uint8_t mod   = (modrm >> 6) & 0x03;
-        uint8_t reg   = (modrm >> 3) & 0x07;
-        uint8_t rm    = (modrm & 0x07);
-
-        uint16_t* dest;
-        uint16_t  srcVal;
-        uint32_t cycleCount = 0;
-
-        if(mod == 0b11) {
-            dest   = getRegisterReference(rm);
-            srcVal = *getRegisterReference(reg);
-            cycleCount = cycles.ALU_REG_REG;
+    // Apply Op to two byte or word operands and record its flags. Returns the
+    // result; CMP callers drop it.
+    template<Instructions::AluOp Op, bool Word>
+    uint16_t Instructions::alu(uint16_t dest, uint16_t src) {
+        uint32_t result;
+        FlagOp flagOp;
+
+        if constexpr (Op == AluOp::Add || Op == AluOp::Adc) {
+            uint32_t carry = (Op == AluOp::Adc && flags.getFlag(FLAGS::CF)) ? 1 : 0;
+            result = static_cast<uint32_t>(dest) + src + carry;
+            flagOp = FlagOp::Add;
+        } else if constexpr (Op == AluOp::Sub || Op == AluOp::Sbb || Op == AluOp::Cmp) {
+            uint32_t borrow = (Op == AluOp::Sbb && flags.getFlag(FLAGS::CF)) ? 1 : 0;
+            result = static_cast<uint32_t>(dest) - src - borrow;
+            flagOp = FlagOp::Sub;
+        } else if constexpr (Op == AluOp::And) {
+            result = dest & src;
+            flagOp = FlagOp::Logic;
+        } else if constexpr (Op == AluOp::Or) {
+            result = dest | src;
+            flagOp = FlagOp::Logic;
         } else {
-            dest   = getMemoryReference(mod, rm);
-            srcVal = *getRegisterReference(reg);
-            cycleCount = cycles.ALU_REG_MEM;
+            result = dest ^ src;
+            flagOp = FlagOp::Logic;
         }
 
-        uint32_t result = static_cast<uint32_t>(*dest) + static_cast<uint32_t>(srcVal);
-        setArithmeticFlags(result, *dest, srcVal);
-        *dest = static_cast<uint16_t>(result);
-        
-        return cycleCount;
+        if (liveFlags) {
+            flags.setResult(flagOp, result, dest, src, Word);
+        }
+        return static_cast<uint16_t>(result);
     }
 
-    uint32_t Instructions::handleSUB() {
-        uint8_t modrm = fetchByte();
-        uint8_t mod   = (modrm >> 6) & 0x03;
-        uint8_t reg   = (modrm >> 3) & 0x07;
-        uint8_t rm    = (modrm & 0x07);
+    // op r/m, reg (ToReg false) or op reg, r/m (ToReg true) where r/m is a
+    // register (Operand::Reg) or memory (Operand::Mem); op AL/AX, imm for
+    // Operand::Imm
+    template<Instructions::AluOp Op, bool Word, bool ToReg, Instructions::Operand Kind>
+    uint32_t Instructions::handleALU() {
+        constexpr bool writeBack = (Op != AluOp::Cmp);
 
-        uint16_t* dest;
-        uint16_t  srcVal;
-        uint32_t cycleCount = 0;
-
-        if(mod == 0b11) {
-            dest   = getRegisterReference(rm);
-            srcVal = *getRegisterReference(reg);
-            cycleCount = cycles.ALU_REG_REG;
+        if constexpr (Kind == Operand::Imm) {
+            uint16_t result = alu<Op, Word>(readRegister<Word>(0), Word ? insn->imm : insn->imm & 0xFF);
+            if constexpr (writeBack) {
+                writeRegister<Word>(0, result);
+            }
+            return cycles.ALU_IMM_REG;
+        } else if constexpr (Kind == Operand::Reg) {
+            uint8_t dest = ToReg ? insn->reg : insn->rm;
+            uint8_t src = ToReg ? insn->rm : insn->reg;
+            uint16_t result = alu<Op, Word>(readRegister<Word>(dest), readRegister<Word>(src));
+            if constexpr (writeBack) {
+                writeRegister<Word>(dest, result);
+            }
+            return cycles.ALU_REG_REG;
+        } else if constexpr (ToReg) {
+            uint32_t addr = getEffectiveAddress(insn->mod, insn->rm);
+            uint16_t result = alu<Op, Word>(readRegister<Word>(insn->reg), readMemory<Word>(addr));
+            if constexpr (writeBack) {
+                writeRegister<Word>(insn->reg, result);
+            }
+            return cycles.ALU_MEM_REG;
         } else {
-            dest   = getMemoryReference(mod, rm);
-            srcVal = *getRegisterReference(reg);
-            cycleCount = cycles.ALU_REG_MEM;
+            uint32_t addr = getEffectiveAddress(insn->mod, insn->rm);
+            uint16_t result = alu<Op, Word>(readMemory<Word>(addr), readRegister<Word>(insn->reg));
+            if constexpr (writeBack) {
+                writeMemory<Word>(addr, result);
+                return cycles.ALU_REG_MEM;
+            } else {
+                return cycles.ALU_MEM_REG;  // CMP only reads memory
+            }
         }
-
-        uint32_t result = static_cast<uint32_t>(*dest) - static_cast<uint32_t>(srcVal);
-        setArithmeticFlags(result, *dest, srcVal);
-        *dest = static_cast<uint16_t>(result);
-        
-        return cycleCount;
     }
 
-    uint32_t Instructions::handleCMP() {
-        uint8_t modrm = fetchByte();
-        uint8_t mod   = (modrm >> 6) & 0x03;
-        uint8_t reg   = (modrm >> 3) & 0x07;
-        uint8_t rm    = (modrm & 0x07);
-
-        uint16_t* dest;
-        uint16_t  srcVal;
-        uint32_t cycleCount = 0;
+    // Group 1: op r/m, imm. The decoder has already sign-extended the imm8
+    // of 0x83.
+    template<Instructions::AluOp Op, bool Word, Instructions::Operand Kind>
+    uint32_t Instructions::handleALUImm() {
+        constexpr bool writeBack = (Op != AluOp::Cmp);
+        uint16_t imm = Word ? insn->imm : insn->imm & 0xFF;
 
-        if(mod == 0b11) {
-            dest   = getRegisterReference(rm);
-            srcVal = *getRegisterReference(reg);
-            cycleCount = cycles.ALU_REG_REG;
+        if constexpr (Kind == Operand::Reg) {
+            uint16_t result = alu<Op, Word>(readRegister<Word>(insn->rm), imm);
+            if constexpr (writeBack) {
+                writeRegister<Word>(insn->rm, result);
+            }
+            return cycles.ALU_IMM_REG;
         } else {
-            dest   = getMemoryReference(mod, rm);
-            srcVal = *getRegisterReference(reg);
-            cycleCount = cycles.ALU_MEM_REG;
+            uint32_t addr = getEffectiveAddress(insn->mod, insn->rm);
+            uint16_t result = alu<Op, Word>(readMemory<Word>(addr), imm);
+            if constexpr (writeBack) {
+                writeMemory<Word>(addr, result);
+            }
+            return cycles.ALU_IMM_MEM;
         }
-
-        uint32_t result = static_cast<uint32_t>(*dest) - static_cast<uint32_t>(srcVal);
-        setArithmeticFlags(result, *dest, srcVal);
-        
-        return cycleCount;
     }
 
-    uint32_t Instructions::handleCMPImm() {
-        // Handle CMP AL, imm8 (3C) and CMP AX, imm16 (3D)
-        uint8_t opcode = memory.readByte(memory.calculatePhysicalAddress(registers.CS, registers.IP - 1));
-        uint32_t cycleCount = cycles.ALU_IMM_REG;
-        
-        if (opcode == 0x3C) {
-            // CMP AL, imm8
-            uint8_t imm8 = fetchByte();
-            uint8_t al = registers.AX.low;
-            
-            uint16_t result = al - imm8;
-            setArithmeticFlags8(result, al, imm8);
-        } else if (opcode == 0x3D) {
-            // CMP AX, imm16
-            uint16_t imm16 = fetchWord();
-            uint16_t ax = registers.AX.value;
-            
-            uint32_t result = static_cast<uint32_t>(ax) - static_cast<uint32_t>(imm16);
-            setArithmeticFlags(result, ax, imm16);
-        }
-        
-        return cycleCount;
+    size_t Instructions::group1Index(const DecodedInstruction &insn) {
+        return (insn.isWord ? 0x10 : 0) | (insn.mod != 0b11 ? 0x08 : 0) | insn.reg;
     }
 
     uint32_t Instructions::handleGroup1() {
-        uint8_t opcode = memory.readByte(memory.calculatePhysicalAddress(registers.CS, registers.IP - 1));
-        uint8_t modrm = fetchByte();
-        uint8_t mod = (modrm >> 6) & 0x03;
-        uint8_t reg = (modrm >> 3) & 0x07;
-        uint8_t rm = modrm & 0x07;
-        
-        uint32_t cycleCount = 0;
-        
-        // Group 1 operations: ADD(0), OR(1), ADC(2), SBB(3), AND(4), SUB(5), XOR(6), CMP(7)
-        
-        if (opcode == 0x80) {  // 8-bit operands
-            uint8_t imm8 = fetchByte();
-            
-            if (mod == 0b11) {  // Register operand
-                uint8_t* dest = get8BitRegisterRef(rm);
-                uint8_t oldValue = *dest;
-                uint16_t result = 0;
-                
-                // Process based on operation type
-                switch (reg) {
-                    case 0: // ADD
-                        result = oldValue + imm8;
-                        *dest = result & 0xFF;
-                        break;
-                    case 1: // OR
-                        result = oldValue | imm8;
-                        *dest = result & 0xFF;
-                        break;
-                    case 2: // ADC (Add with Carry)
-                        result = oldValue + imm8 + (flags.getFlag(FLAGS::CF) ? 1 : 0);
-                        *dest = result & 0xFF;
-                        break;
-                    case 3: // SBB (Subtract with Borrow)
-                        result = oldValue - imm8 - (flags.getFlag(FLAGS::CF) ? 1 : 0);
-                        *dest = result & 0xFF;
-                        break;
-                    case 4: // AND
-                        result = oldValue & imm8;
-                        *dest = result & 0xFF;
-                        break;
-                    case 5: // SUB
-                        result = oldValue - imm8;
-                        *dest = result & 0xFF;
-                        break;
-                    case 6: // XOR
-                        result = oldValue ^ imm8;
-                        *dest = result & 0xFF;
-                        break;
-                    case 7: // CMP (don't update destination)
-                        result = oldValue - imm8;
-                        break;
-                }
-                
-                setArithmeticFlags8(result, oldValue, imm8);
-                cycleCount = cycles.ALU_IMM_REG;
-            } else {  // Memory operand
-                uint32_t addr = getEffectiveAddress(mod, rm);
-                uint8_t value = memory.readByte(addr);
-                uint16_t result = 0;
-                
-                // Process based on operation type
-                switch (reg) {
-                    case 0: // ADD
-                        result = value + imm8;
-                        memory.writeByte(addr, result & 0xFF);
-                        break;
-                    case 1: // OR
-                        result = value | imm8;
-                        memory.writeByte(addr, result & 0xFF);
-                        break;
-                    case 2: // ADC (Add with Carry)
-                        result = value + imm8 + (flags.getFlag(FLAGS::CF) ? 1 : 0);
-                        memory.writeByte(addr, result & 0xFF);
-                        break;
-                    case 3: // SBB (Subtract with Borrow)
-                        result = value - imm8 - (flags.getFlag(FLAGS::CF) ? 1 : 0);
-                        memory.writeByte(addr, result & 0xFF);
-                        break;
-                    case 4: // AND
-                        result = value & imm8;
-                        memory.writeByte(addr, result & 0xFF);
-                        break;
-                    case 5: // SUB
-                        result = value - imm8;
-                        memory.writeByte(addr, result & 0xFF);
-                        break;
-                    case 6: // XOR
-                        result = value ^ imm8;
-                        memory.writeByte(addr, result & 0xFF);
-                        break;
-                    case 7: // CMP (don't update destination)
-                        result = value - imm8;
-                        break;
-                }
-                
-                setArithmeticFlags8(result, value, imm8);
-                cycleCount = cycles.ALU_IMM_MEM;
-            }
-        } else if (opcode == 0x81) {  // 16-bit operands
-            uint16_t imm16 = fetchWord();
-            
-            if (mod == 0b11) {  // Register operand
-                uint16_t* dest = getRegisterReference(rm);
-                uint16_t oldValue = *dest;
-                uint32_t result = 0;
-                
-                // Process based on operation type
-                switch (reg) {
-                    case 0: // ADD
-                        result = static_cast<uint32_t>(oldValue) + static_cast<uint32_t>(imm16);
-                        *dest = result & 0xFFFF;
-                        break;
-                    case 1: // OR
-                        result = oldValue | imm16;
-                        *dest = result & 0xFFFF;
-                        break;
-                    case 2: // ADC (Add with Carry)
-                        result = static_cast<uint32_t>(oldValue) + static_cast<uint32_t>(imm16) + (flags.getFlag(FLAGS::CF) ? 1 : 0);
-                        *dest = result & 0xFFFF;
-                        break;
-                    case 3: // SBB (Subtract with Borrow)
-                        result = static_cast<uint32_t>(oldValue) - static_cast<uint32_t>(imm16) - (flags.getFlag(FLAGS::CF) ? 1 : 0);
-                        *dest = result & 0xFFFF;
-                        break;
-                    case 4: // AND
-                        result = oldValue & imm16;
-                        *dest = result & 0xFFFF;
-                        break;
-                    case 5: // SUB
-                        result = static_cast<uint32_t>(oldValue) - static_cast<uint32_t>(imm16);
-                        *dest = result & 0xFFFF;
-                        break;
-                    case 6: // XOR
-                        result = oldValue ^ imm16;
-                        *dest = result & 0xFFFF;
-                        break;
-                    case 7: // CMP (don't update destination)
-                        result = static_cast<uint32_t>(oldValue) - static_cast<uint32_t>(imm16);
-                        break;
-                }
-                
-                setArithmeticFlags(result, oldValue, imm16);
-                cycleCount = cycles.ALU_IMM_REG;
-            } else {  // Memory operand
-                uint32_t addr = getEffectiveAddress(mod, rm);
-                uint16_t value = memory.readWord(addr);
-                uint32_t result = 0;
-                
-                // Process based on operation type
-                switch (reg) {
-                    case 0: // ADD
-                        result = static_cast<uint32_t>(value) + static_cast<uint32_t>(imm16);
-                        memory.writeWord(addr, result & 0xFFFF);
-                        break;
-                    case 1: // OR
-                        result = value | imm16;
-                        memory.writeWord(addr, result & 0xFFFF);
-                        break;
-                    case 2: // ADC (Add with Carry)
-                        result = static_cast<uint32_t>(value) + static_cast<uint32_t>(imm16) + (flags.getFlag(FLAGS::CF) ? 1 : 0);
-                        memory.writeWord(addr, result & 0xFFFF);
-                        break;
-                    case 3: // SBB (Subtract with Borrow)
-                        result = static_cast<uint32_t>(value) - static_cast<uint32_t>(imm16) - (flags.getFlag(FLAGS::CF) ? 1 : 0);
-                        memory.writeWord(addr, result & 0xFFFF);
-                        break;
-                    case 4: // AND
-                        result = value & imm16;
-                        memory.writeWord(addr, result & 0xFFFF);
-                        break;
-                    case 5: // SUB
-                        result = static_cast<uint32_t>(value) - static_cast<uint32_t>(imm16);
-                        memory.writeWord(addr, result & 0xFFFF);
-                        break;
-                    case 6: // XOR
-                        result = value ^ imm16;
-                        memory.writeWord(addr, result & 0xFFFF);
-                        break;
-                    case 7: // CMP (don't update destination)
-                        result = static_cast<uint32_t>(value) - static_cast<uint32_t>(imm16);
-                        break;
-                }
-                
-                setArithmeticFlags(result, value, imm16);
-                cycleCount = cycles.ALU_IMM_MEM;
-            }
-        } else if (opcode == 0x83) {  // 16-bit operands, sign-extended 8-bit immediate
-            uint8_t imm8 = fetchByte();
-            int16_t signExtImm = static_cast<int8_t>(imm8);  // Sign extend 8-bit to 16-bit
-            
-            if (mod == 0b11) {  // Register operand
-                uint16_t* dest = getRegisterReference(rm);
-                uint16_t oldValue = *dest;
-                uint32_t result = 0;
-                
-                // Process based on operation type
-                switch (reg) {
-                    case 0: // ADD
-                        result = static_cast<uint32_t>(oldValue) + static_cast<uint32_t>(signExtImm);
-                        *dest = result & 0xFFFF;
-                        break;
-                    case 1: // OR
-                        result = oldValue | signExtImm;
-                        *dest = result & 0xFFFF;
-                        break;
-                    case 2: // ADC (Add with Carry)
-                        result = static_cast<uint32_t>(oldValue) + static_cast<uint32_t>(signExtImm) + (flags.getFlag(FLAGS::CF) ? 1 : 0);
-                        *dest = result & 0xFFFF;
-                        break;
-                    case 3: // SBB (Subtract with Borrow)
-                        result = static_cast<uint32_t>(oldValue) - static_cast<uint32_t>(signExtImm) - (flags.getFlag(FLAGS::CF) ? 1 : 0);
-                        *dest = result & 0xFFFF;
-                        break;
-                    case 4: // AND
-                        result = oldValue & signExtImm;
-                        *dest = result & 0xFFFF;
-                        break;
-                    case 5: // SUB
-                        result = static_cast<uint32_t>(oldValue) - static_cast<uint32_t>(signExtImm);
-                        *dest = result & 0xFFFF;
-                        break;
-                    case 6: // XOR
-                        result = oldValue ^ signExtImm;
-                        *dest = result & 0xFFFF;
-                        break;
-                    case 7: // CMP (don't update destination)
-                        result = static_cast<uint32_t>(oldValue) - static_cast<uint32_t>(signExtImm);
-                        break;
-                }
-                
-                setArithmeticFlags(result, oldValue, signExtImm);
-                cycleCount = cycles.ALU_IMM_REG;
-            } else {  // Memory operand
-                uint32_t addr = getEffectiveAddress(mod, rm);
-                uint16_t value = memory.readWord(addr);
-                uint32_t result = 0;
-                
-                // Process based on operation type
-                switch (reg) {
-                    case 0: // ADD
-                        result = static_cast<uint32_t>(value) + static_cast<uint32_t>(signExtImm);
-                        memory.writeWord(addr, result & 0xFFFF);
-                        break;
-                    case 1: // OR
-                        result = value | signExtImm;
-                        memory.writeWord(addr, result & 0xFFFF);
-                        break;
-                    case 2: // ADC (Add with Carry)
-                        result = static_cast<uint32_t>(value) + static_cast<uint32_t>(signExtImm) + (flags.getFlag(FLAGS::CF) ? 1 : 0);
-                        memory.writeWord(addr, result & 0xFFFF);
-                        break;
-                    case 3: // SBB (Subtract with Borrow)
-                        result = static_cast<uint32_t>(value) - static_cast<uint32_t>(signExtImm) - (flags.getFlag(FLAGS::CF) ? 1 : 0);
-                        memory.writeWord(addr, result & 0xFFFF);
-                        break;
-                    case 4: // AND
-                        result = value & signExtImm;
-                        memory.writeWord(addr, result & 0xFFFF);
-                        break;
-                    case 5: // SUB
-                        result = static_cast<uint32_t>(value) - static_cast<uint32_t>(signExtImm);
-                        memory.writeWord(addr, result & 0xFFFF);
-                        break;
-                    case 6: // XOR
-                        result = value ^ signExtImm;
-                        memory.writeWord(addr, result & 0xFFFF);
-                        break;
-                    case 7: // CMP (don't update destination)
-                        result = static_cast<uint32_t>(value) - static_cast<uint32_t>(signExtImm);
-                        break;
-                }
-                
-                setArithmeticFlags(result, value, signExtImm);
-                cycleCount = cycles.ALU_IMM_MEM;
-            }
-        }
-        
-        return cycleCount;
+        return (this->*group1Table[group1Index(*insn)])();
     }
 
     uint8_t* Instructions::get8BitRegisterRef(uint8_t reg) {
@@ -862,148 +1113,52 @@ namespace CPU {
     // INC and DEC
     //--------------------------------------------------------------------------
     uint32_t Instructions::handleINC() {
-        // 0x40-0x47 => inc register
-        uint8_t lastOpcode = memory.readByte(memory.calculatePhysicalAddress(registers.CS, registers.IP - 1));
-        uint8_t regCode = lastOpcode & 0x07;  // e.g. 0x40 => 0, 0x41 => 1, etc.
-
-        uint16_t* dest = getRegisterReference(regCode);
-
-        uint32_t result = static_cast<uint32_t>(*dest) + 1;
-        setArithmeticFlags(result, *dest, 1);
-        *dest = static_cast<uint16_t>(result);
-        
-        return cycles.INC_REG;
-    }
-
-    uint32_t Instructions::handleDEC() {
-        // 0x48-0x4F => dec register
-        uint8_t lastOpcode = memory.readByte(memory.calculatePhysicalAddress(registers.CS, registers.IP - 1));
-        uint8_t regCode = lastOpcode & 0x07;
-
-        uint16_t* dest = getRegisterReference(regCode);
-
-        uint32_t result = static_cast<uint32_t>(*dest) - 1;
-        setArithmeticFlags(result, *dest, 1);
-        *dest = static_cast<uint16_t>(result);
-        
-        return cycles.INC_REG;
-    }
-
-    //--------------------------------------------------------------------------
-    // Logic: AND, OR, XOR, NOT
-    //--------------------------------------------------------------------------
-    uint32_t Instructions::handleAND() {
-        uint8_t modrm = fetchByte();
-        uint8_t mod   = (modrm >> 6) & 0x03;
-        uint8_t reg   = (modrm >> 3) & 0x07;
-        uint8_t rm    = (modrm & 0x07);
-
-        uint16_t* dest;
-        uint16_t  srcVal;
-        uint32_t cycleCount = 0;
-
-        if(mod == 0b11) {
-            dest   = getRegisterReference(rm);
-            srcVal = *getRegisterReference(reg);
-            cycleCount = cycles.ALU_REG_REG;
-        } else {
-            dest   = getMemoryReference(mod, rm);
-            srcVal = *getRegisterReference(reg);
-            cycleCount = cycles.ALU_REG_MEM;
-        }
-
-        uint16_t result = (*dest) & srcVal;
-        *dest = result;
-
-        // Set flags
-        flags.setFlag(FLAGS::ZF, (result == 0));
-        flags.setFlag(FLAGS::SF, (result & 0x8000) != 0);
-        flags.setFlag(FLAGS::OF, false);
-        flags.setFlag(FLAGS::CF, false);
-        flags.setFlag(FLAGS::AF, false);
-        flags.setFlag(FLAGS::PF, utils.calculateParity(result));
-        
-        return cycleCount;
-    }
-
-    uint32_t Instructions::handleOR() {
-        uint8_t modrm = fetchByte();
-        uint8_t mod   = (modrm >> 6) & 0x03;
-        uint8_t reg   = (modrm >> 3) & 0x07;
-        uint8_t rm    = (modrm & 0x07);
-
-        uint16_t* dest;
-        uint16_t  srcVal;
-        uint32_t cycleCount = 0;
-
-        if(mod == 0b11) {
-            dest   = getRegisterReference(rm);
-            srcVal = *getRegisterReference(reg);
-            cycleCount = cycles.ALU_REG_REG;
-        } else {
-            dest   = getMemoryReference(mod, rm);
-            srcVal = *getRegisterReference(reg);
-            cycleCount = cycles.ALU_REG_MEM;
-        }
-
-        uint16_t result = (*dest) | srcVal;
-        *dest = result;
-
-        flags.setFlag(FLAGS::ZF, (result == 0));
-        flags.setFlag(FLAGS::SF, (result & 0x8000) != 0);
-        flags.setFlag(FLAGS::OF, false);
-        flags.setFlag(FLAGS::CF, false);
-        flags.setFlag(FLAGS::AF, false);
-        flags.setFlag(FLAGS::PF, utils.calculateParity(result));
-        
-        return cycleCount;
-    }
+        // 0x40-0x47 => inc register
+        uint8_t lastOpcode = currentOpcode;
+        uint8_t regCode = lastOpcode & 0x07;  // e.g. 0x40 => 0, 0x41 => 1, etc.
 
-    uint32_t Instructions::handleXOR() {
-        uint8_t modrm = fetchByte();
-        uint8_t mod   = (modrm >> 6) & 0x03;
-        uint8_t reg   = (modrm >> 3) & 0x07;
-        uint8_t rm    = (modrm & 0x07);
+        uint16_t* dest = getRegisterReference(regCode);
 
-        uint16_t* dest;
-        uint16_t  srcVal;
-        uint32_t cycleCount = 0;
+        uint32_t result = static_cast<uint32_t>(*dest) + 1;
+        setArithmeticFlags(FlagOp::Inc, result, *dest, 1);
+        *dest = static_cast<uint16_t>(result);
+        
+        return cycles.INC_REG;
+    }
 
-        if(mod == 0b11) {
-            dest   = getRegisterReference(rm);
-            srcVal = *getRegisterReference(reg);
-            cycleCount = cycles.ALU_REG_REG;
-        } else {
-            dest   = getMemoryReference(mod, rm);
-            srcVal = *getRegisterReference(reg);
-            cycleCount = cycles.ALU_REG_MEM;
-        }
+    uint32_t Instructions::handleDEC() {
+        // 0x48-0x4F => dec register
+        uint8_t lastOpcode = currentOpcode;
+        uint8_t regCode = lastOpcode & 0x07;
 
-        uint16_t result = (*dest) ^ srcVal;
-        *dest = result;
+        uint16_t* dest = getRegisterReference(regCode);
 
-        flags.setFlag(FLAGS::ZF, (result == 0));
-        flags.setFlag(FLAGS::SF, (result & 0x8000) != 0);
-        flags.setFlag(FLAGS::OF, false);
-        flags.setFlag(FLAGS::CF, false);
-        flags.setFlag(FLAGS::AF, false);
-        flags.setFlag(FLAGS::PF, utils.calculateParity(result));
+        uint32_t result = static_cast<uint32_t>(*dest) - 1;
+        setArithmeticFlags(FlagOp::Dec, result, *dest, 1);
+        *dest = static_cast<uint16_t>(result);
         
-        return cycleCount;
+        return cycles.INC_REG;
     }
 
+    //--------------------------------------------------------------------------
+    // Logic: NOT
+    //--------------------------------------------------------------------------
     uint32_t Instructions::handleNOT() {
-        uint8_t modrm = fetchByte();
+        uint8_t modrm = insn->modrm;
         uint8_t mod   = (modrm >> 6) & 0x03;
         uint8_t rm    = (modrm & 0x07);
         uint32_t cycleCount = 0;
 
         uint16_t* dest;
+        uint16_t memoryOperand = 0;
+        uint32_t address = 0;
         if(mod == 0b11) {
             dest = getRegisterReference(rm);
             cycleCount = cycles.ALU_REG_REG;
         } else {
-            dest = getMemoryReference(mod, rm);
+            address = getEffectiveAddress(mod, rm);
+            memoryOperand = memory.readWord(address);
+            dest = &memoryOperand;
             cycleCount = cycles.ALU_MEM_REG;
         }
 
@@ -1012,7 +1167,11 @@ namespace CPU {
         flags.setFlag(FLAGS::ZF, (*dest == 0));
         flags.setFlag(FLAGS::SF, (*dest & 0x8000) != 0);
         flags.setFlag(FLAGS::PF, utils.calculateParity(*dest));
-        
+
+        if(mod != 0b11) {
+            memory.writeWord(address, *dest);
+        }
+
         return cycleCount;
     }
 
@@ -1021,7 +1180,7 @@ namespace CPU {
     //--------------------------------------------------------------------------
     uint32_t Instructions::handleSHL() {
         // For 0xD0, 0xD1, 0xD2, 0xD3, check how many bits to shift
-        uint8_t modrm = fetchByte();
+        uint8_t modrm = insn->modrm;
         uint8_t reg = (modrm >> 3) & 0x07;
         uint8_t rm  = (modrm & 0x07);
         uint8_t mod = (modrm >> 6) & 0x03;
@@ -1030,11 +1189,15 @@ namespace CPU {
         // Shift count: if opcode is D0 or D1 => 1 bit
         // if D2 or D3 => shift = CL
         uint16_t* dest;
+        uint16_t memoryOperand = 0;
+        uint32_t address = 0;
         if(mod == 0b11) {
             dest = getRegisterReference(rm);
             cycleCount = cycles.SHIFT_REG_1;
         } else {
-            dest = getMemoryReference(mod, rm);
+            address = getEffectiveAddress(mod, rm);
+            memoryOperand = memory.readWord(address);
+            dest = &memoryOperand;
             cycleCount = cycles.SHIFT_MEM_1;
         }
 
@@ -1055,22 +1218,29 @@ namespace CPU {
         flags.setFlag(FLAGS::PF, utils.calculateParity(result));
 
         *dest = result;
-        
+        if(mod != 0b11) {
+            memory.writeWord(address, *dest);
+        }
+
         return cycleCount;
     }
 
     uint32_t Instructions::handleSHR() {
-        uint8_t modrm = fetchByte();
+        uint8_t modrm = insn->modrm;
         uint8_t rm    = (modrm & 0x07);
         uint8_t mod   = (modrm >> 6) & 0x03;
         uint32_t cycleCount = 0;
 
         uint16_t* dest;
+        uint16_t memoryOperand = 0;
+        uint32_t address = 0;
         if(mod == 0b11) {
             dest = getRegisterReference(rm);
             cycleCount = cycles.SHIFT_REG_1;
         } else {
-            dest = getMemoryReference(mod, rm);
+            address = getEffectiveAddress(mod, rm);
+            memoryOperand = memory.readWord(address);
+            dest = &memoryOperand;
             cycleCount = cycles.SHIFT_MEM_1;
         }
 
@@ -1088,7 +1258,10 @@ namespace CPU {
         flags.setFlag(FLAGS::PF, utils.calculateParity(result));
 
         *dest = result;
-        
+        if(mod != 0b11) {
+            memory.writeWord(address, *dest);
+        }
+
         return cycleCount;
     }
 
@@ -1097,17 +1270,17 @@ namespace CPU {
     //--------------------------------------------------------------------------
     uint32_t Instructions::handleJMP() {
         // Check if it's a short (EB) or near (E9) jump
-        uint8_t opcode = memory.readByte(memory.calculatePhysicalAddress(registers.CS, registers.IP - 1));
+        uint8_t opcode = currentOpcode;
         uint32_t cycleCount = 0;
         
         if (opcode == 0xEB) {
             // Short jump (8-bit displacement)
-            int8_t disp8 = static_cast<int8_t>(fetchByte());
+            int8_t disp8 = static_cast<int8_t>(insn->imm);
             registers.IP += disp8;
             cycleCount = cycles.JMP_SHORT;
         } else if (opcode == 0xE9) {
             // Near jump (16-bit displacement)
-            int16_t disp16 = static_cast<int16_t>(fetchWord());
+            int16_t disp16 = static_cast<int16_t>(insn->imm);
             registers.IP += disp16;
             cycleCount = cycles.JMP_NEAR;
         }
@@ -1116,7 +1289,7 @@ namespace CPU {
     }
 
     uint32_t Instructions::handleJE() {
-        int8_t offset = static_cast<int8_t>(fetchByte());
+        int8_t offset = static_cast<int8_t>(insn->imm);
         // Jump if ZF=1 (equal)
         if (flags.getFlag(FLAGS::ZF)) {
             registers.IP += offset;
@@ -1126,7 +1299,7 @@ namespace CPU {
     }
 
     uint32_t Instructions::handleJNE() {
-        int16_t offset = static_cast<int16_t>(fetchWord());
+        int16_t offset = static_cast<int16_t>(insn->imm);
         if(!flags.getFlag(FLAGS::ZF)) {
             registers.IP += offset;
             return cycles.JCOND_TAKEN;
@@ -1135,7 +1308,7 @@ namespace CPU {
     }
 
     uint32_t Instructions::handleJG() {
-        int16_t offset = static_cast<int16_t>(fetchWord());
+        int16_t offset = static_cast<int16_t>(insn->imm);
         // JG => ZF=0 and SF=OF
         bool cond = (!flags.getFlag(FLAGS::ZF) && (flags.getFlag(FLAGS::SF) == flags.getFlag(FLAGS::OF)));
         if(cond) {
@@ -1146,7 +1319,7 @@ namespace CPU {
     }
 
     uint32_t Instructions::handleJGE() {
-        int16_t offset = static_cast<int16_t>(fetchWord());
+        int16_t offset = static_cast<int16_t>(insn->imm);
         // JGE => SF=OF
         if(flags.getFlag(FLAGS::SF) == flags.getFlag(FLAGS::OF)) {
             registers.IP += offset;
@@ -1156,7 +1329,7 @@ namespace CPU {
     }
 
     uint32_t Instructions::handleJL() {
-        int16_t offset = static_cast<int16_t>(fetchWord());
+        int16_t offset = static_cast<int16_t>(insn->imm);
         // JL => SF!=OF
         if(flags.getFlag(FLAGS::SF) != flags.getFlag(FLAGS::OF)) {
             registers.IP += offset;
@@ -1166,7 +1339,7 @@ namespace CPU {
     }
 
     uint32_t Instructions::handleJLE() {
-        int16_t offset = static_cast<int16_t>(fetchWord());
+        int16_t offset = static_cast<int16_t>(insn->imm);
         // JLE => ZF=1 or SF!=OF
         bool cond = (flags.getFlag(FLAGS::ZF) || (flags.getFlag(FLAGS::SF) != flags.getFlag(FLAGS::OF)));
         if(cond) {
@@ -1182,7 +1355,7 @@ namespace CPU {
     uint32_t Instructions::handlePUSH() {
         // Example: 0x50 => PUSH AX, 0x51 => PUSH CX, etc.
         // Parse the last opcode, get which reg it is, then do SP -= 2, writeWord(SS:SP, reg).
-        uint8_t lastOp = memory.readByte(memory.calculatePhysicalAddress(registers.CS, registers.IP - 1));
+        uint8_t lastOp = currentOpcode;
         uint8_t regCode = lastOp & 0x07;
         uint16_t* src = getRegisterReference(regCode);
 
@@ -1195,7 +1368,7 @@ namespace CPU {
 
     uint32_t Instructions::handlePOP() {
         // 0x58 => POP AX, 0x59 => POP CX, etc.
-        uint8_t lastOp = memory.readByte(memory.calculatePhysicalAddress(registers.CS, registers.IP - 1));
+        uint8_t lastOp = currentOpcode;
         uint8_t regCode = lastOp & 0x07;
         uint16_t* dest = getRegisterReference(regCode);
 
@@ -1209,7 +1382,7 @@ namespace CPU {
     uint32_t Instructions::handleCALL() {
         // 0xE8 => CALL rel16
         // push IP, then IP += offset
-        int16_t offset = static_cast<int16_t>(fetchWord());
+        int16_t offset = static_cast<int16_t>(insn->imm);
 
         // push current IP onto stack
         registers.SP -= 2;
@@ -1234,146 +1407,78 @@ namespace CPU {
     // INT, HLT
     //--------------------------------------------------------------------------
     uint32_t Instructions::handleINT() {
-        uint8_t intNum = fetchByte();
+        interrupt(static_cast<uint8_t>(insn->imm));
+        return cycles.INT;
+    }
+
+    // Interrupt entry through the IVT at 0000:0000, which holds an IP and
+    // a CS for each vector
+    void Instructions::interrupt(uint8_t vector) {
+        // 1. Push flags
+        registers.SP -= 2;
+        uint32_t stackAddr = memory.calculatePhysicalAddress(registers.SS, registers.SP);
+        uint16_t flagsValue = 0;
+        // Set all flags bits
+        for (int i = 0; i < 16; i++) {
+            if (flags.getFlag(1 << i)) {
+                flagsValue |= (1 << i);
+            }
+        }
+        memory.writeWord(stackAddr, flagsValue);
         
-        // Calculate the address of the interrupt vector in the IVT
-        // The IVT is located at physical address 0x0000:0x0000
-        // Each interrupt vector is 4 bytes (2 for IP, 2 for CS)
-        uint32_t ivtEntryAddress = intNum * 4;
+        // 2. Push CS (current code segment)
+        registers.SP -= 2;
+        stackAddr = memory.calculatePhysicalAddress(registers.SS, registers.SP);
+        memory.writeWord(stackAddr, registers.CS);
         
-        // Check if we're emulating certain interrupts directly
-        bool emulatedInterrupt = false;
+        // 3. Push IP (return address)
+        registers.SP -= 2;
+        stackAddr = memory.calculatePhysicalAddress(registers.SS, registers.SP);
+        memory.writeWord(stackAddr, registers.IP);
         
-        // Handle specific interrupts directly (BIOS/DOS services)
-        if (intNum == 0x10 || intNum == 0x16 || intNum == 0x21) {
-            emulatedInterrupt = true;
-            
-            // Save state if using the real IVT mechanism later
-            uint16_t oldFlags = 0;
-            if (flags.getFlag(FLAGS::IF)) oldFlags |= FLAGS::IF;
-            if (flags.getFlag(FLAGS::TF)) oldFlags |= FLAGS::TF;
-            
-            // Clear IF (interrupt) and TF (trap) flags as per 8086 behavior
-            flags.setFlag(FLAGS::IF, false);
-            flags.setFlag(FLAGS::TF, false);
-            
-            // Handle specific interrupts
-            switch (intNum) {
-                case 0x10: {  // BIOS Video Services
-                    uint8_t ah = registers.AX.high;  // Function number
-                    
-                    switch (ah) {
-                        case 0x0E: {  // Teletype output
-                            char character = registers.AX.low;  // Character to print
-                            std::cout << character;  // Print to console
-                            break;
-                        }
-                        case 0x00: {  // Set video mode
-                            std::cout << "INT 10h: Set video mode " << static_cast<int>(registers.AX.low) << std::endl;
-                            break;
-                        }
-                        case 0x02: {  // Set cursor position
-                            std::cout << "INT 10h: Set cursor position to row " << static_cast<int>(registers.DX.high)
-                                    << ", col " << static_cast<int>(registers.DX.low) << std::endl;
-                            break;
-                        }
-                        case 0x09: {  // Write character and attribute
-                            char character = registers.AX.low;
-                            std::cout << "INT 10h: Write character '" << character << "' with attribute "
-                                    << static_cast<int>(registers.BX.low) << std::endl;
-                            break;
-                        }
-                        case 0x13: {  // Write string
-                            std::cout << "INT 10h: Write string (not fully implemented)" << std::endl;
-                            break;
-                        }
-                        default:
-                            std::cout << "INT 10h: Function " << static_cast<int>(ah) << " (not implemented)" << std::endl;
-                            break;
-                    }
-                    break;
-                }
-                case 0x16: {  // Keyboard services
-                    uint8_t ah = registers.AX.high;  // Function number
-                    
-                    switch (ah) {
-                        case 0x00:  // Wait for keystroke and read
-                            registers.AX.low = 'A';  // Dummy: simulate user pressed 'A'
-                            break;
-                        case 0x01:  // Check for keystroke
-                            flags.setFlag(FLAGS::ZF, false);  // Indicate keypress available
-                            registers.AX.low = 'A';  // Dummy: simulate user pressed 'A'
-                            break;
-                        default:
-                            std::cout << "INT 16h: Function " << static_cast<int>(ah) << " (not implemented)" << std::endl;
-                            break;
-                    }
-                    break;
-                }
-                case 0x21: {  // DOS services
-                    uint8_t ah = registers.AX.high;  // Function number
-                    
-                    switch (ah) {
-                        case 0x01:  // Character input with echo
-                            registers.AX.low = 'A';  // Dummy: simulate user input 'A'
-                            std::cout << "A";  // Echo character
-                            break;
-                        case 0x02:  // Character output
-                            std::cout << static_cast<char>(registers.DX.low);
-                            break;
-                        case 0x09:  // Print string (terminated by '$')
-                            {
-                                uint32_t addr = memory.calculatePhysicalAddress(registers.DS, registers.DX.value);
-                                char c;
-                                while ((c = memory.readByte(addr++)) != '$') {
-                                    std::cout << c;
-                                }
-                            }
-                            break;
-                        case 0x4C:  // Exit program
-                            halted = true;
-                            break;
-                        default:
-                            std::cout << "INT 21h: Function " << static_cast<int>(ah) << " (not implemented)" << std::endl;
-                            break;
-                    }
-                    break;
-                }
-            }
-        } else {
-            // Use IVT for other interrupts
-            // 1. Push flags
-            registers.SP -= 2;
-            uint32_t stackAddr = memory.calculatePhysicalAddress(registers.SS, registers.SP);
-            uint16_t flagsValue = 0;
-            // Set all flags bits
-            for (int i = 0; i < 16; i++) {
-                if (flags.getFlag(1 << i)) {
-                    flagsValue |= (1 << i);
-                }
-            }
-            memory.writeWord(stackAddr, flagsValue);
-            
-            // 2. Push CS (current code segment)
-            registers.SP -= 2;
-            stackAddr = memory.calculatePhysicalAddress(registers.SS, registers.SP);
-            memory.writeWord(stackAddr, registers.CS);
-            
-            // 3. Push IP (return address)
-            registers.SP -= 2;
-            stackAddr = memory.calculatePhysicalAddress(registers.SS, registers.SP);
-            memory.writeWord(stackAddr, registers.IP);
-            
-            // 4. Clear IF and TF flags
-            flags.setFlag(FLAGS::IF, false);
-            flags.setFlag(FLAGS::TF, false);
-            
-            // 5. Load CS:IP from IVT
-            registers.IP = memory.readWord(ivtEntryAddress);
-            registers.CS = memory.readWord(ivtEntryAddress + 2);
-        }
+        // 4. Clear IF and TF flags
+        flags.setFlag(FLAGS::IF, false);
+        flags.setFlag(FLAGS::TF, false);
         
-        return cycles.INT;
+        // 5. Load CS:IP from IVT
+        uint32_t ivtEntryAddress = vector * 4;
+        registers.IP = memory.readWord(ivtEntryAddress);
+        registers.CS = memory.readWord(ivtEntryAddress + 2);
+        updateAttention();
+    }
+
+    uint32_t Instructions::serviceAttention(IO::PIC &pic) {
+        uint32_t spent = 0;
+        // The trap comes first; the interrupt entry it makes clears IF,
+        // so a pending IRQ waits for the trap handler's IRET
+        if (trapArmed) {
+            interrupt(1);
+            spent += cycles.TRAP;
+        }
+        if (interruptRequest && flags.getFlag(FLAGS::IF)) {
+            interrupt(pic.acknowledge());
+            halted = false;  // An interrupt ends HLT
+            spent += cycles.INTR;
+        }
+        trapArmed = flags.getFlag(FLAGS::TF);
+        updateAttention();
+        return spent;
+    }
+
+    int Instructions::peekKey() {
+        if (!consoleInput) {
+            return 'A';  // No input attached: simulate user pressed 'A'
+        }
+        int key = consoleInput->peek();
+        return key == std::char_traits<char>::eof() ? -1 : key;
+    }
+
+    uint8_t Instructions::readKey() {
+        if (!consoleInput) {
+            return 'A';
+        }
+        int key = consoleInput->get();
+        return key == std::char_traits<char>::eof() ? 0 : static_cast<uint8_t>(key);
     }
 
     uint32_t Instructions::handleHLT() {
@@ -1381,12 +1486,151 @@ namespace CPU {
         return cycles.HLT;
     }
 
+    //--------------------------------------------------------------------------
+    // Host services
+    //--------------------------------------------------------------------------
+    void Instructions::setService(uint8_t vector, ServiceHandler handler) {
+        services[vector] = std::move(handler);
+        if (services[vector]) {
+            pointAtStub(vector);
+        }
+    }
+
+    void Instructions::installServices() {
+        for (int vector = 0; vector < 256; vector++) {
+            if (services[vector]) {
+                pointAtStub(static_cast<uint8_t>(vector));
+            }
+        }
+    }
+
+    void Instructions::pointAtStub(uint8_t vector) {
+        memory.writeWord(vector * 4u, static_cast<uint16_t>(vector * 4));
+        memory.writeWord(vector * 4u + 2, SERVICE_SEGMENT);
+    }
+
+    uint32_t Instructions::handleServiceTrap() {
+        uint8_t vector = static_cast<uint8_t>(insn->imm);
+
+        // Only the stub's own trap has an INT frame under it. Anywhere else
+        // the opcode is as undefined as on the real part.
+        if (registers.CS != SERVICE_SEGMENT ||
+            static_cast<uint16_t>(registers.IP - insn->length) != vector * 4) {
+            return handleUnknown();
+        }
+        const ServiceHandler &service = services[vector];
+        if (!service) {
+            throw std::runtime_error("No service for interrupt " + std::to_string(vector));
+        }
+        service();
+
+        // The stub's IRET pops the FLAGS pushed by the INT. Results go back
+        // in the arithmetic flags, as a BIOS returning with RETF 2 would
+        // leave them.
+        uint32_t flagsAddr = memory.calculatePhysicalAddress(registers.SS, static_cast<uint16_t>(registers.SP + 4));
+        uint16_t saved = memory.readWord(flagsAddr);
+        uint16_t result = saved & ~ARITHMETIC_FLAGS;
+        for (uint16_t flag : {CF, PF, AF, ZF, SF, OF}) {
+            if (flags.getFlag(flag)) {
+                result |= flag;
+            }
+        }
+        if (result != saved) {
+            memory.writeWord(flagsAddr, result);
+        }
+        return cycles.SERVICE;
+    }
+
+    void Instructions::videoService() {
+        uint8_t ah = registers.AX.high;  // Function number
+        
+        switch (ah) {
+            case 0x0E: {  // Teletype output
+                char character = registers.AX.low;  // Character to print
+                *consoleOutput << character;  // Print to console
+                break;
+            }
+            case 0x00: {  // Set video mode
+                *consoleOutput << "INT 10h: Set video mode " << static_cast<int>(registers.AX.low) << std::endl;
+                break;
+            }
+            case 0x02: {  // Set cursor position
+                *consoleOutput << "INT 10h: Set cursor position to row " << static_cast<int>(registers.DX.high)
+                        << ", col " << static_cast<int>(registers.DX.low) << std::endl;
+                break;
+            }
+            case 0x09: {  // Write character and attribute
+                char character = registers.AX.low;
+                *consoleOutput << "INT 10h: Write character '" << character << "' with attribute "
+                        << static_cast<int>(registers.BX.low) << std::endl;
+                break;
+            }
+            case 0x13: {  // Write string
+                *consoleOutput << "INT 10h: Write string (not fully implemented)" << std::endl;
+                break;
+            }
+            default:
+                *consoleOutput << "INT 10h: Function " << static_cast<int>(ah) << " (not implemented)" << std::endl;
+                break;
+        }
+    }
+
+    void Instructions::keyboardService() {
+        uint8_t ah = registers.AX.high;  // Function number
+        
+        switch (ah) {
+            case 0x00:  // Wait for keystroke and read
+                registers.AX.low = readKey();
+                break;
+            case 0x01: {  // Check for keystroke
+                int key = peekKey();
+                flags.setFlag(FLAGS::ZF, key < 0);  // ZF set when no key is waiting
+                if (key >= 0) {
+                    registers.AX.low = static_cast<uint8_t>(key);
+                }
+                break;
+            }
+            default:
+                *consoleOutput << "INT 16h: Function " << static_cast<int>(ah) << " (not implemented)" << std::endl;
+                break;
+        }
+    }
+
+    void Instructions::dosService() {
+        uint8_t ah = registers.AX.high;  // Function number
+        
+        switch (ah) {
+            case 0x01:  // Character input with echo
+                registers.AX.low = readKey();
+                *consoleOutput << static_cast<char>(registers.AX.low);  // Echo character
+                break;
+            case 0x02:  // Character output
+                *consoleOutput << static_cast<char>(registers.DX.low);
+                break;
+            case 0x09:  // Print string (terminated by '$')
+                {
+                    uint32_t addr = memory.calculatePhysicalAddress(registers.DS, registers.DX.value);
+                    char c;
+                    while ((c = memory.readByte(addr++)) != '$') {
+                        *consoleOutput << c;
+                    }
+                }
+                break;
+            case 0x4C:  // Exit program
+                halted = true;
+                break;
+            default:
+                *consoleOutput << "INT 21h: Function " << static_cast<int>(ah) << " (not implemented)" << std::endl;
+                break;
+        }
+    }
+
     //--------------------------------------------------------------------------
     // String operations
     //--------------------------------------------------------------------------
     uint32_t Instructions::handleMOVS() {
         // Get the opcode to determine if it's byte or word operation
-        uint8_t lastOpcode = memory.readByte(memory.calculatePhysicalAddress(registers.CS, registers.IP - 1));
+        uint8_t lastOpcode = currentOpcode;
         bool isWord = (lastOpcode == 0xA5); // MOVSW = 0xA5, MOVSB = 0xA4
         
         // Calculate source and destination addresses
@@ -1421,12 +1665,12 @@ namespace CPU {
             }
         }
         
-        return 18; // MOVS takes about 18 cycles on 8086
+        return cycles.MOVS;
     }
 
     uint32_t Instructions::handleCMPS() {
         // Get the opcode to determine if it's byte or word operation
-        uint8_t lastOpcode = memory.readByte(memory.calculatePhysicalAddress(registers.CS, registers.IP - 1));
+        uint8_t lastOpcode = currentOpcode;
         bool isWord = (lastOpcode == 0xA7); // CMPSW = 0xA7, CMPSB = 0xA6
         
         // Calculate source and destination addresses
@@ -1440,7 +1684,7 @@ namespace CPU {
             
             // Perform comparison and set flags
             uint32_t result = static_cast<uint32_t>(dest) - static_cast<uint32_t>(src);
-            setArithmeticFlags(result, dest, src);
+            setArithmeticFlags(FlagOp::Sub, result, dest, src);
             
             // Update SI and DI based on direction flag
             if (flags.getFlag(FLAGS::DF)) {
@@ -1457,7 +1701,7 @@ namespace CPU {
             
             // Perform comparison and set flags
             uint16_t result = static_cast<uint16_t>(dest) - static_cast<uint16_t>(src);
-            setArithmeticFlags8(result, dest, src);
+            setArithmeticFlags8(FlagOp::Sub, result, dest, src);
             
             // Update SI and DI based on direction flag
             if (flags.getFlag(FLAGS::DF)) {
@@ -1469,12 +1713,12 @@ namespace CPU {
             }
         }
         
-        return 22; // CMPS takes 22 cycles on 8086
+        return cycles.CMPS;
     }
 
     uint32_t Instructions::handleSTOS() {
         // Get the opcode to determine if it's byte or word operation
-        uint8_t lastOpcode = memory.readByte(memory.calculatePhysicalAddress(registers.CS, registers.IP - 1));
+        uint8_t lastOpcode = currentOpcode;
         bool isWord = (lastOpcode == 0xAB); // STOSW = 0xAB, STOSB = 0xAA
         
         // Calculate destination address (ES:DI)
@@ -1502,12 +1746,12 @@ namespace CPU {
             }
         }
         
-        return 11; // STOS takes about 11 cycles on 8086
+        return cycles.STOS;
     }
 
     uint32_t Instructions::handleLODS() {
         // Get the opcode to determine if it's byte or word operation
-        uint8_t lastOpcode = memory.readByte(memory.calculatePhysicalAddress(registers.CS, registers.IP - 1));
+        uint8_t lastOpcode = currentOpcode;
         bool isWord = (lastOpcode == 0xAD); // LODSW = 0xAD, LODSB = 0xAC
         
         // Calculate source address (DS:SI)
@@ -1540,7 +1784,7 @@ namespace CPU {
 
     uint32_t Instructions::handleSCAS() {
         // Get the opcode to determine if it's byte or word operation
-        uint8_t lastOpcode = memory.readByte(memory.calculatePhysicalAddress(registers.CS, registers.IP - 1));
+        uint8_t lastOpcode = currentOpcode;
         bool isWord = (lastOpcode == 0xAF); // SCASW = 0xAF, SCASB = 0xAE
         
         // Calculate destination address (ES:DI)
@@ -1553,7 +1797,7 @@ namespace CPU {
             
             // Perform comparison and set flags
             uint32_t result = static_cast<uint32_t>(src) - static_cast<uint32_t>(dest);
-            setArithmeticFlags(result, src, dest);
+            setArithmeticFlags(FlagOp::Sub, result, src, dest);
             
             // Update DI based on direction flag
             if (flags.getFlag(FLAGS::DF)) {
@@ -1568,7 +1812,7 @@ namespace CPU {
             
             // Perform comparison and set flags
             uint16_t result = static_cast<uint16_t>(src) - static_cast<uint16_t>(dest);
-            setArithmeticFlags8(result, src, dest);
+            setArithmeticFlags8(FlagOp::Sub, result, src, dest);
             
             // Update DI based on direction flag
             if (flags.getFlag(FLAGS::DF)) {
@@ -1578,27 +1822,40 @@ namespace CPU {
             }
         }
         
-        return 15; // SCAS takes 15 cycles on 8086
+        return cycles.SCAS;
     }
 
     uint32_t Instructions::handleREP() {
         // Get the REP prefix opcode
-        uint8_t prefixOpcode = memory.readByte(memory.calculatePhysicalAddress(registers.CS, registers.IP - 1));
-        bool isREPZ = (prefixOpcode == 0xF3); // REPZ/REPE = 0xF3, REPNZ/REPNE = 0xF2
+        bool isREPZ = (insn->opcode == 0xF3); // REPZ/REPE = 0xF3, REPNZ/REPNE = 0xF2
         
-        // Fetch the string operation opcode
-        uint8_t stringOpcode = fetchByte();
-        
-        // Save the current IP to return to the string operation
-        uint16_t savedIP = registers.IP;
+        // The decoder pairs the prefix with the string operation that follows it
+        uint8_t stringOpcode = insn->stringOpcode;
         
         uint32_t totalCycles = 2; // Initial REP prefix overhead
         
+        // REP in front of anything but a string operation has no effect
+        if (stringOpcode == 0) {
+            return totalCycles;
+        }
+
+        // Only CMPS and SCAS stop on ZF; the other string operations
+        // don't set it and run for the whole count
+        bool compares = (stringOpcode & 0xF6) == 0xA6; // A6/A7 CMPS, AE/AF SCAS
+
+        // Block copies and fills are done in one go
+        uint16_t count = registers.CX.value;
+        if (!compares && count != 0 && repeatBlock(stringOpcode)) {
+            return totalCycles + count * (stringOpcode >= 0xAA ? cycles.STOS : cycles.MOVS);
+        }
+
+        // Comparisons are scanned ahead to the element they stop at
+        if (compares) {
+            totalCycles += skipCompares(stringOpcode, isREPZ) * (stringOpcode >= 0xAE ? cycles.SCAS : cycles.CMPS);
+        }
+        
         // Execute the string operation until CX = 0
         while (registers.CX.value != 0) {
-            // Reset IP to the string operation
-            registers.IP = savedIP;
-            
             // Execute the string operation and accumulate cycles
             totalCycles += decodeAndExecute(stringOpcode);
             
@@ -1606,13 +1863,15 @@ namespace CPU {
             registers.CX.value--;
             
             // For REPZ/REPE, continue if ZF=1; for REPNZ/REPNE, continue if ZF=0
-            if (isREPZ) {
-                if (!flags.getFlag(FLAGS::ZF)) {
-                    break;
-                }
-            } else {
-                if (flags.getFlag(FLAGS::ZF)) {
-                    break;
+            if (compares) {
+                if (isREPZ) {
+                    if (!flags.getFlag(FLAGS::ZF)) {
+                        break;
+                    }
+                } else {
+                    if (flags.getFlag(FLAGS::ZF)) {
+                        break;
+                    }
                 }
             }
             
@@ -1625,22 +1884,117 @@ namespace CPU {
         return totalCycles;
     }
 
+    // REP MOVS/STOS moving upwards through memory, with neither offset
+    // wrapping in its segment, become a single host copy or fill. Returns
+    // false, having done nothing, if the operation has to be stepped an
+    // element at a time.
+    bool Instructions::repeatBlock(uint8_t stringOpcode) {
+        if ((stringOpcode & 0xFC) != 0xA4 && (stringOpcode & 0xFE) != 0xAA) {
+            return false;  // Not MOVS or STOS
+        }
+        if (flags.getFlag(FLAGS::DF)) {
+            return false;
+        }
+        uint32_t size = static_cast<uint32_t>(registers.CX.value) << (stringOpcode & 1);
+        if (registers.DI + size > 0x10000) {
+            return false;
+        }
+        uint32_t destination = memory.calculatePhysicalAddress(registers.ES, registers.DI);
+
+        if (stringOpcode >= 0xAA) {
+            uint16_t pattern = (stringOpcode & 1) ? registers.AX.value : registers.AX.low * 0x101;
+            if (!memory.fillBlock(destination, size, pattern)) {
+                return false;
+            }
+        } else {
+            if (registers.SI + size > 0x10000) {
+                return false;
+            }
+            uint32_t source = memory.calculatePhysicalAddress(registers.DS, registers.SI);
+            if (!memory.copyBlock(destination, source, size)) {
+                return false;
+            }
+            registers.SI += size;
+        }
+        registers.DI += size;
+        registers.CX.value = 0;
+        return true;
+    }
+
+    // Moves SI, DI and CX past the elements of a REPE/REPNE CMPS/SCAS that
+    // don't stop it, found a vector at a time, and returns how many that
+    // was. At least the last element is left for the caller to step, and
+    // with it go all the flags the comparison sets, as the skipped
+    // elements' are overwritten anyway. Only done moving upwards, and only
+    // as far as the offsets go without wrapping in their segments.
+    uint16_t Instructions::skipCompares(uint8_t stringOpcode, bool isREPZ) {
+        if (flags.getFlag(FLAGS::DF) || registers.CX.value == 0) {
+            return 0;
+        }
+        bool isWord = stringOpcode & 1;
+        bool isCMPS = stringOpcode < 0xAE;
+        uint32_t count = std::min<uint32_t>(registers.CX.value, (0x10000 - registers.DI) >> isWord);
+        if (isCMPS) {
+            count = std::min<uint32_t>(count, (0x10000 - registers.SI) >> isWord);
+        }
+        uint32_t size = count << isWord;
+        uint32_t destination = memory.calculatePhysicalAddress(registers.ES, registers.DI);
+        uint32_t source = memory.calculatePhysicalAddress(registers.DS, registers.SI);
+
+        // REPZ stops at the first element that differs, REPNZ at the first
+        // that is equal
+        auto find = [&](uint32_t from, uint32_t &offset) {
+            bool scanned = isCMPS
+                ? memory.compareBlock(destination + from, source + from, size - from, !isREPZ, offset)
+                : memory.scanBlock(destination + from, size - from, isWord ? registers.AX.value : registers.AX.low * 0x101, !isREPZ, offset);
+            offset += from;
+            return scanned;
+        };
+        uint32_t offset;
+        if (!find(0, offset)) {
+            return 0;
+        }
+        if (isWord && !isREPZ) {
+            // A word is only equal if both its bytes are
+            while (offset < size) {
+                if (offset & 1) {
+                    find(offset + 1, offset);  // Its low byte differed
+                } else if (offset + 1 < size &&
+                           memory.readByte(destination + offset + 1) ==
+                           (isCMPS ? memory.readByte(source + offset + 1) : registers.AX.high)) {
+                    break;
+                } else {
+                    find(offset + 2, offset);
+                }
+            }
+        }
+
+        uint16_t skipped = static_cast<uint16_t>(std::min<uint32_t>(offset >> isWord, registers.CX.value - 1));
+        uint16_t bytes = static_cast<uint16_t>(skipped << isWord);
+        registers.DI += bytes;
+        if (isCMPS) {
+            registers.SI += bytes;
+        }
+        registers.CX.value -= skipped;
+        return skipped;
+    }
+
     //--------------------------------------------------------------------------
     // I/O operations
     //--------------------------------------------------------------------------
     uint32_t Instructions::handleIN() {
-        uint8_t opcode = memory.readByte(memory.calculatePhysicalAddress(registers.CS, registers.IP - 1));
+        uint8_t opcode = currentOpcode;
         uint32_t cycles_count = 0;
         
         if (opcode == 0xE4) {
             // IN AL, imm8
-            uint8_t port = fetchByte();
+            uint8_t port = static_cast<uint8_t>(insn->imm);
             registers.AX.low = io.readPort(port);
             cycles_count = 10; // Typical IN AL, port cycles
         }
         else if (opcode == 0xE5) {
             // IN AX, imm8
-            uint8_t port = fetchByte();
+            uint8_t port = static_cast<uint8_t>(insn->imm);
             registers.AX.value = io.readPortWord(port);
             cycles_count = 14; // Typical IN AX, port cycles
         }
@@ -1660,12 +2014,12 @@ namespace CPU {
 
     uint32_t Instructions::handleOUT() {
         // Get the opcode to determine the operation type
-        uint8_t lastOpcode = memory.readByte(memory.calculatePhysicalAddress(registers.CS, registers.IP - 1));
+        uint8_t lastOpcode = currentOpcode;
         uint32_t cycleCount = 0;
         
         if (lastOpcode == 0xE6) {  // OUT imm8, AL
             // Read port address from the instruction stream
-            uint8_t port = fetchByte();
+            uint8_t port = static_cast<uint8_t>(insn->imm);
             
             // Write AL to the I/O port
             io.writePort(port, registers.AX.low);
@@ -1673,7 +2027,7 @@ namespace CPU {
         }
         else if (lastOpcode == 0xE7) {  // OUT imm8, AX
             // Read port address from the instruction stream
-            uint8_t port = fetchByte();
+            uint8_t port = static_cast<uint8_t>(insn->imm);
             
             // Write AX to the I/O port
             io.writePortWord(port, registers.AX.value);
@@ -1681,214 +2035,19 @@ namespace CPU {
         }
         else if (lastOpcode == 0xEE) {  // OUT DX, AL
             // Port address is in DX register
-            uint16_t port = registers.DX.value;
-            
-            // Write AL to the I/O port
-            io.writePort(port, registers.AX.low);
-            cycleCount = 8; // Approximate cycles
-        }
-        else if (lastOpcode == 0xEF) {  // OUT DX, AX
-            // Port address is in DX register
-            uint16_t port = registers.DX.value;
-            
-            // Write AX to the I/O port
-            io.writePortWord(port, registers.AX.value);
-            cycleCount = 12; // Approximate cycles
-        }
-        
-        return cycleCount;
-    }
-
-    uint32_t Instructions::handleADD8() {
-        uint8_t modrm = fetchByte();
-        uint8_t mod = (modrm >> 6) & 0x03;
-        uint8_t reg = (modrm >> 3) & 0x07;
-        uint8_t rm = modrm & 0x07;
-        
-        uint8_t lastOpcode = memory.readByte(memory.calculatePhysicalAddress(registers.CS, registers.IP - 2));
-        bool direction = (lastOpcode & 0x02) != 0; // 0x00 or 0x02
-        uint32_t cycleCount = 0;
-        
-        if (direction) {
-            // ADD r8, r/m8 (0x02)
-            uint8_t* destReg = get8BitRegisterRef(reg);
-            
-            if (mod == 0b11) {
-                // Register to register
-                uint8_t* srcReg = get8BitRegisterRef(rm);
-                uint16_t result = *destReg + *srcReg;
-                setArithmeticFlags8(result, *destReg, *srcReg);
-                *destReg = static_cast<uint8_t>(result);
-                cycleCount = cycles.ALU_REG_REG;
-            } else {
-                // Memory to register
-                uint32_t addr = getEffectiveAddress(mod, rm);
-                uint8_t value = memory.readByte(addr);
-                uint16_t result = *destReg + value;
-                setArithmeticFlags8(result, *destReg, value);
-                *destReg = static_cast<uint8_t>(result);
-                cycleCount = cycles.ALU_MEM_REG;
-            }
-        } else {
-            // ADD r/m8, r8 (0x00)
-            uint8_t* srcReg = get8BitRegisterRef(reg);
-            
-            if (mod == 0b11) {
-                // Register to register
-                uint8_t* destReg = get8BitRegisterRef(rm);
-                uint16_t result = *destReg + *srcReg;
-                setArithmeticFlags8(result, *destReg, *srcReg);
-                *destReg = static_cast<uint8_t>(result);
-                cycleCount = cycles.ALU_REG_REG;
-            } else {
-                // Register to memory
-                uint32_t addr = getEffectiveAddress(mod, rm);
-                uint8_t value = memory.readByte(addr);
-                uint16_t result = value + *srcReg;
-                setArithmeticFlags8(result, value, *srcReg);
-                memory.writeByte(addr, static_cast<uint8_t>(result));
-                cycleCount = cycles.ALU_REG_MEM;
-            }
-        }
-        
-        return cycleCount;
-    }
-
-    uint32_t Instructions::handleADDImm8() {
-        // ADD AL, imm8 (0x04)
-        uint8_t imm8 = fetchByte();
-        uint8_t al = registers.AX.low;
-        uint16_t result = al + imm8;
-        
-        setArithmeticFlags8(result, al, imm8);
-        registers.AX.low = static_cast<uint8_t>(result);
-        
-        return cycles.ALU_IMM_REG;
-    }
-
-    uint32_t Instructions::handleADDImm16() {
-        // ADD AX, imm16 (0x05)
-        uint16_t imm16 = fetchWord();
-        uint16_t ax = registers.AX.value;
-        uint32_t result = ax + imm16;
-        
-        setArithmeticFlags(result, ax, imm16);
-        registers.AX.value = static_cast<uint16_t>(result);
-        
-        return cycles.ALU_IMM_REG;
-    }
-
-    uint32_t Instructions::handleADC8() {
-        uint8_t opcode = memory.readByte(memory.calculatePhysicalAddress(registers.CS, registers.IP - 1));
-        uint32_t cycleCount = 0;
-        
-        if (opcode == 0x10) {
-            // ADC r/m8, r8
-            uint8_t modrm = fetchByte();
-            uint8_t mod = (modrm >> 6) & 0x03;
-            uint8_t reg = (modrm >> 3) & 0x07;
-            uint8_t rm = modrm & 0x07;
-            
-            uint8_t* dest;
-            uint8_t src = *get8BitRegisterRef(reg);
-            bool carry = flags.getFlag(FLAGS::CF);
-            
-            if (mod == 0b11) {
-                // Register destination
-                dest = get8BitRegisterRef(rm);
-                uint16_t result = *dest + src + carry;
-                setArithmeticFlags8(result, *dest, src);
-                *dest = result & 0xFF;
-                cycleCount = cycles.ALU_REG_REG;
-            } else {
-                // Memory destination
-                uint32_t addr = getEffectiveAddress(mod, rm);
-                uint8_t destValue = memory.readByte(addr);
-                uint16_t result = destValue + src + carry;
-                setArithmeticFlags8(result, destValue, src);
-                memory.writeByte(addr, result & 0xFF);
-                cycleCount = cycles.ALU_REG_MEM;
-            }
-        } else if (opcode == 0x12) {
-            // ADC r8, r/m8
-            uint8_t modrm = fetchByte();
-            uint8_t mod = (modrm >> 6) & 0x03;
-            uint8_t reg = (modrm >> 3) & 0x07;
-            uint8_t rm = modrm & 0x07;
-            
-            uint8_t* dest = get8BitRegisterRef(reg);
-            uint8_t src;
-            bool carry = flags.getFlag(FLAGS::CF);
-            
-            if (mod == 0b11) {
-                // Register source
-                src = *get8BitRegisterRef(rm);
-                cycleCount = cycles.ALU_REG_REG;
-            } else {
-                // Memory source
-                uint32_t addr = getEffectiveAddress(mod, rm);
-                src = memory.readByte(addr);
-                cycleCount = cycles.ALU_MEM_REG;
-            }
-            
-            uint16_t result = *dest + src + carry;
-            setArithmeticFlags8(result, *dest, src);
-            *dest = result & 0xFF;
-        }
-        
-        return cycleCount; // Return the cycle count
-    }
-
-    uint32_t Instructions::handleSBB8() {
-        uint8_t modrm = fetchByte();
-        uint8_t mod = (modrm >> 6) & 0x03;
-        uint8_t reg = (modrm >> 3) & 0x07;
-        uint8_t rm = modrm & 0x07;
-        
-        uint8_t lastOpcode = memory.readByte(memory.calculatePhysicalAddress(registers.CS, registers.IP - 2));
-        bool direction = (lastOpcode & 0x02) != 0; // 0x18 or 0x1A
-        uint32_t cycleCount = 0;
-        
-        if (direction) {
-            // SBB r8, r/m8 (0x1A)
-            uint8_t* destReg = get8BitRegisterRef(reg);
+            uint16_t port = registers.DX.value;
             
-            if (mod == 0b11) {
-                // Register to register
-                uint8_t* srcReg = get8BitRegisterRef(rm);
-                uint16_t result = *destReg - *srcReg - static_cast<uint8_t>(flags.getFlag(FLAGS::CF));
-                setArithmeticFlags8(result, *destReg, *srcReg);
-                *destReg = static_cast<uint8_t>(result);
-                cycleCount = cycles.ALU_REG_REG;
-            } else {
-                // Memory to register
-                uint32_t addr = getEffectiveAddress(mod, rm);
-                uint8_t value = memory.readByte(addr);
-                uint16_t result = *destReg - value - static_cast<uint8_t>(flags.getFlag(FLAGS::CF));
-                setArithmeticFlags8(result, *destReg, value);
-                *destReg = static_cast<uint8_t>(result);
-                cycleCount = cycles.ALU_MEM_REG;
-            }
-        } else {
-            // SBB r/m8, r8 (0x18)
-            uint8_t* srcReg = get8BitRegisterRef(reg);
+            // Write AL to the I/O port
+            io.writePort(port, registers.AX.low);
+            cycleCount = 8; // Approximate cycles
+        }
+        else if (lastOpcode == 0xEF) {  // OUT DX, AX
+            // Port address is in DX register
+            uint16_t port = registers.DX.value;
             
-            if (mod == 0b11) {
-                // Register to register
-                uint8_t* destReg = get8BitRegisterRef(rm);
-                uint16_t result = *destReg - *srcReg - static_cast<uint8_t>(flags.getFlag(FLAGS::CF));
-                setArithmeticFlags8(result, *destReg, *srcReg);
-                *destReg = static_cast<uint8_t>(result);
-                cycleCount = cycles.ALU_REG_REG;
-            } else {
-                // Register to memory
-                uint32_t addr = getEffectiveAddress(mod, rm);
-                uint8_t value = memory.readByte(addr);
-                uint16_t result = value - *srcReg - static_cast<uint8_t>(flags.getFlag(FLAGS::CF));
-                setArithmeticFlags8(result, value, *srcReg);
-                memory.writeByte(addr, static_cast<uint8_t>(result));
-                cycleCount = cycles.ALU_REG_MEM;
-            }
+            // Write AX to the I/O port
+            io.writePortWord(port, registers.AX.value);
+            cycleCount = 12; // Approximate cycles
         }
         
         return cycleCount;
@@ -1921,132 +2080,24 @@ namespace CPU {
 
     uint32_t Instructions::handleCLI() {
         flags.setFlag(FLAGS::IF, false);
+        updateAttention();
         return cycles.FLAG_OP;
     }
 
     uint32_t Instructions::handleSTI() {
         flags.setFlag(FLAGS::IF, true);
+        updateAttention();
         return cycles.FLAG_OP;
     }
 
-    uint32_t Instructions::handleADC() {
-        uint8_t modrm = fetchByte();
-        uint8_t mod = (modrm >> 6) & 0x03;
-        uint8_t reg = (modrm >> 3) & 0x07;
-        uint8_t rm = modrm & 0x07;
-        
-        uint8_t lastOpcode = memory.readByte(memory.calculatePhysicalAddress(registers.CS, registers.IP - 2));
-        bool direction = (lastOpcode & 0x02) != 0; // 0x11 or 0x13
-        uint32_t cycleCount = 0;
-        
-        if (direction) {
-            // ADC r16, r/m16 (0x13)
-            uint16_t* destReg = getRegisterReference(reg);
-            
-            if (mod == 0b11) {
-                // Register to register
-                uint16_t* srcReg = getRegisterReference(rm);
-                uint32_t result = *destReg + *srcReg + static_cast<uint16_t>(flags.getFlag(FLAGS::CF));
-                setArithmeticFlags(result, *destReg, *srcReg);
-                *destReg = static_cast<uint16_t>(result);
-                cycleCount = cycles.ALU_REG_REG;
-            } else {
-                // Memory to register
-                uint32_t addr = getEffectiveAddress(mod, rm);
-                uint16_t value = memory.readWord(addr);
-                uint32_t result = *destReg + value + static_cast<uint16_t>(flags.getFlag(FLAGS::CF));
-                setArithmeticFlags(result, *destReg, value);
-                *destReg = static_cast<uint16_t>(result);
-                cycleCount = cycles.ALU_MEM_REG;
-            }
-        } else {
-            // ADC r/m16, r16 (0x11)
-            uint16_t* srcReg = getRegisterReference(reg);
-            
-            if (mod == 0b11) {
-                // Register to register
-                uint16_t* destReg = getRegisterReference(rm);
-                uint32_t result = *destReg + *srcReg + static_cast<uint16_t>(flags.getFlag(FLAGS::CF));
-                setArithmeticFlags(result, *destReg, *srcReg);
-                *destReg = static_cast<uint16_t>(result);
-                cycleCount = cycles.ALU_REG_REG;
-            } else {
-                // Register to memory
-                uint32_t addr = getEffectiveAddress(mod, rm);
-                uint16_t value = memory.readWord(addr);
-                uint32_t result = value + *srcReg + static_cast<uint16_t>(flags.getFlag(FLAGS::CF));
-                setArithmeticFlags(result, value, *srcReg);
-                memory.writeWord(addr, static_cast<uint16_t>(result));
-                cycleCount = cycles.ALU_REG_MEM;
-            }
-        }
-        
-        return cycleCount;
-    }
-
-    uint32_t Instructions::handleSBB() {
-        uint8_t modrm = fetchByte();
-        uint8_t mod = (modrm >> 6) & 0x03;
-        uint8_t reg = (modrm >> 3) & 0x07;
-        uint8_t rm = modrm & 0x07;
-        
-        uint8_t lastOpcode = memory.readByte(memory.calculatePhysicalAddress(registers.CS, registers.IP - 2));
-        bool direction = (lastOpcode & 0x02) != 0; // 0x19 or 0x1B
-        uint32_t cycleCount = 0;
-        
-        if (direction) {
-            // SBB r16, r/m16 (0x1B)
-            uint16_t* destReg = getRegisterReference(reg);
-            
-            if (mod == 0b11) {
-                // Register to register
-                uint16_t* srcReg = getRegisterReference(rm);
-                uint32_t result = *destReg - *srcReg - static_cast<uint16_t>(flags.getFlag(FLAGS::CF));
-                setArithmeticFlags(result, *destReg, *srcReg);
-                *destReg = static_cast<uint16_t>(result);
-                cycleCount = cycles.ALU_REG_REG;
-            } else {
-                // Memory to register
-                uint32_t addr = getEffectiveAddress(mod, rm);
-                uint16_t value = memory.readWord(addr);
-                uint32_t result = *destReg - value - static_cast<uint16_t>(flags.getFlag(FLAGS::CF));
-                setArithmeticFlags(result, *destReg, value);
-                *destReg = static_cast<uint16_t>(result);
-                cycleCount = cycles.ALU_MEM_REG;
-            }
-        } else {
-            // SBB r/m16, r16 (0x19)
-            uint16_t* srcReg = getRegisterReference(reg);
-            
-            if (mod == 0b11) {
-                // Register to register
-                uint16_t* destReg = getRegisterReference(rm);
-                uint32_t result = *destReg - *srcReg - static_cast<uint16_t>(flags.getFlag(FLAGS::CF));
-                setArithmeticFlags(result, *destReg, *srcReg);
-                *destReg = static_cast<uint16_t>(result);
-                cycleCount = cycles.ALU_REG_REG;
-            } else {
-                // Register to memory
-                uint32_t addr = getEffectiveAddress(mod, rm);
-                uint16_t value = memory.readWord(addr);
-                uint32_t result = value - *srcReg - static_cast<uint16_t>(flags.getFlag(FLAGS::CF));
-                setArithmeticFlags(result, value, *srcReg);
-                memory.writeWord(addr, static_cast<uint16_t>(result));
-                cycleCount = cycles.ALU_REG_MEM;
-            }
-        }
-        
-        return cycleCount;
-    }
-
-    uint32_t Instructions::handleROL() {
-        uint8_t modrm = fetchByte();
+    uint32_t Instructions::handleShiftGroup() {
+        uint8_t modrm = insn->modrm;
         uint8_t mod = (modrm >> 6) & 0x03;
         uint8_t op = (modrm >> 3) & 0x07;
         uint8_t rm = modrm & 0x07;
         
         // Get the last opcode to determine operation size and count
-        uint8_t lastOp = memory.readByte(memory.calculatePhysicalAddress(registers.CS, registers.IP - 2));
+        uint8_t lastOp = currentOpcode;
         bool is16Bit = (lastOp == 0xD1 || lastOp == 0xD3);
         bool useCount = (lastOp == 0xD2 || lastOp == 0xD3);
         
@@ -2061,71 +2112,13 @@ namespace CPU {
             return useCount ? cycles.SHIFT_REG_CL : cycles.SHIFT_REG_1;
         }
         
-        uint32_t cycleCount = 0;
-        
-        // Process according to op code (ROL, ROR, RCL, RCR, SHL/SAL, SHR, SAR)
-        switch (op) {
-            case 0: // ROL - Rotate Left
-                if (is16Bit) {
-                    cycleCount = handleROL16(modrm, count, mod, rm);
-                } else {
-                    cycleCount = handleROL8(modrm, count, mod, rm);
-                }
-                break;
-                
-            case 1: // ROR - Rotate Right
-                if (is16Bit) {
-                    cycleCount = handleROR16(modrm, count, mod, rm);
-                } else {
-                    cycleCount = handleROR8(modrm, count, mod, rm);
-                }
-                break;
-                
-            case 2: // RCL - Rotate through Carry Left
-                if (is16Bit) {
-                    cycleCount = handleRCL16(modrm, count, mod, rm);
-                } else {
-                    cycleCount = handleRCL8(modrm, count, mod, rm);
-                }
-                break;
-                
-            case 3: // RCR - Rotate through Carry Right
-                if (is16Bit) {
-                    cycleCount = handleRCR16(modrm, count, mod, rm);
-                } else {
-                    cycleCount = handleRCR8(modrm, count, mod, rm);
-                }
-                break;
-                
-            case 4: // SHL/SAL - Shift Left
-                if (is16Bit) {
-                    cycleCount = handleSAL16(modrm, count, mod, rm);
-                } else {
-                    cycleCount = handleSAL8(modrm, count, mod, rm);
-                }
-                break;
-                
-            case 5: // SHR - Shift Right (logical)
-                if (is16Bit) {
-                    cycleCount = handleSHR16(modrm, count, mod, rm);
-                } else {
-                    cycleCount = handleSHR8(modrm, count, mod, rm);
-                }
-                break;
-                
-            case 7: // SAR - Shift Arithmetic Right
-                if (is16Bit) {
-                    cycleCount = handleSAR16(modrm, count, mod, rm);
-                } else {
-                    cycleCount = handleSAR8(modrm, count, mod, rm);
-                }
-                break;
-                
-            default:
-                throw std::runtime_error("Unknown shift/rotate operation: " + std::to_string(op));
-        }
-        
-        return cycleCount;
+        // Dispatch on the op field (ROL, ROR, RCL, RCR, SHL/SAL, SHR, SAR)
+        ShiftHandler handler = is16Bit ? shiftTable16[op] : shiftTable8[op];
+        return (this->*handler)(modrm, count, mod, rm);
+    }
+
+    uint32_t Instructions::handleShiftUnknown(uint8_t modrm, uint8_t, uint8_t, uint8_t) {
+        throw std::runtime_error("Unknown shift/rotate operation: " + std::to_string((modrm >> 3) & 0x07));
     }
 
     uint32_t Instructions::handleROL8(uint8_t modrm, uint8_t count, uint8_t mod, uint8_t rm) {
@@ -2792,6 +2785,7 @@ namespace CPU {
             uint16_t flag = 1 << i;
             flags.setFlag(flag, (flagsValue & flag) != 0);
         }
+        updateAttention();
         
         // Return cycle count for IRET
         return 32; // IRET typically takes ~32 cycles on 8086
@@ -2823,7 +2817,7 @@ namespace CPU {
                     address = registers.DI;
                     break;
                 case 6: // [disp16] or [BP + disp] if mod != 00
-                    address = fetchWord(); // Direct address
+                    address = insn->disp; // Direct address
                     break;
                 case 7: // [BX]
                     address = registers.BX.value;
@@ -2831,7 +2825,7 @@ namespace CPU {
             }
         } else if (mod == 0b01) {
             // 8-bit displacement
-            int8_t disp8 = static_cast<int8_t>(fetchByte());
+            int8_t disp8 = static_cast<int8_t>(insn->disp);
             
             switch (rm) {
                 case 0: // [BX + SI + disp8]
@@ -2861,7 +2855,7 @@ namespace CPU {
             }
         } else if (mod == 0b10) {
             // 16-bit displacement
-            int16_t disp16 = static_cast<int16_t>(fetchWord());
+            int16_t disp16 = static_cast<int16_t>(insn->disp);
             
             switch (rm) {
                 case 0: // [BX + SI + disp16]
@@ -2896,28 +2890,277 @@ namespace CPU {
         return memory.calculatePhysicalAddress(registers.DS, address);
     }
 
-    // Implementation for handleF6 function (0xF6 group)
+    //--------------------------------------------------------------------------
+    // Group 3: F6 (8-bit) / F7 (16-bit)
+    //--------------------------------------------------------------------------
     uint32_t Instructions::handleF6() {
-        uint8_t modrm = fetchByte();
-        uint8_t mod = (modrm >> 6) & 0x03;
+        uint8_t modrm = insn->modrm;
         uint8_t op = (modrm >> 3) & 0x07;  // This is the specific operation within group F6
+        return (this->*group3Table8[op])(modrm);
+    }
+
+    uint32_t Instructions::handleF7() {
+        uint8_t modrm = insn->modrm;
+        uint8_t op = (modrm >> 3) & 0x07;  // This is the specific operation within group F7
+        return (this->*group3Table16[op])(modrm);
+    }
+
+    uint32_t Instructions::handleTest8(uint8_t modrm) {
+        uint8_t mod = (modrm >> 6) & 0x03;
         uint8_t rm = modrm & 0x07;
+        uint8_t value;
+        
+        if (mod == 0b11) {
+            value = *get8BitRegisterRef(rm);
+        } else {
+            value = memory.readByte(getEffectiveAddress(mod, rm));
+        }
+        uint8_t imm8 = static_cast<uint8_t>(insn->imm);
+        uint8_t result = value & imm8;
+        
+        flags.setFlag(FLAGS::ZF, (result == 0));
+        flags.setFlag(FLAGS::SF, (result & 0x80) != 0);
+        flags.setFlag(FLAGS::OF, false);
+        flags.setFlag(FLAGS::CF, false);
+        flags.setFlag(FLAGS::AF, false);
+        flags.setFlag(FLAGS::PF, utils.calculateParity(result));
+        
+        return (mod == 0b11) ? cycles.TEST_IMM_REG : cycles.TEST_IMM_MEM;
+    }
 
-        // Placeholder implementation to allow build
-        std::cerr << "F6 group operation " << static_cast<int>(op) << " not fully implemented" << std::endl;
-        return 10; // Default cycle count
+    uint32_t Instructions::handleTest16(uint8_t modrm) {
+        uint8_t mod = (modrm >> 6) & 0x03;
+        uint8_t rm = modrm & 0x07;
+        uint16_t value;
+        
+        if (mod == 0b11) {
+            value = *getRegisterReference(rm);
+        } else {
+            value = memory.readWord(getEffectiveAddress(mod, rm));
+        }
+        uint16_t imm16 = insn->imm;
+        uint16_t result = value & imm16;
+        
+        if (liveFlags) {
+            flags.setFlag(FLAGS::ZF, (result == 0));
+            flags.setFlag(FLAGS::SF, (result & 0x8000) != 0);
+            flags.setFlag(FLAGS::OF, false);
+            flags.setFlag(FLAGS::CF, false);
+            flags.setFlag(FLAGS::AF, false);
+            flags.setFlag(FLAGS::PF, utils.calculateParity(result));
+        }
+        
+        return (mod == 0b11) ? cycles.TEST_IMM_REG : cycles.TEST_IMM_MEM;
     }
 
-    // Implementation for handleF7 function (0xF7 group)
-    uint32_t Instructions::handleF7() {
-        uint8_t modrm = fetchByte();
+    uint32_t Instructions::handleNot8(uint8_t modrm) {
         uint8_t mod = (modrm >> 6) & 0x03;
-        uint8_t op = (modrm >> 3) & 0x07;  // This is the specific operation within group F7
         uint8_t rm = modrm & 0x07;
+        
+        // NOT doesn't affect any flags
+        if (mod == 0b11) {
+            uint8_t* dest = get8BitRegisterRef(rm);
+            *dest = ~(*dest);
+            return cycles.ALU_REG_REG;
+        }
+        uint32_t addr = getEffectiveAddress(mod, rm);
+        memory.writeByte(addr, ~memory.readByte(addr));
+        return cycles.ALU_REG_MEM;
+    }
+
+    uint32_t Instructions::handleNot16(uint8_t modrm) {
+        uint8_t mod = (modrm >> 6) & 0x03;
+        uint8_t rm = modrm & 0x07;
+        
+        if (mod == 0b11) {
+            uint16_t* dest = getRegisterReference(rm);
+            *dest = ~(*dest);
+            return cycles.ALU_REG_REG;
+        }
+        uint32_t addr = getEffectiveAddress(mod, rm);
+        memory.writeWord(addr, ~memory.readWord(addr));
+        return cycles.ALU_REG_MEM;
+    }
+
+    uint32_t Instructions::handleNeg8(uint8_t modrm) {
+        uint8_t mod = (modrm >> 6) & 0x03;
+        uint8_t rm = modrm & 0x07;
+        uint32_t addr = 0;
+        uint8_t value;
+        
+        if (mod == 0b11) {
+            value = *get8BitRegisterRef(rm);
+        } else {
+            addr = getEffectiveAddress(mod, rm);
+            value = memory.readByte(addr);
+        }
+        
+        // NEG is 0 - operand, so CF is set unless the operand was zero
+        uint16_t result = static_cast<uint16_t>(0 - value);
+        setArithmeticFlags8(FlagOp::Sub, result, 0, value);
+        
+        if (mod == 0b11) {
+            *get8BitRegisterRef(rm) = static_cast<uint8_t>(result);
+            return cycles.ALU_REG_REG;
+        }
+        memory.writeByte(addr, static_cast<uint8_t>(result));
+        return cycles.ALU_REG_MEM;
+    }
+
+    uint32_t Instructions::handleNeg16(uint8_t modrm) {
+        uint8_t mod = (modrm >> 6) & 0x03;
+        uint8_t rm = modrm & 0x07;
+        uint32_t addr = 0;
+        uint16_t value;
+        
+        if (mod == 0b11) {
+            value = *getRegisterReference(rm);
+        } else {
+            addr = getEffectiveAddress(mod, rm);
+            value = memory.readWord(addr);
+        }
+        
+        uint32_t result = 0u - static_cast<uint32_t>(value);
+        setArithmeticFlags(FlagOp::Sub, result, 0, value);
+        
+        if (mod == 0b11) {
+            *getRegisterReference(rm) = static_cast<uint16_t>(result);
+            return cycles.ALU_REG_REG;
+        }
+        memory.writeWord(addr, static_cast<uint16_t>(result));
+        return cycles.ALU_REG_MEM;
+    }
+
+    uint32_t Instructions::handleMul8(uint8_t modrm) {
+        uint8_t mod = (modrm >> 6) & 0x03;
+        uint8_t rm = modrm & 0x07;
+        uint8_t src = (mod == 0b11) ? *get8BitRegisterRef(rm) : memory.readByte(getEffectiveAddress(mod, rm));
+        
+        // AX = AL * r/m8, CF and OF are set when the upper half is non-zero
+        registers.AX.value = static_cast<uint16_t>(registers.AX.low * src);
+        bool upper = registers.AX.high != 0;
+        flags.setFlag(FLAGS::CF, upper);
+        flags.setFlag(FLAGS::OF, upper);
+        
+        return (mod == 0b11) ? cycles.MUL8_REG : cycles.MUL8_MEM;
+    }
+
+    uint32_t Instructions::handleMul16(uint8_t modrm) {
+        uint8_t mod = (modrm >> 6) & 0x03;
+        uint8_t rm = modrm & 0x07;
+        uint16_t src = (mod == 0b11) ? *getRegisterReference(rm) : memory.readWord(getEffectiveAddress(mod, rm));
+        
+        // DX:AX = AX * r/m16
+        uint32_t result = static_cast<uint32_t>(registers.AX.value) * src;
+        registers.AX.value = static_cast<uint16_t>(result);
+        registers.DX.value = static_cast<uint16_t>(result >> 16);
+        bool upper = registers.DX.value != 0;
+        flags.setFlag(FLAGS::CF, upper);
+        flags.setFlag(FLAGS::OF, upper);
+        
+        return (mod == 0b11) ? cycles.MUL16_REG : cycles.MUL16_MEM;
+    }
+
+    uint32_t Instructions::handleIMul8(uint8_t modrm) {
+        uint8_t mod = (modrm >> 6) & 0x03;
+        uint8_t rm = modrm & 0x07;
+        uint8_t src = (mod == 0b11) ? *get8BitRegisterRef(rm) : memory.readByte(getEffectiveAddress(mod, rm));
+        
+        // AX = AL * r/m8 (signed), CF and OF are set when AH isn't the sign extension of AL
+        int16_t result = static_cast<int16_t>(static_cast<int8_t>(registers.AX.low) * static_cast<int8_t>(src));
+        registers.AX.value = static_cast<uint16_t>(result);
+        bool overflow = result != static_cast<int8_t>(result);
+        flags.setFlag(FLAGS::CF, overflow);
+        flags.setFlag(FLAGS::OF, overflow);
+        
+        return (mod == 0b11) ? cycles.IMUL8_REG : cycles.IMUL8_MEM;
+    }
+
+    uint32_t Instructions::handleIMul16(uint8_t modrm) {
+        uint8_t mod = (modrm >> 6) & 0x03;
+        uint8_t rm = modrm & 0x07;
+        uint16_t src = (mod == 0b11) ? *getRegisterReference(rm) : memory.readWord(getEffectiveAddress(mod, rm));
+        
+        // DX:AX = AX * r/m16 (signed)
+        int32_t result = static_cast<int32_t>(static_cast<int16_t>(registers.AX.value)) * static_cast<int16_t>(src);
+        registers.AX.value = static_cast<uint16_t>(result);
+        registers.DX.value = static_cast<uint16_t>(static_cast<uint32_t>(result) >> 16);
+        bool overflow = result != static_cast<int16_t>(result);
+        flags.setFlag(FLAGS::CF, overflow);
+        flags.setFlag(FLAGS::OF, overflow);
+        
+        return (mod == 0b11) ? cycles.IMUL16_REG : cycles.IMUL16_MEM;
+    }
+
+    uint32_t Instructions::handleDiv8(uint8_t modrm) {
+        uint8_t mod = (modrm >> 6) & 0x03;
+        uint8_t rm = modrm & 0x07;
+        uint8_t src = (mod == 0b11) ? *get8BitRegisterRef(rm) : memory.readByte(getEffectiveAddress(mod, rm));
+        
+        // AL = AX / r/m8, AH = AX % r/m8
+        uint16_t dividend = registers.AX.value;
+        if (src == 0 || (dividend / src) > 0xFF) {
+            throw std::runtime_error("Divide error");
+        }
+        registers.AX.low = static_cast<uint8_t>(dividend / src);
+        registers.AX.high = static_cast<uint8_t>(dividend % src);
+        
+        return (mod == 0b11) ? cycles.DIV8_REG : cycles.DIV8_MEM;
+    }
+
+    uint32_t Instructions::handleDiv16(uint8_t modrm) {
+        uint8_t mod = (modrm >> 6) & 0x03;
+        uint8_t rm = modrm & 0x07;
+        uint16_t src = (mod == 0b11) ? *getRegisterReference(rm) : memory.readWord(getEffectiveAddress(mod, rm));
+        
+        // AX = DX:AX / r/m16, DX = DX:AX % r/m16
+        uint32_t dividend = (static_cast<uint32_t>(registers.DX.value) << 16) | registers.AX.value;
+        if (src == 0 || (dividend / src) > 0xFFFF) {
+            throw std::runtime_error("Divide error");
+        }
+        registers.AX.value = static_cast<uint16_t>(dividend / src);
+        registers.DX.value = static_cast<uint16_t>(dividend % src);
+        
+        return (mod == 0b11) ? cycles.DIV16_REG : cycles.DIV16_MEM;
+    }
+
+    uint32_t Instructions::handleIDiv8(uint8_t modrm) {
+        uint8_t mod = (modrm >> 6) & 0x03;
+        uint8_t rm = modrm & 0x07;
+        int8_t src = static_cast<int8_t>((mod == 0b11) ? *get8BitRegisterRef(rm) : memory.readByte(getEffectiveAddress(mod, rm)));
+        
+        // Quotient must fit in -128..127 (the 8086 rejects -128 itself)
+        int16_t dividend = static_cast<int16_t>(registers.AX.value);
+        if (src == 0) {
+            throw std::runtime_error("Divide error");
+        }
+        int16_t quotient = dividend / src;
+        if (quotient > 127 || quotient < -127) {
+            throw std::runtime_error("Divide error");
+        }
+        registers.AX.low = static_cast<uint8_t>(quotient);
+        registers.AX.high = static_cast<uint8_t>(dividend % src);
+        
+        return (mod == 0b11) ? cycles.IDIV8_REG : cycles.IDIV8_MEM;
+    }
 
-        // Placeholder implementation to allow build
-        std::cerr << "F7 group operation " << static_cast<int>(op) << " not fully implemented" << std::endl;
-        return 10; // Default cycle count
+    uint32_t Instructions::handleIDiv16(uint8_t modrm) {
+        uint8_t mod = (modrm >> 6) & 0x03;
+        uint8_t rm = modrm & 0x07;
+        int16_t src = static_cast<int16_t>((mod == 0b11) ? *getRegisterReference(rm) : memory.readWord(getEffectiveAddress(mod, rm)));
+        
+        int32_t dividend = static_cast<int32_t>((static_cast<uint32_t>(registers.DX.value) << 16) | registers.AX.value);
+        if (src == 0) {
+            throw std::runtime_error("Divide error");
+        }
+        int32_t quotient = dividend / src;
+        if (quotient > 32767 || quotient < -32767) {
+            throw std::runtime_error("Divide error");
+        }
+        registers.AX.value = static_cast<uint16_t>(quotient);
+        registers.DX.value = static_cast<uint16_t>(dividend % src);
+        
+        return (mod == 0b11) ? cycles.IDIV16_REG : cycles.IDIV16_MEM;
     }
 
     // Implementation for handleSAL8 function (Shift Arithmetic Left for 8-bit operands)
@@ -3032,89 +3275,4 @@ namespace CPU {
         return (mod == 0b11) ? cycles.SHIFT_REG_CL : cycles.SHIFT_MEM_CL;
     }
 
-    uint32_t Instructions::handleANDImm() {
-        // Handle AND AL, imm8 (24) and AND AX, imm16 (25)
-        uint8_t opcode = memory.readByte(memory.calculatePhysicalAddress(registers.CS, registers.IP - 1));
-        uint32_t cycleCount = cycles.ALU_IMM_REG;
-        
-        if (opcode == 0x24) {
-            // AND AL, imm8
-            uint8_t imm8 = fetchByte();
-            uint8_t al = registers.AX.low;
-            
-            uint8_t result = al & imm8;
-            registers.AX.low = result;  // Update AL register
-            
-            // Set flags
-            flags.setFlag(FLAGS::ZF, (result == 0));
-            flags.setFlag(FLAGS::SF, (result & 0x80) != 0);
-            flags.setFlag(FLAGS::OF, false);
-            flags.setFlag(FLAGS::CF, false);
-            flags.setFlag(FLAGS::AF, false);
-            flags.setFlag(FLAGS::PF, utils.calculateParity(result));
-        } else if (opcode == 0x25) {
-            // AND AX, imm16
-            uint16_t imm16 = fetchWord();
-            uint16_t ax = registers.AX.value;
-            
-            uint32_t result = static_cast<uint32_t>(ax) & static_cast<uint32_t>(imm16);
-            registers.AX.value = result & 0xFFFF;  // Update AX register
-            setArithmeticFlags(result, ax, imm16);
-        }
-        
-        return cycleCount;
-    }
-
-    uint32_t Instructions::handleORImm() {
-        // Handle OR AL, imm8 (0C) and OR AX, imm16 (0D)
-        uint8_t opcode = memory.readByte(memory.calculatePhysicalAddress(registers.CS, registers.IP - 1));
-        uint32_t cycleCount = cycles.ALU_IMM_REG;
-        
-        if (opcode == 0x0C) {
-            // OR AL, imm8
-            uint8_t imm8 = fetchByte();
-            uint8_t al = registers.AX.low;
-            
-            uint16_t result = al | imm8;
-            registers.AX.low = result & 0xFF;  // Update AL register with result
-            setArithmeticFlags8(result, al, imm8);
-        } else if (opcode == 0x0D) {
-            // OR AX, imm16
-            uint16_t imm16 = fetchWord();
-            uint16_t ax = registers.AX.value;
-            
-            uint32_t result = static_cast<uint32_t>(ax) | static_cast<uint32_t>(imm16);
-            registers.AX.value = result & 0xFFFF;  // Update AX register with result
-            setArithmeticFlags(result, ax, imm16);
-        }
-        
-        return cycleCount;
-    }
-
-    uint32_t Instructions::handleXORImm() {
-        // Handle XOR AL, imm8 (34) and XOR AX, imm16 (35)
-        uint8_t opcode = memory.readByte(memory.calculatePhysicalAddress(registers.CS, registers.IP - 1));
-        uint32_t cycleCount = cycles.ALU_IMM_REG;
-        
-        if (opcode == 0x34) {
-            // XOR AL, imm8
-            uint8_t imm8 = fetchByte();
-            uint8_t al = registers.AX.low;
-            
-            uint16_t result = al ^ imm8;
-            registers.AX.low = result & 0xFF;  // Update AL register with result
-            setArithmeticFlags8(result, al, imm8);
-        } else if (opcode == 0x35) {
-            // XOR AX, imm16
-            uint16_t imm16 = fetchWord();
-            uint16_t ax = registers.AX.value;
-            
-            uint32_t result = static_cast<uint32_t>(ax) ^ static_cast<uint32_t>(imm16);
-            registers.AX.value = result & 0xFFFF;  // Update AX register with result
-            setArithmeticFlags(result, ax, imm16);
-        }
-        
-        return cycleCount;
-    }
-
 } // namespace CPU
@@ -1,15 +1,24 @@
 #ifndef INSTRUCTIONS_HPP
 #define INSTRUCTIONS_HPP
 
+#include <array>
 #include <cstdint>
+#include <exception>
 #include <functional>
-#include <unordered_map>
+#include <iostream>
+#include <memory>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include "memory.hpp"
+#include "decoder.hpp"
+#include "jit.hpp"
 #include "registers.hpp"
 #include "flags.hpp"
 #include "../io/io.hpp"
+#include "../io/pic.hpp"
 
 namespace CPU {
 
@@ -20,11 +29,136 @@ namespace CPU {
         // Fetch and execute one instruction at CS:IP - now returns cycle count
         uint32_t executeNext();
 
+        // Execute the basic block at CS:IP (straight-line code up to and
+        // including the next branch, INT or HLT) as a run of pre-bound handler
+        // calls. Cycles and instructions for the block are added to the counters.
+        //
+        // A block that starts at the entry point of a routine with an
+        // intrinsic (see addIntrinsic) runs the intrinsic instead, as far as
+        // it gets before cycleHorizon, the next cycle something may happen
+        // between blocks, or instructionLimit, past which no block may
+        // start.
+        void executeBlock(uint64_t &cycleCount, uint64_t &instructionCount,
+                          uint64_t cycleHorizon, uint64_t instructionLimit);
+        static constexpr size_t MAX_BLOCK_LENGTH = 64;   // Instructions per block
+
+        // Whether the block executeBlock() just ran only worked on registers
+        // and flags and read ports, so that running it again from the same
+        // state does the same thing, as long as the ports read the same.
+        // The CPU uses it to find polling loops.
+        bool ranSpinSafeBlock() const { return lastBlock && lastBlock->spinSafe; }
+
+        // Compile blocks that keep being executed to native code (x86-64 hosts
+        // only; elsewhere executeBlock() keeps running threaded code)
+        void setJitEnabled(bool enabled);
+        bool isJitEnabled() const { return jit != nullptr; }
+
+        // Cycle counts of the instructions the JIT emits inline
+        static JitCycles nativeCycles();
+
+        // Nonzero when something has to happen between instructions: an
+        // interrupt request the CPU can take (INTR with IF set), or a
+        // single-step trap. The execution loop tests only this.
+        static constexpr uint32_t ATTENTION_INTERRUPT = 1 << 0;
+        static constexpr uint32_t ATTENTION_TRAP = 1 << 1;
+        uint32_t getAttention() const { return attention; }
+
+        // INTR from the interrupt controller
+        void setInterruptRequest(bool requesting) {
+            interruptRequest = requesting;
+            updateAttention();
+        }
+
+        // Take what getAttention() asked for: a single-step trap, then a
+        // hardware interrupt, acknowledged with pic. Returns the cycles
+        // spent.
+        uint32_t serviceAttention(IO::PIC &pic);
+
+        // Work attention out again after the flags were set from outside
+        // (a restored snapshot, a debugger). With TF set, the next
+        // instruction traps.
+        void refreshAttention() {
+            trapArmed = flags.getFlag(FLAGS::TF);
+            updateAttention();
+        }
+
         // Check if CPU is halted
         bool isHalted() const { return halted; }
         
         // Reset the halt state (used when resetting the CPU)
-        void resetHaltState() { halted = false; }
+        void resetHaltState() {
+            halted = false;
+            refreshAttention();
+        }
+        void setHaltState(bool value) { halted = value; }
+
+        // Streams behind the BIOS and DOS console services (INT 10h, 16h,
+        // 21h). Without an input stream every key read returns 'A'; once
+        // the input runs out, reads return 0 and INT 16h/01 reports no key.
+        void setConsole(std::istream *input, std::ostream &output) {
+            consoleInput = input;
+            consoleOutput = &output;
+        }
+
+        // Host implementation of a software interrupt, run with the guest's
+        // registers as they are at the INT. Arithmetic flags it leaves set
+        // are handed back to the caller.
+        using ServiceHandler = std::function<void()>;
+
+        // Services are reached the way a real BIOS is: INT n goes through
+        // the IVT to a stub at SERVICE_SEGMENT:n*4 in a ROM page, which is
+        // the reserved opcode SERVICE_TRAP n followed by IRET. The trap
+        // calls the vector's handler; outside its stub it is an unknown
+        // opcode. Guest code can hook a vector like on real hardware, and
+        // chain to the stub it found there.
+        static constexpr uint16_t SERVICE_SEGMENT = 0xF000;
+        static constexpr uint8_t SERVICE_TRAP = 0xF1;
+
+        // Install handler for vector and point the vector at its stub. The
+        // console services (10h, 16h, 21h) are installed from the start.
+        void setService(uint8_t vector, ServiceHandler handler);
+
+        // Point every vector that has a service at its stub again, as a
+        // BIOS does at power-up
+        void installServices();
+
+        // What an intrinsic may spend and has spent. Guest code would have
+        // gone back to the CPU between blocks, where a device event or a
+        // limit can cut in, so a block may only start while less than the
+        // budgets has been spent. The first one always runs.
+        struct IntrinsicRun {
+            uint64_t cycleBudget;
+            uint64_t instructionBudget;
+            uint64_t cycles = 0;        // Spent, filled in by the intrinsic
+            uint64_t instructions = 0;
+
+            bool mayStartBlock(uint64_t spentCycles, uint64_t spentInstructions) const {
+                return spentCycles < cycleBudget && spentInstructions < instructionBudget;
+            }
+        };
+
+        // Host implementation of a guest routine. It leaves registers, flags
+        // and memory as the routine would, IP included, and fills in the
+        // cycles and instructions the routine would have taken. It returns
+        // false without changing anything to have the guest code run
+        // instead: the registers don't meet the routine's contract, or the
+        // work can't be done within the budgets.
+        using IntrinsicHandler = std::function<bool(IntrinsicRun &run)>;
+
+        // A routine is recognized by its code: a block that starts with
+        // pattern is at its entry point
+        struct Intrinsic {
+            std::string name;
+            std::vector<uint8_t> pattern;
+            IntrinsicHandler handler;
+        };
+
+        // Recognize another routine. A copy loop, a checksum loop, a hex
+        // digit conversion and a multiply by 10 are recognized from the
+        // start; clearIntrinsics() drops those too, leaving every routine to
+        // run as guest code.
+        void addIntrinsic(Intrinsic intrinsic);
+        void clearIntrinsics();
 
     private:
         // References to CPU components
@@ -35,6 +169,34 @@ namespace CPU {
 
         bool halted = false;
 
+        uint32_t attention = 0;
+        bool interruptRequest = false;
+        bool trapArmed = false;  // TF was set when the last instruction started
+
+        // Push FLAGS, CS and IP and jump through the interrupt vector table
+        void interrupt(uint8_t vector);
+
+        // After IF or TF may have changed. CLI run inline by the JIT or
+        // Lockstep doesn't come through here, which only leaves an interrupt
+        // bit that serviceAttention() finds IF clear for.
+        void updateAttention() {
+            attention = (interruptRequest && flags.getFlag(FLAGS::IF) ? ATTENTION_INTERRUPT : 0) |
+                        (trapArmed || flags.getFlag(FLAGS::TF) ? ATTENTION_TRAP : 0);
+        }
+
+        std::istream *consoleInput = nullptr;
+        std::ostream *consoleOutput = &std::cout;
+        int peekKey();      // Next key without taking it, -1 if none
+        uint8_t readKey();
+
+        // Handlers by vector, empty where there's no service
+        std::array<ServiceHandler, 256> services;
+
+        void videoService();     // INT 10h
+        void keyboardService();  // INT 16h
+        void dosService();       // INT 21h
+        void pointAtStub(uint8_t vector);  // IVT entry to SERVICE_SEGMENT:vector*4
+
         // Cycle counts for different instruction groups (based on 8086 documentation)
         struct CycleCounts {
             const uint32_t MOV_REG_REG = 2;      // MOV register to register
@@ -70,67 +232,237 @@ namespace CPU {
             
             const uint32_t FLAG_OP = 2;          // Flag operations (CLC, STC, etc.)
             
+            const uint32_t TEST_IMM_REG = 5;     // TEST register, immediate
+            const uint32_t TEST_IMM_MEM = 11;    // TEST memory, immediate
+            const uint32_t MUL8_REG = 70;        // MUL r/m8 (register)
+            const uint32_t MUL8_MEM = 76;        // MUL r/m8 (memory)
+            const uint32_t MUL16_REG = 118;      // MUL r/m16 (register)
+            const uint32_t MUL16_MEM = 124;      // MUL r/m16 (memory)
+            const uint32_t IMUL8_REG = 80;       // IMUL r/m8 (register)
+            const uint32_t IMUL8_MEM = 86;       // IMUL r/m8 (memory)
+            const uint32_t IMUL16_REG = 128;     // IMUL r/m16 (register)
+            const uint32_t IMUL16_MEM = 134;     // IMUL r/m16 (memory)
+            const uint32_t DIV8_REG = 80;        // DIV r/m8 (register)
+            const uint32_t DIV8_MEM = 86;        // DIV r/m8 (memory)
+            const uint32_t DIV16_REG = 144;      // DIV r/m16 (register)
+            const uint32_t DIV16_MEM = 150;      // DIV r/m16 (memory)
+            const uint32_t IDIV8_REG = 101;      // IDIV r/m8 (register)
+            const uint32_t IDIV8_MEM = 107;      // IDIV r/m8 (memory)
+            const uint32_t IDIV16_REG = 165;     // IDIV r/m16 (register)
+            const uint32_t IDIV16_MEM = 171;     // IDIV r/m16 (memory)
+
+            const uint32_t MOVS = 18;            // MOVS, per element
+            const uint32_t STOS = 11;            // STOS, per element
+            const uint32_t CMPS = 22;            // CMPS, per element
+            const uint32_t SCAS = 15;            // SCAS, per element
+
             const uint32_t INT = 51;             // INT instruction
+            const uint32_t SERVICE = 0;          // Host service trap; the service itself is free
+            const uint32_t INTR = 61;            // Hardware interrupt acknowledge and entry
+            const uint32_t TRAP = 50;            // Single-step trap
             const uint32_t HLT = 2;              // HLT instruction
         } cycles;
 
-        // Opcode table: opcode -> handler function
-        using InstructionHandler = std::function<uint32_t()>;
-        std::unordered_map<uint8_t, InstructionHandler> opcodeTable;
+        // ALU operations of opcodes 00-3D and group 1, in encoding order
+        // (opcode bits 3-5, or the ModR/M reg field for group 1)
+        enum class AluOp : uint8_t { Add, Or, Adc, Sbb, And, Sub, Xor, Cmp };
+
+        // Kind of the operand that isn't the ModR/M reg register: the
+        // register named by r/m (mod 11), memory, or an immediate
+        enum class Operand : uint8_t { Reg, Mem, Imm };
+
+        // Opcode table: opcode -> handler. Built once at compile time and shared
+        // by every instance, so dispatch is a single indexed indirect call.
+        // ModR/M opcodes go through dispatchModRM, which picks the register or
+        // memory specialization from mod when the instruction runs.
+        using InstructionHandler = uint32_t (Instructions::*)();
+        static const std::array<InstructionHandler, 256> opcodeTable;
+        static constexpr std::array<InstructionHandler, 256> buildOpcodeTable();
+
+        // The same ModR/M opcodes specialized for one r/m kind, nullptr for
+        // the rest. Blocks bind these directly (see selectHandler).
+        static const std::array<InstructionHandler, 256> registerFormTable;
+        static const std::array<InstructionHandler, 256> memoryFormTable;
+        static constexpr std::array<InstructionHandler, 256> buildFormTable(Operand kind);
+
+        // Fill in the six opcodes of one ALU operation: the run-time
+        // dispatching entries, or the forms for one r/m kind
+        template<AluOp Op>
+        static constexpr void setALUHandlers(std::array<InstructionHandler, 256> &t);
+        template<AluOp Op>
+        static constexpr void setALUForms(std::array<InstructionHandler, 256> &t, Operand kind);
+        template<AluOp Op>
+        static constexpr void setGroup1Handlers(std::array<InstructionHandler, 32> &t);
+
+        // Second-level tables for group opcodes, indexed by the ModR/M reg field.
+        // group1Table is indexed by w bit, memory operand and reg field.
+        using ShiftHandler = uint32_t (Instructions::*)(uint8_t modrm, uint8_t count, uint8_t mod, uint8_t rm);
+        using Group3Handler = uint32_t (Instructions::*)(uint8_t modrm);
+        static const std::array<ShiftHandler, 8> shiftTable8;
+        static const std::array<ShiftHandler, 8> shiftTable16;
+        static const std::array<Group3Handler, 8> group3Table8;
+        static const std::array<Group3Handler, 8> group3Table16;
+        static const std::array<InstructionHandler, 32> group1Table;
+        static constexpr std::array<InstructionHandler, 32> buildGroup1Table();
+        static size_t group1Index(const DecodedInstruction &insn);
+
+        // Handler to bind for a decoded instruction: the specialization for
+        // its r/m kind (and group 1 operation) where there is one
+        static InstructionHandler selectHandler(const DecodedInstruction &insn);
+
+        // Predecoded instruction cache and the instruction being executed.
+        // currentOpcode differs from insn->opcode while a REP prefix runs its
+        // string operation.
+        Decoder decoder;
+        const DecodedInstruction* insn = nullptr;
+        uint8_t currentOpcode = 0;
 
         //----------------------------------------------------------------------
-        // Internal helper methods
+        // Threaded-code block cache
         //----------------------------------------------------------------------
-        // Fetch next byte or word from memory and advance IP
-        uint8_t  fetchByte();
-        uint16_t fetchWord();
+        static constexpr size_t MAX_BLOCKS = 16384;      // Cache is flushed past this
+        static constexpr uint32_t JIT_THRESHOLD = 16;    // Executions before a block is compiled
+
+        struct ThreadedOp {
+            InstructionHandler handler;
+            DecodedInstruction insn;
+            uint16_t liveFlags;  // Flags this instruction writes that are read before being overwritten
+            InstructionHandler run = nullptr;  // What the block calls: handler, or a superinstruction
+            uint8_t span = 1;                  // Instructions run covers, starting with this one
+        };
+
+        struct Block {
+            uint32_t key = 0;                    // CS:IP the block starts at
+            uint32_t firstPage = 0;              // First code page the block covers
+            std::vector<uint32_t> pageVersions;  // Versions of the covered pages when built
+            std::vector<ThreadedOp> ops;
+            Block* successors[2] = {nullptr, nullptr};  // Chained exits, most recent first
+            uint32_t executionCount = 0;         // Runs so far, up to JIT_THRESHOLD
+            JitBlockFn native = nullptr;         // Compiled code, if any
+            bool spinSafe = false;               // Touches nothing but registers, flags and port reads
+            const Intrinsic *intrinsic = nullptr;  // Routine the block is the entry point of
+        };
+
+        std::unordered_map<uint32_t, Block> blocks;
+        Block* lastBlock = nullptr;
+
+        Block* lookupBlock();
+        void buildBlock(Block &block);
+        void flushBlocks();
+        bool isBlockCurrent(const Block &block) const;
+        static bool endsBlock(uint8_t opcode);
+        static bool getFlagUsage(const DecodedInstruction &insn, uint16_t &reads, uint16_t &writes);
+        static bool isSpinSafe(const DecodedInstruction &insn);
+
+        // Intrinsics, in the order they are tried
+        std::vector<Intrinsic> intrinsics;
+
+        // Intrinsic whose pattern is the code at ip, physical address start,
+        // nullptr if none
+        const Intrinsic* matchIntrinsic(uint16_t ip, uint32_t start) const;
+        bool runIntrinsic(Block &block, uint64_t &cycleCount, uint64_t &instructionCount,
+                          uint64_t cycleHorizon, uint64_t instructionLimit);
 
-        // Decode the opcode from memory, look up and call the handler
+        // Built-in intrinsics, in the encodings the decoder runs (JNE and
+        // JLE take a 16-bit displacement)
+        void addBuiltinIntrinsics();
+        bool copyLoop(IntrinsicRun &run);      // MOV AL,[SI]; MOV [DI],AL; INC SI; INC DI; DEC CX; JNE
+        bool checksumLoop(IntrinsicRun &run);  // ADD AL,[SI]; ADC AH,0; INC SI; DEC CX; JNE
+        bool hexDigit(IntrinsicRun &run);      // AND AL,0Fh; ADD AL,'0'; CMP AL,'9'; JLE +2; ADD AL,7; RET
+        bool timesTen(IntrinsicRun &run);      // MOV BX,AX; SHL AX,1; SHL AX,1; ADD AX,BX; SHL AX,1; RET
+
+        // Superinstructions: short runs that dominate guest loops (compare,
+        // INC or DEC then a conditional jump; INC, compare, jump; MOV reg,
+        // [mem] then ALU) bound to one handler that calls each instruction's
+        // handler directly, so the block dispatches once for the run. Cycles
+        // and flags are those of the separate instructions. Only the first
+        // instruction of a run can throw and none writes memory, so a run
+        // never stops half way.
+        static constexpr size_t FUSED_BRANCHES = 6;
+        template<InstructionHandler First, InstructionHandler... Rest>
+        uint32_t handleFused();
+        static constexpr std::array<InstructionHandler, 10> fusedFlagSetters();
+        static constexpr std::array<InstructionHandler, FUSED_BRANCHES> fusedBranches();
+        static constexpr std::array<InstructionHandler, 2> fusedLoads();
+        static constexpr std::array<InstructionHandler, 48> fusedLoadUsers();
+        template<AluOp Op, bool Word>
+        static constexpr std::array<InstructionHandler, 3> aluRegisterForms();
+        template<size_t... I>
+        static constexpr std::array<InstructionHandler, sizeof...(I)> buildLoadUsers(std::index_sequence<I...>);
+        template<size_t... I>
+        static constexpr std::array<InstructionHandler, sizeof...(I)> buildSetBranchTable(std::index_sequence<I...>);
+        template<size_t... I>
+        static constexpr std::array<InstructionHandler, sizeof...(I)> buildIncCompareBranchTable(std::index_sequence<I...>);
+        template<size_t... I>
+        static constexpr std::array<InstructionHandler, sizeof...(I)> buildLoadUseTable(std::index_sequence<I...>);
+        static const std::array<InstructionHandler, 10 * FUSED_BRANCHES> setBranchTable;
+        static const std::array<InstructionHandler, 8 * FUSED_BRANCHES> incCompareBranchTable;
+        static const std::array<InstructionHandler, 48> loadUseTable;
+
+        // Superinstruction for the run starting at ops (count of them left
+        // in the block), nullptr if there's none; span gets its length
+        static InstructionHandler fuse(const ThreadedOp *ops, size_t count, uint8_t &span);
+        const ThreadedOp *fusedOp = nullptr;  // Op of the instruction a superinstruction is on
+
+        // Arithmetic flags the running instruction has to produce. Handlers
+        // skip their flag work when it is zero; only blocks lower it.
+        uint16_t liveFlags = ARITHMETIC_FLAGS;
+
+        // Native code for hot blocks. Handlers called from compiled code can't
+        // throw through it, so their exception is parked in jitError and
+        // rethrown once the block has returned.
+        std::unique_ptr<Jit> jit;
+        std::exception_ptr jitError;
+
+        void compileBlock(Block &block);
+        void runCompiledBlock(Block &block, uint64_t &cycleCount, uint64_t &instructionCount);
+        uint32_t runJitOp(JitContext &ctx, uint32_t index);
+        static uint32_t jitHelper(JitContext *ctx, uint32_t index);
+        static void jitFlagsHelper(JitContext *ctx);
+        static bool isIOOpcode(uint8_t opcode);
+
+        //----------------------------------------------------------------------
+        // Internal helper methods
+        //----------------------------------------------------------------------
+        // Look up and call the handler for an opcode
         uint32_t decodeAndExecute(uint8_t opcode);
 
         // Return pointer to a 16-bit register based on reg index
         uint16_t* getRegisterReference(uint8_t reg);
 
-        // Return pointer into memory for the given addressing mode
-        // (mod r/m) from an x86 ModR/M byte
-        uint16_t* getMemoryReference(uint8_t mod, uint8_t rm);
-
         // Flag-setting helpers
         // For arithmetic ops (ADD, SUB, etc.)
-        void setArithmeticFlags(uint32_t result, uint16_t dest, uint16_t src);
+        void setArithmeticFlags(FlagOp op, uint32_t result, uint16_t dest, uint16_t src);
 
         //----------------------------------------------------------------------
         // Instruction handlers - now return cycle counts
         //----------------------------------------------------------------------
-        // Move
+        // Run RegisterForm when the ModR/M operand is a register, else MemoryForm
+        template<InstructionHandler RegisterForm, InstructionHandler MemoryForm>
+        uint32_t dispatchModRM();
+
+        // Move (88-8B). ToReg is the d bit: reg <- r/m rather than r/m <- reg.
+        template<bool Word, bool ToReg, Operand Kind>
         uint32_t handleMOV();
         
         // MOV register, immediate (B0-BF)
+        template<bool Word>
         uint32_t handleMOVRegImm();
         
-        // Arithmetic
-        uint32_t handleADD();
-        uint32_t handleADD8();
-        uint32_t handleADDImm8();
-        uint32_t handleADDImm16();
-        uint32_t handleSUB();
-        uint32_t handleADC();  // Add with Carry
-        uint32_t handleADC8(); // Add with Carry (8-bit)
-        uint32_t handleSBB();  // Subtract with Borrow
-        uint32_t handleSBB8(); // Subtract with Borrow (8-bit)
-        uint32_t handleCMP();
-        uint32_t handleCMPImm();
+        // Arithmetic and logic: ADD, OR, ADC, SBB, AND, SUB, XOR, CMP.
+        // handleALU covers the r/m <-> reg forms and, with Operand::Imm,
+        // AL/AX, imm; handleALUImm is group 1 (r/m, imm). Both share alu().
+        template<AluOp Op, bool Word, bool ToReg, Operand Kind>
+        uint32_t handleALU();
+        template<AluOp Op, bool Word, Operand Kind>
+        uint32_t handleALUImm();
+        template<AluOp Op, bool Word>
+        uint16_t alu(uint16_t dest, uint16_t src);
         uint32_t handleGroup1();
         uint32_t handleINC();
         uint32_t handleDEC();
 
         // Logical
-        uint32_t handleAND();
-        uint32_t handleANDImm();
-        uint32_t handleOR();
-        uint32_t handleORImm();
-        uint32_t handleXOR();
-        uint32_t handleXORImm();
         uint32_t handleNOT();
 
         // String operations
@@ -140,11 +472,13 @@ namespace CPU {
         uint32_t handleLODS();  // Load string
         uint32_t handleSCAS();  // Scan string
         uint32_t handleREP();   // Repeat prefix
+        bool repeatBlock(uint8_t stringOpcode);  // REP MOVS/STOS as one block move
+        uint16_t skipCompares(uint8_t stringOpcode, bool isREPZ);  // REPE/REPNE CMPS/SCAS up to where they stop
 
         // Shift/Rotate
         uint32_t handleSHL();
         uint32_t handleSHR();
-        uint32_t handleROL();  // Rotate Left
+        uint32_t handleShiftGroup(); // D0-D3 (ROL, ROR, RCL, RCR, SHL/SAL, SHR, SAR)
         uint32_t handleROR();  // Rotate Right
         uint32_t handleRCL();  // Rotate through Carry Left
         uint32_t handleRCR();  // Rotate through Carry Right
@@ -179,6 +513,10 @@ namespace CPU {
         // Interrupt / Halt
         uint32_t handleINT();
         uint32_t handleHLT();
+        uint32_t handleServiceTrap();
+
+        // Slot for opcodes that have no handler
+        uint32_t handleUnknown();
 
         // I/O operations
         uint32_t handleIN();    // Input from port
@@ -211,7 +549,13 @@ namespace CPU {
         // Helper methods
         uint32_t getEffectiveAddress(uint8_t mod, uint8_t rm);
         uint8_t* get8BitRegisterRef(uint8_t reg);
-        void setArithmeticFlags8(uint16_t result, uint8_t dest, uint8_t src);
+
+        // Byte or word register and memory access
+        template<bool Word> uint16_t readRegister(uint8_t reg);
+        template<bool Word> void writeRegister(uint8_t reg, uint16_t value);
+        template<bool Word> uint16_t readMemory(uint32_t addr);
+        template<bool Word> void writeMemory(uint32_t addr, uint16_t value);
+        void setArithmeticFlags8(FlagOp op, uint16_t result, uint8_t dest, uint8_t src);
 
         // Rotate and Shift Helper Methods
         uint32_t handleROL8(uint8_t modrm, uint8_t count, uint8_t mod, uint8_t rm);
@@ -228,6 +572,7 @@ namespace CPU {
         uint32_t handleSHR16(uint8_t modrm, uint8_t count, uint8_t mod, uint8_t rm);
         uint32_t handleSAR8(uint8_t modrm, uint8_t count, uint8_t mod, uint8_t rm);
         uint32_t handleSAR16(uint8_t modrm, uint8_t count, uint8_t mod, uint8_t rm);
+        uint32_t handleShiftUnknown(uint8_t modrm, uint8_t count, uint8_t mod, uint8_t rm);
     };
 
 } 
@@ -0,0 +1,222 @@
+#include "instructions.hpp"
+#include <algorithm>
+#include <limits>
+#include "../utils/utils.h"
+
+namespace CPU {
+
+    static cpu::UTILS utils;
+
+    // Iterations of a loop, each a block of period cycles and length
+    // instructions, that run before the budgets stop the next one from
+    // starting, up to count
+    static uint32_t iterationsWithin(const Instructions::IntrinsicRun &run, uint32_t count,
+                                     uint32_t period, uint32_t length) {
+        uint64_t byCycles = run.cycleBudget ? 1 + (run.cycleBudget - 1) / period : 1;
+        uint64_t byInstructions = run.instructionBudget ? 1 + (run.instructionBudget - 1) / length : 1;
+        return static_cast<uint32_t>(std::min<uint64_t>({count, byCycles, byInstructions}));
+    }
+
+    //--------------------------------------------------------------------------
+    // Registry
+    //--------------------------------------------------------------------------
+    void Instructions::addIntrinsic(Intrinsic intrinsic) {
+        intrinsics.push_back(std::move(intrinsic));
+        // Blocks point into the list, and cached ones may now match
+        flushBlocks();
+    }
+
+    void Instructions::clearIntrinsics() {
+        intrinsics.clear();
+        flushBlocks();
+    }
+
+    const Instructions::Intrinsic* Instructions::matchIntrinsic(uint16_t ip, uint32_t start) const {
+        for (const Intrinsic &intrinsic : intrinsics) {
+            const std::vector<uint8_t> &pattern = intrinsic.pattern;
+            if (pattern.empty() || static_cast<uint32_t>(ip) + pattern.size() > 0x10000) {
+                continue;
+            }
+            size_t i = 0;
+            while (i < pattern.size() && memory.readByte(start + static_cast<uint32_t>(i)) == pattern[i]) {
+                i++;
+            }
+            if (i == pattern.size()) {
+                return &intrinsic;
+            }
+        }
+        return nullptr;
+    }
+
+    bool Instructions::runIntrinsic(Block &block, uint64_t &cycleCount, uint64_t &instructionCount,
+                                    uint64_t cycleHorizon, uint64_t instructionLimit) {
+        // A block may start on the horizon's side of either limit
+        IntrinsicRun run{cycleHorizon > cycleCount ? cycleHorizon - cycleCount : 0,
+                         instructionLimit >= instructionCount
+                             ? std::min(instructionLimit - instructionCount, std::numeric_limits<uint64_t>::max() - 1) + 1
+                             : 0};
+        if (!block.intrinsic->handler(run)) {
+            return false;
+        }
+        cycleCount += run.cycles;
+        instructionCount += run.instructions;
+        lastBlock = &block;
+        return true;
+    }
+
+    //--------------------------------------------------------------------------
+    // Built-in routines
+    //--------------------------------------------------------------------------
+    void Instructions::addBuiltinIntrinsics() {
+        addIntrinsic({"copy loop", {0x8A, 0x04, 0x88, 0x05, 0x46, 0x47, 0x49, 0x75, 0xF6, 0xFF},
+                      [this](IntrinsicRun &run) { return copyLoop(run); }});
+        addIntrinsic({"checksum loop", {0x02, 0x04, 0x80, 0xD4, 0x00, 0x46, 0x49, 0x75, 0xF6, 0xFF},
+                      [this](IntrinsicRun &run) { return checksumLoop(run); }});
+        addIntrinsic({"hex digit", {0x24, 0x0F, 0x04, 0x30, 0x3C, 0x39, 0x7E, 0x02, 0x00, 0x04, 0x07, 0xC3},
+                      [this](IntrinsicRun &run) { return hexDigit(run); }});
+        // MOV BX, AX has two encodings
+        addIntrinsic({"multiply by 10", {0x89, 0xC3, 0xD1, 0xE0, 0xD1, 0xE0, 0x01, 0xD8, 0xD1, 0xE0, 0xC3},
+                      [this](IntrinsicRun &run) { return timesTen(run); }});
+        addIntrinsic({"multiply by 10", {0x8B, 0xD8, 0xD1, 0xE0, 0xD1, 0xE0, 0x01, 0xD8, 0xD1, 0xE0, 0xC3},
+                      [this](IntrinsicRun &run) { return timesTen(run); }});
+    }
+
+    // CX bytes (65536 for 0) from DS:SI to DS:DI, a byte at a time from the
+    // bottom up. The loop is one block per iteration, so it can stop after
+    // any of them and be picked up again.
+    bool Instructions::copyLoop(IntrinsicRun &run) {
+        constexpr uint32_t LENGTH = 6;     // Instructions per iteration
+        constexpr uint32_t CODE_SIZE = 10;
+        uint32_t period = cycles.MOV_MEM_REG + cycles.MOV_REG_MEM + 3 * cycles.INC_REG + cycles.JCOND_TAKEN;
+        uint32_t count = iterationsWithin(run, registers.CX.value ? registers.CX.value : 0x10000, period, LENGTH);
+
+        // Copies that wrap around the segment are left to the loop
+        if (registers.SI + count > 0x10000 || registers.DI + count > 0x10000) {
+            return false;
+        }
+        uint32_t source = memory.calculatePhysicalAddress(registers.DS, registers.SI);
+        uint32_t destination = memory.calculatePhysicalAddress(registers.DS, registers.DI);
+
+        // So are writes to a code page, the loop's own included: the first
+        // ends the block it is in, and a device event can come in between
+        for (uint32_t page = destination >> Memory::CODE_PAGE_SHIFT;
+             page <= (destination + count - 1) >> Memory::CODE_PAGE_SHIFT; page++) {
+            if (memory.isCodePage(page << Memory::CODE_PAGE_SHIFT)) {
+                return false;
+            }
+        }
+
+        uint8_t last = 0;
+        if (memory.copyBlock(destination, source, count)) {
+            last = memory.readByte(memory.calculatePhysicalAddress(registers.DS, registers.DI + count - 1));
+        } else {
+            for (uint32_t i = 0; i < count; i++) {
+                last = memory.readByte(memory.calculatePhysicalAddress(registers.DS, registers.SI + i));
+                memory.writeByte(memory.calculatePhysicalAddress(registers.DS, registers.DI + i), last);
+            }
+        }
+
+        // Flags are those of the last DEC CX; INC and DEC leave CF alone
+        uint16_t counter = static_cast<uint16_t>(registers.CX.value - (count - 1));
+        flags.setResult(FlagOp::Dec, static_cast<uint32_t>(counter) - 1, counter, 1, true);
+        registers.AX.low = last;
+        registers.SI += count;
+        registers.DI += count;
+        registers.CX.value = static_cast<uint16_t>(counter - 1);
+
+        bool done = registers.CX.value == 0;
+        if (done) {
+            registers.IP += CODE_SIZE;
+        }
+        run.cycles = static_cast<uint64_t>(count) * period - (done ? cycles.JCOND_TAKEN - cycles.JCOND_NOT_TAKEN : 0);
+        run.instructions = static_cast<uint64_t>(count) * LENGTH;
+        return true;
+    }
+
+    // Adds CX bytes (65536 for 0) from DS:SI to AX. ADD AL then ADC AH is
+    // a 16-bit add, with CF the carry out of AX on the last byte.
+    bool Instructions::checksumLoop(IntrinsicRun &run) {
+        constexpr uint32_t LENGTH = 5;
+        constexpr uint32_t CODE_SIZE = 10;
+        uint32_t period = cycles.ALU_MEM_REG + cycles.ALU_IMM_REG + 2 * cycles.INC_REG + cycles.JCOND_TAKEN;
+        uint32_t count = iterationsWithin(run, registers.CX.value ? registers.CX.value : 0x10000, period, LENGTH);
+
+        uint16_t sum = registers.AX.value;
+        bool carry = false;
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t total = static_cast<uint32_t>(sum) +
+                             memory.readByte(memory.calculatePhysicalAddress(registers.DS, static_cast<uint16_t>(registers.SI + i)));
+            carry = total > 0xFFFF;
+            sum = static_cast<uint16_t>(total);
+        }
+
+        uint16_t counter = static_cast<uint16_t>(registers.CX.value - (count - 1));
+        flags.setFlag(FLAGS::CF, carry);
+        flags.setResult(FlagOp::Dec, static_cast<uint32_t>(counter) - 1, counter, 1, true);
+        registers.AX.value = sum;
+        registers.SI += count;
+        registers.CX.value = static_cast<uint16_t>(counter - 1);
+
+        bool done = registers.CX.value == 0;
+        if (done) {
+            registers.IP += CODE_SIZE;
+        }
+        run.cycles = static_cast<uint64_t>(count) * period - (done ? cycles.JCOND_TAKEN - cycles.JCOND_NOT_TAKEN : 0);
+        run.instructions = static_cast<uint64_t>(count) * LENGTH;
+        return true;
+    }
+
+    // Low nibble of AL to its ASCII hex digit, then return. The routine is
+    // two blocks, split at the JLE.
+    bool Instructions::hexDigit(IntrinsicRun &run) {
+        uint8_t digit = static_cast<uint8_t>((registers.AX.low & 0x0F) + '0');
+        bool decimal = digit <= '9';
+        uint64_t spent = 3 * cycles.ALU_IMM_REG + (decimal ? cycles.JCOND_TAKEN : cycles.JCOND_NOT_TAKEN);
+        if (!run.mayStartBlock(spent, 4)) {
+            return false;
+        }
+
+        // Flags are those of the CMP, or of the ADD that makes a letter
+        if (decimal) {
+            flags.setResult(FlagOp::Sub, static_cast<uint32_t>(digit) - '9', digit, '9', false);
+        } else {
+            flags.setResult(FlagOp::Add, static_cast<uint32_t>(digit) + 7, digit, 7, false);
+            digit += 7;
+            spent += cycles.ALU_IMM_REG;
+        }
+        registers.AX.low = digit;
+
+        registers.IP = memory.readWord(memory.calculatePhysicalAddress(registers.SS, registers.SP));
+        registers.SP += 2;
+        run.cycles = spent + cycles.RET_NEAR;
+        run.instructions = decimal ? 5 : 6;
+        return true;
+    }
+
+    // AX * 10 as ((AX * 4) + AX) * 2, the original left in BX, then
+    // return. SHL sets its flags outright, so AF is still the ADD's.
+    bool Instructions::timesTen(IntrinsicRun &run) {
+        uint16_t value = registers.AX.value;
+        uint16_t quadruple = static_cast<uint16_t>(value << 2);
+        uint32_t sum = static_cast<uint32_t>(quadruple) + value;
+        uint16_t quintuple = static_cast<uint16_t>(sum);
+        uint16_t result = static_cast<uint16_t>(quintuple << 1);
+
+        flags.setResult(FlagOp::Add, sum, quadruple, value, true);
+        flags.setFlag(FLAGS::CF, (quintuple & 0x8000) != 0);
+        flags.setFlag(FLAGS::OF, ((quintuple ^ result) & 0x8000) != 0);
+        flags.setFlag(FLAGS::ZF, result == 0);
+        flags.setFlag(FLAGS::SF, (result & 0x8000) != 0);
+        flags.setFlag(FLAGS::PF, utils.calculateParity(result));
+        registers.BX.value = value;
+        registers.AX.value = result;
+
+        registers.IP = memory.readWord(memory.calculatePhysicalAddress(registers.SS, registers.SP));
+        registers.SP += 2;
+        // Shifts by 1 cost what the shift handlers charge
+        run.cycles = cycles.MOV_REG_REG + 3 * cycles.SHIFT_REG_CL + cycles.ALU_REG_REG + cycles.RET_NEAR;
+        run.instructions = 6;
+        return true;
+    }
+
+} // namespace CPU
@@ -0,0 +1,476 @@
+#include "jit.hpp"
+#include <cstring>
+#include <initializer_list>
+#include "flags.hpp"
+
+#if defined(__x86_64__) && defined(__unix__)
+#define EMU8086_JIT 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace CPU {
+
+    namespace {
+
+        // Guest register index (AX=0, CX=1, DX=2, BX=3, SP=4, BP=5, SI=6, DI=7)
+        // -> field in Registers. Guest register i lives in host register r8+i.
+        const uint8_t guestRegisterOffsets[8] = {
+            offsetof(Registers, AX), offsetof(Registers, CX),
+            offsetof(Registers, DX), offsetof(Registers, BX),
+            offsetof(Registers, SP), offsetof(Registers, BP),
+            offsetof(Registers, SI), offsetof(Registers, DI),
+        };
+        const uint8_t IP_OFFSET = offsetof(Registers, IP);
+
+        // JitContext fields, addressed off rbp
+        const uint8_t CTX_REGISTERS = offsetof(JitContext, registers);
+        const uint8_t CTX_CYCLES    = offsetof(JitContext, cycles);
+        const uint8_t CTX_EXECUTED  = offsetof(JitContext, executed);
+        const uint8_t CTX_FLAGS     = offsetof(JitContext, flags);
+        const uint8_t CTX_PENDING   = offsetof(JitContext, pending);
+
+
+        // OR/AND/XOR r/m16, r16 and r16, r/m16
+        bool isLogicOpcode(uint8_t opcode) {
+            return opcode == 0x09 || opcode == 0x0B || opcode == 0x21 || opcode == 0x23 ||
+                   opcode == 0x31 || opcode == 0x33;
+        }
+
+        // ADD/SUB/CMP r/m16, r16 and r16, r/m16
+        bool isArithmeticOpcode(uint8_t opcode) {
+            return opcode == 0x01 || opcode == 0x03 || opcode == 0x29 || opcode == 0x2B ||
+                   opcode == 0x39 || opcode == 0x3B;
+        }
+
+        bool isConditionalJump(uint8_t opcode) {
+            switch (opcode) {
+                case 0x74: case 0x75: case 0x77:
+                case 0x7C: case 0x7D: case 0x7E:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        //----------------------------------------------------------------------
+        // Machine code buffer
+        //----------------------------------------------------------------------
+        class Emitter {
+        public:
+            std::vector<uint8_t> code;
+
+            void bytes(std::initializer_list<uint8_t> list) { code.insert(code.end(), list); }
+            void byte(uint8_t value) { code.push_back(value); }
+            void word(uint16_t value) { byte(value & 0xFF); byte(value >> 8); }
+            void dword(uint32_t value) { word(value & 0xFFFF); word(value >> 16); }
+            void qword(uint64_t value) { dword(static_cast<uint32_t>(value)); dword(static_cast<uint32_t>(value >> 32)); }
+
+            // Emit a jump with a rel32 operand and return the position to patch
+            size_t jump(std::initializer_list<uint8_t> opcode) {
+                bytes(opcode);
+                dword(0);
+                return code.size();
+            }
+
+            // Point a jump emitted by jump() at the current position
+            void bind(size_t site) {
+                uint32_t rel = static_cast<uint32_t>(code.size() - site);
+                std::memcpy(&code[site - 4], &rel, sizeof(rel));
+            }
+
+            //------------------------------------------------------------------
+            // Guest state
+            //------------------------------------------------------------------
+            // rax = ctx->registers
+            void loadRegistersPointer() { bytes({0x48, 0x8B, 0x45, CTX_REGISTERS}); }
+
+            void loadGuest() {
+                loadRegistersPointer();
+                for (uint8_t i = 0; i < 8; i++) {
+                    bytes({0x44, 0x0F, 0xB7, static_cast<uint8_t>(0x40 | (i << 3)), guestRegisterOffsets[i]});  // movzx r8d+i, word [rax+off]
+                }
+                bytes({0x0F, 0xB7, 0x5D, CTX_FLAGS});  // movzx ebx, word [rbp+flags]
+            }
+
+            void storeGuest() {
+                loadRegistersPointer();
+                for (uint8_t i = 0; i < 8; i++) {
+                    bytes({0x66, 0x44, 0x89, static_cast<uint8_t>(0x40 | (i << 3)), guestRegisterOffsets[i]});  // mov [rax+off], r8w+i
+                }
+                bytes({0x66, 0x89, 0x5D, CTX_FLAGS});  // mov [rbp+flags], bx
+            }
+
+            // Expects rax = ctx->registers
+            void storeIP(uint16_t ip) {
+                bytes({0x66, 0xC7, 0x40, IP_OFFSET});
+                word(ip);
+            }
+
+            void addCycles(uint32_t count) {
+                if (count) {
+                    bytes({0x81, 0x45, CTX_CYCLES});
+                    dword(count);
+                }
+            }
+
+            void setExecuted(uint32_t count) {
+                bytes({0xC7, 0x45, CTX_EXECUTED});
+                dword(count);
+            }
+
+            //------------------------------------------------------------------
+            // Entry and exit
+            //------------------------------------------------------------------
+            void prologue() {
+                bytes({0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57});  // push rbx, rbp, r12-r15
+                bytes({0x48, 0x83, 0xEC, 0x08});  // sub rsp, 8 (keep the stack 16-byte aligned for calls)
+                bytes({0x48, 0x89, 0xFD});        // mov rbp, rdi
+                loadGuest();
+            }
+
+            void epilogue() {
+                storeGuest();
+                leave();
+            }
+
+            void leave() {
+                bytes({0x48, 0x83, 0xC4, 0x08});  // add rsp, 8
+                bytes({0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B, 0xC3});  // pop r15-r12, rbp, rbx; ret
+            }
+
+            // Leave the block with IP = ip
+            void exitTo(uint16_t ip, uint32_t pendingCycles, uint32_t executed) {
+                addCycles(pendingCycles);
+                setExecuted(executed);
+                storeGuest();
+                storeIP(ip);
+                leave();
+            }
+
+            //------------------------------------------------------------------
+            // 8-bit guest registers. AL..BL are the low bytes of r8..r11,
+            // AH..BH sit in bits 8-15 of the same registers and go through eax.
+            //------------------------------------------------------------------
+            void readByteRegister(uint8_t reg) {
+                uint8_t host = reg & 0x03;
+                bytes({0x44, 0x89, static_cast<uint8_t>(0xC0 | (host << 3))});  // mov eax, r8d+host
+                if (reg >= 4) {
+                    bytes({0xC1, 0xE8, 0x08});  // shr eax, 8
+                }
+            }
+
+            void writeByteRegister(uint8_t reg) {
+                uint8_t host = reg & 0x03;
+                if (reg < 4) {
+                    bytes({0x41, 0x88, static_cast<uint8_t>(0xC0 | host)});  // mov r8b+host, al
+                } else {
+                    bytes({0x0F, 0xB6, 0xC0});  // movzx eax, al
+                    bytes({0xC1, 0xE0, 0x08});  // shl eax, 8
+                    bytes({0x41, 0x81, static_cast<uint8_t>(0xE0 | host)});  // and r8d+host, 0xFFFF00FF
+                    dword(0xFFFF00FF);
+                    bytes({0x41, 0x09, static_cast<uint8_t>(0xC0 | host)});  // or r8d+host, eax
+                }
+            }
+
+            // Bring ebx up to date if the last ALU operation left flags pending.
+            // Only the flags helper is called, so r8-r11 are saved on the stack
+            // rather than written back.
+            void materializeFlags(JitFlagsHelper flagsHelper) {
+                bytes({0x66, 0x83, 0x7D, CTX_PENDING, 0x00});  // cmp word [rbp+pending], 0
+                size_t done = jump({0x0F, 0x84});             // jz done
+                bytes({0x66, 0x89, 0x5D, CTX_FLAGS});          // mov [rbp+flags], bx
+                bytes({0x41, 0x50, 0x41, 0x51, 0x41, 0x52, 0x41, 0x53});  // push r8-r11
+                bytes({0x48, 0x89, 0xEF});                     // mov rdi, rbp
+                bytes({0x48, 0xB8});                           // mov rax, flagsHelper
+                qword(reinterpret_cast<uint64_t>(flagsHelper));
+                bytes({0xFF, 0xD0});                           // call rax
+                bytes({0x41, 0x5B, 0x41, 0x5A, 0x41, 0x59, 0x41, 0x58});  // pop r11-r8
+                bytes({0x0F, 0xB7, 0x5D, CTX_FLAGS});          // movzx ebx, word [rbp+flags]
+                bind(done);
+            }
+
+            // The flags in `mask` have just been written to ebx
+            void clearPending(uint16_t mask) {
+                bytes({0x66, 0x81, 0x65, CTX_PENDING});  // and word [rbp+pending], ~mask
+                word(static_cast<uint16_t>(~mask));
+            }
+
+            // Copy the host's flags after a 16-bit ALU operation or INC/DEC into
+            // ebx; they follow the same rules as the 8086's for these
+            void captureFlags(uint16_t written) {
+                bytes({0x9F});              // lahf
+                bytes({0x0F, 0x90, 0xC0});  // seto al
+                bytes({0x0F, 0xB6, 0xCC});  // movzx ecx, ah
+                bytes({0x81, 0xE1});        // and ecx, written & (SF|ZF|AF|PF|CF)
+                dword(written & ~OF);
+                bytes({0x0F, 0xB6, 0xC0});  // movzx eax, al
+                bytes({0xC1, 0xE0, 0x0B});  // shl eax, 11 (OF)
+                bytes({0x09, 0xC1});        // or ecx, eax
+                bytes({0x81, 0xE3});        // and ebx, ~written
+                dword(~static_cast<uint32_t>(written));
+                bytes({0x09, 0xCB});        // or ebx, ecx
+            }
+
+            // Leave SF != OF in eax (zero when they match)
+            void signOverflowDiffer() {
+                bytes({0x89, 0xD8});        // mov eax, ebx
+                bytes({0xC1, 0xE8, 0x04});  // shr eax, 4 (OF -> bit 7)
+                bytes({0x31, 0xD8});        // xor eax, ebx
+                bytes({0x25});              // and eax, SF
+                dword(SF);
+            }
+        };
+
+        // Inline code for a non-branch native instruction. The flag updates of
+        // ALU instructions are left out when none of them is live.
+        void emitInstruction(Emitter &e, const DecodedInstruction &insn, bool flagsLive) {
+            uint8_t opcode = insn.opcode;
+
+            if (opcode >= 0x88 && opcode <= 0x8B) {
+                bool direction = (opcode & 0x02) != 0;
+                uint8_t dest = direction ? insn.reg : insn.rm;
+                uint8_t src = direction ? insn.rm : insn.reg;
+                if (insn.isWord) {
+                    e.bytes({0x66, 0x45, 0x89, static_cast<uint8_t>(0xC0 | (src << 3) | dest)});  // mov r16, r16
+                } else {
+                    e.readByteRegister(src);
+                    e.writeByteRegister(dest);
+                }
+            } else if (opcode >= 0xB8 && opcode <= 0xBF) {
+                e.bytes({0x66, 0x41, static_cast<uint8_t>(0xB8 | (opcode & 0x07))});  // mov r16, imm16
+                e.word(insn.imm);
+            } else if (opcode >= 0xB0 && opcode <= 0xB7) {
+                e.bytes({0xB0, static_cast<uint8_t>(insn.imm)});  // mov al, imm8
+                e.writeByteRegister(opcode & 0x07);
+            } else if (isArithmeticOpcode(opcode) || isLogicOpcode(opcode)) {
+                // The same operation on the host's r/m16, r16 form
+                bool direction = (opcode & 0x02) != 0;
+                uint8_t dest = direction ? insn.reg : insn.rm;
+                uint8_t src = direction ? insn.rm : insn.reg;
+                uint8_t op = static_cast<uint8_t>((opcode & 0x38) | 0x01);
+                e.bytes({0x66, 0x45, op, static_cast<uint8_t>(0xC0 | (src << 3) | dest)});
+                if (flagsLive) {
+                    e.captureFlags(ARITHMETIC_FLAGS);
+                    if (isLogicOpcode(opcode)) {
+                        e.bytes({0x83, 0xE3, static_cast<uint8_t>(~AF)});  // and ebx, ~AF (undefined on the host)
+                    }
+                }
+            } else if (opcode >= 0x40 && opcode <= 0x4F) {
+                // INC/DEC r16 leave CF alone, on both sides
+                uint8_t op = (opcode < 0x48) ? 0xC0 : 0xC8;
+                e.bytes({0x66, 0x41, 0xFF, static_cast<uint8_t>(op | (opcode & 0x07))});
+                if (flagsLive) {
+                    e.captureFlags(ARITHMETIC_FLAGS & ~CF);
+                }
+            } else {
+                // Flag operations on ebx
+                uint8_t op;
+                uint32_t mask;
+                switch (opcode) {
+                    case 0xF8: op = 0xE3; mask = ~static_cast<uint32_t>(CF); break;  // CLC: and
+                    case 0xF9: op = 0xCB; mask = CF; break;                          // STC: or
+                    case 0xF5: op = 0xF3; mask = CF; break;                          // CMC: xor
+                    case 0xFC: op = 0xE3; mask = ~static_cast<uint32_t>(DF); break;  // CLD
+                    case 0xFD: op = 0xCB; mask = DF; break;                          // STD
+                    default:   op = 0xE3; mask = ~static_cast<uint32_t>(IF); break;  // CLI
+                }
+                e.bytes({0x81, op});
+                e.dword(mask);
+            }
+        }
+
+    } // namespace
+
+    Jit::Jit(JitHelper helper, JitFlagsHelper flagsHelper, const JitCycles &cycles)
+        : helper(helper), flagsHelper(flagsHelper), cycles(cycles) {
+#ifdef EMU8086_JIT
+        // Never writable and executable at once: compile() opens the pages
+        // it writes to for as long as it takes to copy the code in
+        void *memory = mmap(nullptr, BUFFER_SIZE, PROT_READ | PROT_EXEC,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory != MAP_FAILED) {
+            buffer = static_cast<uint8_t*>(memory);
+        }
+#endif
+    }
+
+    Jit::~Jit() {
+#ifdef EMU8086_JIT
+        if (buffer) {
+            munmap(buffer, BUFFER_SIZE);
+        }
+#endif
+    }
+
+    bool Jit::isNative(const DecodedInstruction &insn) {
+        uint8_t opcode = insn.opcode;
+        if ((opcode >= 0x88 && opcode <= 0x8B) || isLogicOpcode(opcode) || isArithmeticOpcode(opcode)) {
+            return insn.mod == 0b11;
+        }
+        switch (opcode) {
+            case 0xF5: case 0xF8: case 0xF9:  // CMC, CLC, STC
+            case 0xFA:                        // CLI (STI runs its handler, which may let an interrupt in)
+            case 0xFC: case 0xFD:             // CLD, STD
+            case 0xE9: case 0xEB:             // JMP
+                return true;
+            default:
+                return (opcode >= 0x40 && opcode <= 0x4F) ||  // INC, DEC
+                       (opcode >= 0xB0 && opcode <= 0xBF) || isConditionalJump(opcode);
+        }
+    }
+
+    JitBlockFn Jit::compile(const std::vector<const DecodedInstruction*> &insns,
+                            const std::vector<uint16_t> &liveFlags, uint16_t ip) {
+        if (!buffer || insns.empty()) {
+            return nullptr;
+        }
+
+        Emitter e;
+        e.prologue();
+
+        // Cycles of inline instructions not yet added to ctx->cycles
+        uint32_t pendingCycles = 0;
+
+        // Whether ctx->pending is known to be zero, so ebx holds every flag
+        bool flagsCurrent = false;
+        uint32_t count = static_cast<uint32_t>(insns.size());
+        bool exited = false;
+
+        for (uint32_t index = 0; index < count; index++) {
+            const DecodedInstruction &insn = *insns[index];
+            uint16_t next = static_cast<uint16_t>(ip + insn.length);
+            bool last = (index + 1 == count);
+
+            if (!isNative(insn)) {
+                // Write the guest state back and let the handler run it
+                e.addCycles(pendingCycles);
+                pendingCycles = 0;
+                flagsCurrent = false;
+                e.storeGuest();
+                e.storeIP(next);
+                e.bytes({0x48, 0x89, 0xEF});  // mov rdi, rbp
+                e.byte(0xBE);                 // mov esi, index
+                e.dword(index);
+                e.bytes({0x48, 0xB8});        // mov rax, helper
+                e.qword(reinterpret_cast<uint64_t>(helper));
+                e.bytes({0xFF, 0xD0});        // call rax
+                e.bytes({0x89, 0xC2});        // mov edx, eax
+                e.loadGuest();
+
+                if (last) {
+                    // The handler has set IP and the helper the instruction count
+                    e.epilogue();
+                    exited = true;
+                } else {
+                    e.bytes({0x85, 0xD2});    // test edx, edx
+                    size_t resume = e.jump({0x0F, 0x84});  // jz resume
+                    e.epilogue();
+                    e.bind(resume);
+                }
+            } else if (insn.opcode == 0xEB || insn.opcode == 0xE9) {
+                int16_t offset = (insn.opcode == 0xEB) ? static_cast<int8_t>(insn.imm) : static_cast<int16_t>(insn.imm);
+                uint32_t jumpCycles = (insn.opcode == 0xEB) ? cycles.jmpShort : cycles.jmpNear;
+                e.exitTo(static_cast<uint16_t>(next + offset), pendingCycles + jumpCycles, index + 1);
+                exited = true;
+            } else if (isConditionalJump(insn.opcode)) {
+                // JE takes a rel8, the others a rel16 (see handleJNE)
+                int16_t offset = (insn.opcode == 0x74) ? static_cast<int8_t>(insn.imm) : static_cast<int16_t>(insn.imm);
+                size_t taken;
+                if (!flagsCurrent) {
+                    e.materializeFlags(flagsHelper);
+                }
+                switch (insn.opcode) {
+                    case 0x74:  // JE: ZF=1
+                    case 0x75:  // JNE: ZF=0
+                        e.bytes({0xF7, 0xC3});  // test ebx, ZF
+                        e.dword(ZF);
+                        taken = e.jump({0x0F, static_cast<uint8_t>(insn.opcode == 0x74 ? 0x85 : 0x84)});
+                        break;
+                    case 0x7C:  // JL: SF!=OF
+                    case 0x7D:  // JGE: SF=OF
+                        e.signOverflowDiffer();
+                        taken = e.jump({0x0F, static_cast<uint8_t>(insn.opcode == 0x7C ? 0x85 : 0x84)});
+                        break;
+                    default:    // JG: ZF=0 and SF=OF, JLE: ZF=1 or SF!=OF
+                        e.signOverflowDiffer();
+                        e.bytes({0x89, 0xD9});  // mov ecx, ebx
+                        e.bytes({0x81, 0xE1});  // and ecx, ZF
+                        e.dword(ZF);
+                        e.bytes({0x09, 0xC8});  // or eax, ecx
+                        taken = e.jump({0x0F, static_cast<uint8_t>(insn.opcode == 0x7E ? 0x85 : 0x84)});
+                        break;
+                }
+                e.exitTo(next, pendingCycles + cycles.jcondNotTaken, index + 1);
+                e.bind(taken);
+                e.exitTo(static_cast<uint16_t>(next + offset), pendingCycles + cycles.jcondTaken, index + 1);
+                exited = true;
+            } else {
+                bool flagsLive = liveFlags[index] != 0;
+                if (!flagsCurrent && flagsLive) {
+                    if (isLogicOpcode(insn.opcode) || isArithmeticOpcode(insn.opcode)) {
+                        e.clearPending(ARITHMETIC_FLAGS);  // Overwrites all of them
+                        flagsCurrent = true;
+                    } else if (insn.opcode >= 0x40 && insn.opcode <= 0x4F) {
+                        e.clearPending(ARITHMETIC_FLAGS & ~CF);
+                    } else if (insn.opcode == 0xF5) {
+                        e.materializeFlags(flagsHelper);   // CMC reads CF
+                        flagsCurrent = true;
+                    } else if (insn.opcode == 0xF8 || insn.opcode == 0xF9) {
+                        e.clearPending(CF);
+                    }
+                }
+
+                emitInstruction(e, insn, flagsLive);
+                if (insn.opcode >= 0x88 && insn.opcode <= 0x8B) {
+                    pendingCycles += cycles.movRegReg;
+                } else if (insn.opcode >= 0xB0 && insn.opcode <= 0xBF) {
+                    pendingCycles += cycles.movImmReg;
+                } else if (isLogicOpcode(insn.opcode) || isArithmeticOpcode(insn.opcode)) {
+                    pendingCycles += cycles.aluRegReg;
+                } else if (insn.opcode >= 0x40 && insn.opcode <= 0x4F) {
+                    pendingCycles += cycles.incReg;
+                } else {
+                    pendingCycles += cycles.flagOp;
+                }
+            }
+
+            ip = next;
+        }
+
+        // Block cut short by its length limit: fall through to the next one
+        if (!exited) {
+            e.exitTo(ip, pendingCycles, count);
+        }
+
+        // Keep each block 16-byte aligned
+        size_t size = (e.code.size() + 15) & ~static_cast<size_t>(15);
+        if (used + size > BUFFER_SIZE) {
+            return nullptr;
+        }
+        uint8_t *code = buffer + used;
+        if (!writeCode(code, e.code.data(), e.code.size())) {
+            return nullptr;
+        }
+        used += size;
+        return reinterpret_cast<JitBlockFn>(code);
+    }
+
+    bool Jit::writeCode(uint8_t *to, const uint8_t *code, size_t size) {
+#ifdef EMU8086_JIT
+        const uintptr_t pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+        uintptr_t first = reinterpret_cast<uintptr_t>(to) & ~(pageSize - 1);
+        uintptr_t last = (reinterpret_cast<uintptr_t>(to) + size + pageSize - 1) & ~(pageSize - 1);
+        void *pages = reinterpret_cast<void*>(first);
+        if (mprotect(pages, last - first, PROT_READ | PROT_WRITE) != 0) {
+            return false;
+        }
+        std::memcpy(to, code, size);
+        return mprotect(pages, last - first, PROT_READ | PROT_EXEC) == 0;
+#else
+        std::memcpy(to, code, size);
+        return true;
+#endif
+    }
+
+} // namespace CPU
@@ -0,0 +1,89 @@
+#ifndef JIT_HPP
+#define JIT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "decoder.hpp"
+#include "registers.hpp"
+
+namespace CPU {
+
+    // State shared between a compiled block and the C++ side. The guest
+    // registers are loaded into host registers on entry and written back to
+    // *registers on every exit and around helper calls.
+    struct JitContext {
+        Registers  *registers = nullptr;
+        void       *owner = nullptr;   // Handed back to the helper (the Instructions instance)
+        const void *block = nullptr;   // Handed back to the helper (the block being run)
+        uint32_t    cycles = 0;        // Cycles spent in the block
+        uint32_t    executed = 0;      // Instructions completed
+        uint16_t    flags = 0;         // Guest FLAGS in and out
+        uint16_t    pending = 0;       // Flags still to be computed from the last ALU operation
+    };
+
+    // Runs instruction `index` of the block through its interpreter handler.
+    // Returns non-zero when the compiled code must return to the caller
+    // (I/O, a write into code, or an exception waiting to be rethrown).
+    using JitHelper = uint32_t (*)(JitContext *ctx, uint32_t index);
+    using JitBlockFn = void (*)(JitContext *ctx);
+
+    // Computes the pending flags into ctx->flags and clears ctx->pending
+    using JitFlagsHelper = void (*)(JitContext *ctx);
+
+    // Cycle counts of the instructions the compiler emits inline
+    struct JitCycles {
+        uint32_t movRegReg;
+        uint32_t movImmReg;
+        uint32_t aluRegReg;
+        uint32_t incReg;
+        uint32_t flagOp;
+        uint32_t jmpShort;
+        uint32_t jmpNear;
+        uint32_t jcondTaken;
+        uint32_t jcondNotTaken;
+    };
+
+    // Translates basic blocks into x86-64 machine code in an mmap'd buffer.
+    // AX..DI live in r8..r15 and FLAGS in ebx for the length of a block.
+    // Register moves, register ALU ops, INC/DEC, flag ops and jumps are
+    // emitted inline; every other instruction calls back into its handler.
+    class Jit {
+    public:
+        Jit(JitHelper helper, JitFlagsHelper flagsHelper, const JitCycles &cycles);
+        ~Jit();
+
+        Jit(const Jit&) = delete;
+        Jit& operator=(const Jit&) = delete;
+
+        // False when the host isn't x86-64 or no executable memory was granted
+        bool isAvailable() const { return buffer != nullptr; }
+
+        // Whether the instruction is translated inline rather than through the helper
+        static bool isNative(const DecodedInstruction &insn);
+
+        // Compile a block starting at offset ip. liveFlags holds, per
+        // instruction, the flags it writes that are read later on. Returns
+        // nullptr when the code buffer is full; reset() it and compile again.
+        JitBlockFn compile(const std::vector<const DecodedInstruction*> &insns,
+                           const std::vector<uint16_t> &liveFlags, uint16_t ip);
+
+        // Throw away all compiled code
+        void reset() { used = 0; }
+
+    private:
+        static constexpr size_t BUFFER_SIZE = 4 << 20;
+
+        // Copy code into the buffer, flipping its pages to writable and back
+        bool writeCode(uint8_t *to, const uint8_t *code, size_t size);
+
+        uint8_t  *buffer = nullptr;
+        size_t    used = 0;
+        JitHelper helper;
+        JitFlagsHelper flagsHelper;
+        JitCycles cycles;
+    };
+
+} // namespace CPU
+
+#endif // JIT_HPP
@@ -0,0 +1,529 @@
+#include "lockstep.hpp"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <limits>
+
+// Vectors are only passed between the helpers below, all internal to this
+// file, so the warning that their calling convention depends on -mavx is moot
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+namespace CPU {
+
+    namespace {
+
+        // GCC/Clang vector extensions: arithmetic works lane by lane, and a
+        // comparison gives all ones in the lanes where it holds
+        typedef uint16_t Vec  __attribute__((vector_size(Lockstep::WIDTH * 2)));
+        typedef int16_t  Mask __attribute__((vector_size(Lockstep::WIDTH * 2)));
+
+        Vec load(const uint16_t *source) {
+            Vec v;
+            std::memcpy(&v, source, sizeof(v));
+            return v;
+        }
+
+        void store(uint16_t *target, const Vec &v) { std::memcpy(target, &v, sizeof(v)); }
+
+        Vec splat(uint16_t value) { return Vec{} + value; }
+
+        Vec select(const Vec &mask, const Vec &a, const Vec &b) { return (a & mask) | (b & ~mask); }
+
+        bool any(const Vec &v) {
+            uint64_t words[sizeof(Vec) / sizeof(uint64_t)];
+            std::memcpy(words, &v, sizeof(v));
+            uint64_t bits = 0;
+            for (uint64_t word : words) {
+                bits |= word;
+            }
+            return bits != 0;
+        }
+
+        bool isSet(const Vec &v, size_t index) { return v[index] != 0; }
+
+        // Unsigned a < b. SSE2 only compares signed words, so both sides are
+        // moved into signed range first rather than leaving the compiler to
+        // do it lane by lane.
+        Vec below(const Vec &a, const Vec &b) {
+            return reinterpret_cast<Vec>(reinterpret_cast<Mask>(a ^ 0x8000) < reinterpret_cast<Mask>(b ^ 0x8000));
+        }
+
+        // ZF, SF and PF of 16-bit results
+        Vec resultFlags(const Vec &result) {
+            Vec parity = result & 0xFF;
+            parity ^= parity >> 4;
+            parity ^= parity >> 2;
+            parity ^= parity >> 1;
+            return (reinterpret_cast<Vec>(result == 0) & splat(ZF)) | ((result >> 8) & splat(SF)) |
+                   ((~parity & 1) << 2);
+        }
+
+        // The arithmetic flags of dest + src = result and dest - src = result,
+        // worked out the way Flags::materialize() does
+        Vec addFlags(const Vec &dest, const Vec &src, const Vec &result) {
+            return (below(result, dest) & splat(CF)) |
+                   ((((dest ^ result) & (src ^ result)) >> 4) & splat(OF)) |
+                   ((dest ^ src ^ result) & splat(AF)) | resultFlags(result);
+        }
+
+        Vec subFlags(const Vec &dest, const Vec &src, const Vec &result) {
+            return (below(dest, src) & splat(CF)) |
+                   ((((dest ^ src) & (dest ^ result)) >> 4) & splat(OF)) |
+                   ((dest ^ src ^ result) & splat(AF)) | resultFlags(result);
+        }
+
+        // Byte registers by encoding: AL, CL, DL, BL, then AH, CH, DH, BH
+        Vec readByte(const Vec &word, uint8_t reg) { return (reg & 4) ? (word >> 8) : (word & 0xFF); }
+        Vec writeByte(const Vec &word, uint8_t reg, const Vec &value) {
+            return (reg & 4) ? ((word & 0x00FF) | (value << 8)) : ((word & 0xFF00) | (value & 0xFF));
+        }
+
+        bool isConditionalJump(uint8_t opcode) {
+            return opcode == 0x74 || opcode == 0x75 || opcode == 0x77 ||
+                   opcode == 0x7C || opcode == 0x7D || opcode == 0x7E;
+        }
+
+        // Lanes where a conditional jump is taken, as the handlers decide it
+        Vec jumpTaken(uint8_t opcode, const Vec &flagsValue) {
+            Vec zero = reinterpret_cast<Vec>((flagsValue & splat(ZF)) != 0);
+            Vec less = reinterpret_cast<Vec>((((flagsValue >> 7) ^ (flagsValue >> 11)) & 1) != 0);  // SF != OF
+            switch (opcode) {
+                case 0x74: return zero;            // JE
+                case 0x75: return ~zero;           // JNE
+                case 0x77: return ~zero & ~less;   // JG
+                case 0x7C: return less;            // JL
+                case 0x7D: return ~less;           // JGE
+                default:   return zero | less;     // JLE
+            }
+        }
+
+    } // namespace
+
+    Lockstep::Lockstep(size_t count, bool sparseMemory)
+        : count(count), padded((count + WIDTH - 1) / WIDTH * WIDTH), cost(Instructions::nativeCycles()) {
+        for (size_t i = 0; i < count; i++) {
+            cpus.push_back(std::make_unique<CPU>(sparseMemory));
+        }
+        for (auto &reg : gpr) {
+            reg.assign(padded, 0);
+        }
+        cs.assign(padded, 0);
+        ip.assign(padded, 0);
+        flags.assign(padded, 0);
+        active.assign(padded, 0);
+        codeChanged.assign(padded, 0);
+        instructions.assign(count, 0);
+        cycles.assign(count, 0);
+        recentInstructions.assign(padded, 0);
+        recentCycles.assign(padded, 0);
+        instructionsLeft.assign(padded, 0);
+        cyclesLeft.assign(padded, 0);
+        states.assign(count, LaneState::Stopped);
+        codeWrites.assign(count, 0);
+        decoders.resize(count);
+    }
+
+    void Lockstep::loadLane(size_t lane) {
+        Registers &r = cpus[lane]->getRegisters();
+        const uint16_t values[8] = {r.AX.value, r.CX.value, r.DX.value, r.BX.value, r.SP, r.BP, r.SI, r.DI};
+        for (size_t reg = 0; reg < 8; reg++) {
+            gpr[reg][lane] = values[reg];
+        }
+        cs[lane] = r.CS;
+        ip[lane] = r.IP;
+        flags[lane] = cpus[lane]->getFlags().getValue();
+    }
+
+    void Lockstep::storeLane(size_t lane) {
+        Registers &r = cpus[lane]->getRegisters();
+        r.AX.value = gpr[0][lane]; r.CX.value = gpr[1][lane]; r.DX.value = gpr[2][lane]; r.BX.value = gpr[3][lane];
+        r.SP = gpr[4][lane]; r.BP = gpr[5][lane]; r.SI = gpr[6][lane]; r.DI = gpr[7][lane];
+        r.CS = cs[lane];
+        r.IP = ip[lane];
+        cpus[lane]->getFlags().setValue(flags[lane]);
+    }
+
+    void Lockstep::stopLane(size_t lane, StopReason reason) {
+        active[lane] = 0;
+        states[lane] = LaneState::Stopped;
+        results[lane].reason = reason;
+    }
+
+    // HLT with IF set waits for an interrupt, which only the lane's own CPU
+    // can bring in; with IF clear nothing ever ends it
+    void Lockstep::haltLane(size_t lane) {
+        if (flags[lane] & IF) {
+            detachLane(lane);
+        } else {
+            stopLane(lane, StopReason::Halted);
+        }
+    }
+
+    // Fold the lane's vector-path counts into its totals, and its CPU's
+    // clock, and work out how far it can go before the next flush
+    void Lockstep::flushLane(size_t lane) {
+        instructions[lane] += recentInstructions[lane];
+        cycles[lane] += recentCycles[lane];
+        cpus[lane]->addCycles(recentCycles[lane]);
+        recentInstructions[lane] = 0;
+        recentCycles[lane] = 0;
+        uint64_t instructionsToGo = maxInstructions - std::min(instructions[lane], maxInstructions);
+        uint64_t cyclesToGo = maxCycles - std::min(cycles[lane], maxCycles);
+        instructionsLeft[lane] = static_cast<uint16_t>(std::min<uint64_t>(instructionsToGo, 0xFFFF));
+        cyclesLeft[lane] = static_cast<uint16_t>(std::min<uint64_t>(cyclesToGo, 0xFFFF));
+    }
+
+    // The lane's registers are handed back to its CPU, which finishes the run
+    void Lockstep::detachLane(size_t lane) {
+        storeLane(lane);
+        active[lane] = 0;
+        states[lane] = LaneState::Detached;
+    }
+
+    // Kept sorted highest first, so the group to run next is at the back
+    void Lockstep::addGroup(uint32_t key) {
+        auto at = std::lower_bound(groups.begin(), groups.end(), key, std::greater<uint32_t>());
+        if (at == groups.end() || *at != key) {
+            groups.insert(at, key);
+        }
+    }
+
+    const DecodedInstruction& Lockstep::fetch(size_t leader, uint16_t segment, uint16_t offset) {
+        if (!decoders[leader]) {
+            decoders[leader] = std::make_unique<Decoder>(cpus[leader]->getMemory());
+        }
+        return decoders[leader]->fetch(segment, offset);
+    }
+
+    bool Lockstep::sameCode(size_t lane, size_t leader, uint32_t address, uint8_t length) {
+        Memory &memory = cpus[lane]->getMemory();
+        const Memory &reference = cpus[leader]->getMemory();
+        for (uint8_t i = 0; i < length; i++) {
+            if (memory.readByte(address + i) != reference.readByte(address + i)) {
+                return false;
+            }
+        }
+        // A later write to these bytes now counts as a code write
+        memory.markCodePage(address);
+        memory.markCodePage(address + length - 1);
+        return true;
+    }
+
+    // First time an instruction is run: every lane must hold the same bytes
+    // there. From then on a lane can only change them by writing into a code
+    // page, which its code write count gives away, and a lane that has done
+    // so is compared again every time it runs an instruction.
+    void Lockstep::checkCode(size_t leader, uint32_t address, uint8_t length) {
+        for (size_t lane = 0; lane < count; lane++) {
+            if (active[lane] && lane != leader && !sameCode(lane, leader, address, length)) {
+                detachLane(lane);
+            }
+        }
+    }
+
+    std::vector<RunResult> Lockstep::run(const RunLimits &limits) {
+        static constexpr uint32_t DEADLINE_INTERVAL = 256;  // Steps between clock reads
+
+        maxInstructions = limits.maxInstructions ? limits.maxInstructions : std::numeric_limits<uint64_t>::max();
+        maxCycles = limits.maxCycles ? limits.maxCycles : std::numeric_limits<uint64_t>::max();
+        const bool hasDeadline = limits.deadline != std::chrono::steady_clock::time_point::max();
+        uint32_t untilClock = DEADLINE_INTERVAL;
+        uint32_t untilFlush = FLUSH_INTERVAL;
+
+        results.assign(count, RunResult());
+        std::fill(instructions.begin(), instructions.end(), 0);
+        std::fill(cycles.begin(), cycles.end(), 0);
+        std::fill(recentInstructions.begin(), recentInstructions.end(), 0);
+        std::fill(recentCycles.begin(), recentCycles.end(), 0);
+        std::fill(codeChanged.begin(), codeChanged.end(), 0);
+        checkedCode.assign(Memory::ADDRESS_SPACE_SIZE, false);
+        groups.clear();
+        for (size_t lane = 0; lane < count; lane++) {
+            loadLane(lane);
+            codeWrites[lane] = cpus[lane]->getMemory().getCodeWriteCount();
+            flushLane(lane);
+            if (cpus[lane]->isHalted()) {
+                haltLane(lane);
+            } else {
+                active[lane] = 0xFFFF;
+                states[lane] = LaneState::Running;
+                addGroup(laneKey(lane));
+            }
+        }
+
+        std::vector<size_t> chunks;  // Vectors holding a lane of the current group
+        while (!groups.empty()) {
+            if (hasDeadline && --untilClock == 0) {
+                untilClock = DEADLINE_INTERVAL;
+                if (std::chrono::steady_clock::now() >= limits.deadline) {
+                    for (size_t lane = 0; lane < count; lane++) {
+                        if (active[lane]) {
+                            stopLane(lane, StopReason::Deadline);
+                        }
+                    }
+                    break;
+                }
+            }
+
+            if (--untilFlush == 0) {
+                untilFlush = FLUSH_INTERVAL;
+                for (size_t lane = 0; lane < count; lane++) {
+                    flushLane(lane);
+                }
+            }
+
+            uint32_t key = groups.back();
+            groups.pop_back();
+            uint16_t segment = static_cast<uint16_t>(key >> 16);
+            uint16_t offset = static_cast<uint16_t>(key);
+
+            // Gather the group, stopping lanes that are out of budget
+            const Vec segments = splat(segment), offsets = splat(offset);
+            bool codeChanges = false;
+            chunks.clear();
+            for (size_t base = 0; base < padded; base += WIDTH) {
+                Vec mask = load(&active[base]) & reinterpret_cast<Vec>(load(&cs[base]) == segments) &
+                           reinterpret_cast<Vec>(load(&ip[base]) == offsets);
+                if (!any(mask)) {
+                    continue;
+                }
+                Vec instructionsOut = ~below(load(&recentInstructions[base]), load(&instructionsLeft[base]));
+                Vec over = mask & (instructionsOut | ~below(load(&recentCycles[base]), load(&cyclesLeft[base])));
+                if (any(over)) {
+                    for (size_t i = 0; i < WIDTH; i++) {
+                        if (isSet(over, i)) {
+                            stopLane(base + i, isSet(instructionsOut, i) ? StopReason::InstructionLimit
+                                                                         : StopReason::CycleLimit);
+                        }
+                    }
+                    mask &= ~over;
+                    if (!any(mask)) {
+                        continue;
+                    }
+                }
+                codeChanges |= any(mask & load(&codeChanged[base]));
+                chunks.push_back(base);
+            }
+            if (chunks.empty()) {
+                continue;
+            }
+
+            size_t leader = chunks.front();
+            while (!(active[leader] && cs[leader] == segment && ip[leader] == offset)) {
+                leader++;
+            }
+            const DecodedInstruction &insn = fetch(leader, segment, offset);
+            uint32_t address = cpus[leader]->getMemory().calculatePhysicalAddress(segment, offset);
+            if (!checkedCode[address]) {
+                checkedCode[address] = true;
+                checkCode(leader, address, insn.length);
+            }
+            // Lanes that have written into code are compared every time, and
+            // if the leader has, all of the group is
+            for (size_t lane = 0; codeChanges && lane < count; lane++) {
+                if (active[lane] && (codeChanged[lane] || codeChanged[leader]) && cs[lane] == segment && ip[lane] == offset &&
+                    lane != leader && !sameCode(lane, leader, address, insn.length)) {
+                    detachLane(lane);
+                }
+            }
+
+            if (Jit::isNative(insn)) {
+                stepNative(insn, segment, offset, chunks);
+            } else {
+                stepLanes(segment, offset, chunks);
+            }
+        }
+
+        for (size_t lane = 0; lane < count; lane++) {
+            flushLane(lane);
+            RunResult &result = results[lane];
+            result.instructions = instructions[lane];
+            result.cycles = cycles[lane];
+            if (states[lane] != LaneState::Detached) {
+                storeLane(lane);
+                continue;
+            }
+
+            // Finish on the lane's own CPU with what is left of its budget
+            if (instructions[lane] >= maxInstructions) {
+                result.reason = StopReason::InstructionLimit;
+                continue;
+            }
+            if (cycles[lane] >= maxCycles) {
+                result.reason = StopReason::CycleLimit;
+                continue;
+            }
+            RunLimits rest = limits;
+            rest.maxInstructions = limits.maxInstructions ? limits.maxInstructions - instructions[lane] : 0;
+            rest.maxCycles = limits.maxCycles ? limits.maxCycles - cycles[lane] : 0;
+            RunResult tail = cpus[lane]->run(rest);
+            result.reason = tail.reason;
+            result.fault = tail.fault;
+            result.faultCS = tail.faultCS;
+            result.faultIP = tail.faultIP;
+            result.instructions += tail.instructions;
+            result.cycles += tail.cycles;
+        }
+        return results;
+    }
+
+    void Lockstep::stepNative(const DecodedInstruction &insn, uint16_t segment, uint16_t offset,
+                              const std::vector<size_t> &chunks) {
+        const uint8_t opcode = insn.opcode;
+        const uint16_t next = static_cast<uint16_t>(offset + insn.length);
+        const Vec segments = splat(segment), offsets = splat(offset);
+
+        // Where jumping lanes go and what each way costs
+        uint16_t target = next;
+        uint32_t takenCost = 0;
+        uint32_t fallCost = 0;
+        bool conditional = isConditionalJump(opcode);
+        if (opcode == 0xEB || opcode == 0xE9 || conditional) {
+            // JE takes a rel8, the other conditional jumps a rel16 (see handleJNE)
+            bool shortJump = opcode == 0xEB || opcode == 0x74;
+            int16_t displacement = shortJump ? static_cast<int8_t>(insn.imm) : static_cast<int16_t>(insn.imm);
+            target = static_cast<uint16_t>(next + displacement);
+            takenCost = conditional ? cost.jcondTaken : (opcode == 0xEB ? cost.jmpShort : cost.jmpNear);
+            fallCost = conditional ? cost.jcondNotTaken : takenCost;
+        } else if (opcode >= 0x88 && opcode <= 0x8B) {
+            takenCost = fallCost = cost.movRegReg;
+        } else if (opcode >= 0xB0 && opcode <= 0xBF) {
+            takenCost = fallCost = cost.movImmReg;
+        } else if (opcode < 0x40) {
+            takenCost = fallCost = cost.aluRegReg;
+        } else if (opcode <= 0x4F) {
+            takenCost = fallCost = cost.incReg;
+        } else {
+            takenCost = fallCost = cost.flagOp;
+        }
+
+        // Operands of the ModR/M forms: reg,r/m or r/m,reg by the direction bit
+        bool direction = (opcode & 0x02) != 0;
+        uint8_t dest = direction ? insn.reg : insn.rm;
+        uint8_t src = direction ? insn.rm : insn.reg;
+
+        Vec anyTaken{}, anyFallen{};
+        for (size_t base : chunks) {
+            Vec mask = load(&active[base]) & reinterpret_cast<Vec>(load(&cs[base]) == segments) &
+                       reinterpret_cast<Vec>(load(&ip[base]) == offsets);
+            Vec flagsValue = load(&flags[base]);
+            Vec newFlags = flagsValue;
+            Vec taken{};
+
+            if (opcode == 0xEB || opcode == 0xE9) {
+                taken = mask;
+            } else if (conditional) {
+                taken = mask & jumpTaken(opcode, flagsValue);
+            } else if (opcode >= 0x88 && opcode <= 0x8B) {
+                uint16_t *to = &gpr[insn.isWord ? dest : dest & 3][base];
+                Vec value = load(&gpr[insn.isWord ? src : src & 3][base]);
+                if (!insn.isWord) {
+                    value = writeByte(load(to), dest, readByte(value, src));
+                }
+                store(to, select(mask, value, load(to)));
+            } else if (opcode >= 0xB8 && opcode <= 0xBF) {
+                uint16_t *to = &gpr[opcode & 0x07][base];
+                store(to, select(mask, splat(insn.imm), load(to)));
+            } else if (opcode >= 0xB0 && opcode <= 0xB7) {
+                uint8_t reg = opcode & 0x07;
+                uint16_t *to = &gpr[reg & 3][base];
+                Vec value = load(to);
+                store(to, select(mask, writeByte(value, reg, splat(insn.imm)), value));
+            } else if (opcode < 0x40) {
+                uint16_t *to = &gpr[dest][base];
+                Vec a = load(to);
+                Vec b = load(&gpr[src][base]);
+                Vec result;
+                Vec arithmetic;
+                switch (opcode & 0x38) {
+                    case 0x00: result = a + b; arithmetic = addFlags(a, b, result); break;  // ADD
+                    case 0x08: result = a | b; arithmetic = resultFlags(result); break;     // OR
+                    case 0x20: result = a & b; arithmetic = resultFlags(result); break;     // AND
+                    case 0x30: result = a ^ b; arithmetic = resultFlags(result); break;     // XOR
+                    default:   result = a - b; arithmetic = subFlags(a, b, result); break;  // SUB, CMP
+                }
+                newFlags = (flagsValue & splat(static_cast<uint16_t>(~ARITHMETIC_FLAGS))) | arithmetic;
+                if ((opcode & 0x38) != 0x38) {
+                    store(to, select(mask, result, a));
+                }
+            } else if (opcode <= 0x4F) {
+                // INC/DEC leave CF alone
+                uint16_t *to = &gpr[opcode & 0x07][base];
+                Vec a = load(to);
+                Vec one = splat(1);
+                Vec result = (opcode < 0x48) ? a + one : a - one;
+                Vec arithmetic = (opcode < 0x48) ? addFlags(a, one, result) : subFlags(a, one, result);
+                uint16_t written = ARITHMETIC_FLAGS & ~CF;
+                newFlags = (flagsValue & splat(static_cast<uint16_t>(~written))) | (arithmetic & splat(written));
+                store(to, select(mask, result, a));
+            } else {
+                switch (opcode) {
+                    case 0xF5: newFlags = flagsValue ^ splat(CF); break;                               // CMC
+                    case 0xF8: newFlags = flagsValue & splat(static_cast<uint16_t>(~CF)); break;       // CLC
+                    case 0xF9: newFlags = flagsValue | splat(CF); break;                               // STC
+                    case 0xFA: newFlags = flagsValue & splat(static_cast<uint16_t>(~IF)); break;       // CLI
+                    case 0xFC: newFlags = flagsValue & splat(static_cast<uint16_t>(~DF)); break;       // CLD
+                    default:   newFlags = flagsValue | splat(DF); break;                               // STD
+                }
+            }
+
+            store(&flags[base], select(mask, newFlags, flagsValue));
+            store(&ip[base], select(mask, select(taken, splat(target), splat(next)), load(&ip[base])));
+            anyTaken |= taken;
+            anyFallen |= mask & ~taken;
+
+            store(&recentInstructions[base], load(&recentInstructions[base]) + (mask & 1));
+            store(&recentCycles[base], load(&recentCycles[base]) +
+                                       (mask & select(taken, splat(takenCost), splat(fallCost))));
+        }
+
+        if (any(anyTaken)) {
+            addGroup(groupKey(segment, target));
+        }
+        if (any(anyFallen)) {
+            addGroup(groupKey(segment, next));
+        }
+    }
+
+    // Everything the vector path doesn't do runs through each lane's CPU
+    void Lockstep::stepLanes(uint16_t segment, uint16_t offset, const std::vector<size_t> &chunks) {
+        for (size_t base : chunks) {
+            for (size_t lane = base; lane < base + WIDTH; lane++) {
+                if (!active[lane] || cs[lane] != segment || ip[lane] != offset) {
+                    continue;
+                }
+                CPU &cpu = *cpus[lane];
+                // The timer counts from the CPU's clock
+                flushLane(lane);
+                storeLane(lane);
+                uint64_t startCycles = cpu.getTotalCycles();
+                try {
+                    cpu.executeInstruction();
+                    instructions[lane]++;
+                } catch (const std::exception &e) {
+                    results[lane].fault = e.what();
+                    results[lane].faultCS = cpu.getRegisters().CS;
+                    results[lane].faultIP = cpu.getRegisters().IP;
+                    loadLane(lane);
+                    stopLane(lane, StopReason::Fault);
+                    continue;
+                }
+                cycles[lane] += cpu.getTotalCycles() - startCycles;
+                flushLane(lane);
+                loadLane(lane);
+
+                uint32_t writes = cpu.getMemory().getCodeWriteCount();
+                if (writes != codeWrites[lane]) {
+                    codeWrites[lane] = writes;
+                    codeChanged[lane] = 0xFFFF;
+                }
+                if (cpu.isHalted()) {
+                    haltLane(lane);
+                } else {
+                    addGroup(laneKey(lane));
+                }
+            }
+        }
+    }
+
+} // namespace CPU
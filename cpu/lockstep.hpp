@@ -0,0 +1,121 @@
+#ifndef LOCKSTEP_HPP
+#define LOCKSTEP_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "cpu.hpp"
+#include "decoder.hpp"
+#include "jit.hpp"
+
+namespace CPU {
+
+    // Runs many instances of the same program side by side, for sweeps that
+    // only differ in their input. The general-purpose registers, CS, IP and
+    // FLAGS of every lane are kept in structure-of-arrays form, and lanes
+    // that sit at the same CS:IP are stepped together: the instructions the
+    // JIT emits inline (register moves and ALU ops, INC/DEC, flag ops and
+    // jumps) run on all of them at once as vector operations, under a mask
+    // of the lanes at that CS:IP. Anything else - memory, I/O,
+    // interrupts, string ops - is stepped through each lane's own CPU.
+    //
+    // Lanes that go different ways at a branch are regrouped by always
+    // running the group with the lowest CS:IP next, so they meet up again
+    // where their paths join. A lane whose code stops matching the others'
+    // (self-modifying code, or a different program loaded) is taken out and
+    // finished on its own CPU.
+    //
+    // Vectors are one host register wide: 16 lanes of AVX2 when built with
+    // -mavx2 (or -march=native on a host that has it), 8 lanes of SSE2
+    // otherwise.
+    class Lockstep {
+    public:
+#ifdef __AVX2__
+        static constexpr size_t WIDTH = 16;  // 16-bit lanes per vector
+#else
+        static constexpr size_t WIDTH = 8;
+#endif
+
+        // count lanes, each a CPU of its own. Sparse memory keeps the ones
+        // that only touch a few pages small.
+        explicit Lockstep(size_t count, bool sparseMemory = true);
+
+        size_t size() const { return count; }
+
+        // Set up a lane (load its program, registers, console, ...) before
+        // run(). DS, SS and ES stay in the lane's CPU, as nothing run on the
+        // vector path reads or writes them. The CPU's own instruction and
+        // cycle counters only see the instructions stepped through it; the
+        // totals are in the results of run(). Events on the lane's scheduler
+        // run on those counters too, so lanes are best left without devices.
+        CPU& lane(size_t index) { return *cpus[index]; }
+
+        // Run every lane until it halts, faults or runs out of budget. The
+        // limits apply to each lane on its own, with the same meaning as for
+        // CPU::run(const RunLimits&), except that the cycle budget is checked
+        // before every instruction. Returns one result per lane.
+        std::vector<RunResult> run(const RunLimits &limits);
+
+    private:
+        enum class LaneState : uint8_t { Running, Stopped, Detached };
+
+        size_t count;
+        size_t padded;  // count rounded up to a whole number of vectors
+        std::vector<std::unique_ptr<CPU>> cpus;
+
+        // Register file, one array per register. The general-purpose
+        // registers are indexed by their encoding (AX, CX, DX, BX, SP, BP,
+        // SI, DI). active is 0xFFFF for lanes still run in lockstep; padding
+        // lanes are never active.
+        std::array<std::vector<uint16_t>, 8> gpr;
+        std::vector<uint16_t> cs, ip, flags, active;
+        std::vector<uint16_t> codeChanged;  // 0xFFFF once the lane has written into a code page
+
+        // Instructions and cycles run so far. The vector path counts in 16
+        // bits, in recentInstructions/recentCycles, which are folded into the
+        // totals and the lane CPU's clock every FLUSH_INTERVAL steps (well
+        // before they could wrap) and before and after a lane is stepped on
+        // its own. instructionsLeft/cyclesLeft
+        // hold what the budget leaves as of the last flush, capped to 16 bits.
+        static constexpr uint32_t FLUSH_INTERVAL = 2048;
+        std::vector<uint64_t> instructions, cycles;
+        std::vector<uint16_t> recentInstructions, recentCycles;
+        std::vector<uint16_t> instructionsLeft, cyclesLeft;
+        uint64_t maxInstructions = 0;
+        uint64_t maxCycles = 0;
+
+        std::vector<LaneState> states;
+        std::vector<RunResult> results;
+        std::vector<uint32_t> codeWrites;  // Lane's code write count when last looked at
+
+        // Decoding is done once per step, from the first lane of the group
+        std::vector<std::unique_ptr<Decoder>> decoders;
+        std::vector<bool> checkedCode;  // By physical address, instructions compared across all lanes
+
+        std::vector<uint32_t> groups;  // CS:IP of every group of active lanes
+        JitCycles cost;
+
+        static uint32_t groupKey(uint16_t segment, uint16_t offset) { return (static_cast<uint32_t>(segment) << 16) | offset; }
+        uint32_t laneKey(size_t lane) const { return groupKey(cs[lane], ip[lane]); }
+
+        void loadLane(size_t lane);   // CPU -> register arrays
+        void storeLane(size_t lane);  // Register arrays -> CPU
+        void stopLane(size_t lane, StopReason reason);
+        void detachLane(size_t lane);
+        void haltLane(size_t lane);
+        void addGroup(uint32_t key);
+        void flushLane(size_t lane);
+
+        const DecodedInstruction& fetch(size_t leader, uint16_t segment, uint16_t offset);
+        bool sameCode(size_t lane, size_t leader, uint32_t address, uint8_t length);
+        void checkCode(size_t leader, uint32_t address, uint8_t length);
+
+        void stepNative(const DecodedInstruction &insn, uint16_t segment, uint16_t offset, const std::vector<size_t> &chunks);
+        void stepLanes(uint16_t segment, uint16_t offset, const std::vector<size_t> &chunks);
+    };
+
+} // namespace CPU
+
+#endif // LOCKSTEP_HPP
@@ -2,45 +2,462 @@
 // Created by Hakan Avgın on 21.12.2024.
 //
 #include "memory.hpp"
+#include <algorithm>
 #include <iomanip> //Hex formatting
+#include <stdexcept>
 
 namespace CPU {
-    uint8_t Memory::readByte(uint32_t address) const {
-        if (address >= MEMORY_SIZE) {
-            throw std::out_of_range("Memory read out of bounds");
+
+    namespace {
+
+        // GCC/Clang vector extensions, one host register of bytes: 32 with
+        // AVX2, 16 with SSE2. A comparison gives all ones in the bytes where
+        // it holds.
+#ifdef __AVX2__
+        typedef uint8_t Bytes __attribute__((vector_size(32)));
+#else
+        typedef uint8_t Bytes __attribute__((vector_size(16)));
+#endif
+
+        bool any(const Bytes &v) {
+            uint64_t words[sizeof(Bytes) / sizeof(uint64_t)];
+            std::memcpy(words, &v, sizeof(v));
+            uint64_t bits = 0;
+            for (uint64_t word : words) {
+                bits |= word;
+            }
+            return bits != 0;
+        }
+
+        // Offset of the first byte where (a[i] == b[i]) == equal, or size.
+        // Whole vectors are skipped until one holds such a byte.
+        uint32_t findByte(const uint8_t *a, const uint8_t *b, uint32_t size, bool equal) {
+            uint32_t i = 0;
+            for (; i + sizeof(Bytes) <= size; i += sizeof(Bytes)) {
+                Bytes x, y;
+                std::memcpy(&x, a + i, sizeof(x));
+                std::memcpy(&y, b + i, sizeof(y));
+                if (any(reinterpret_cast<Bytes>(equal ? x == y : x != y))) {
+                    break;
+                }
+            }
+            for (; i < size; i++) {
+                if ((a[i] == b[i]) == equal) {
+                    return i;
+                }
+            }
+            return size;
+        }
+
+        // The same against low and high repeated, low first
+        uint32_t findByte(const uint8_t *a, uint8_t low, uint8_t high, uint32_t size, bool equal) {
+            Bytes pattern;
+            for (size_t i = 0; i < sizeof(Bytes); i++) {
+                pattern[i] = (i & 1) ? high : low;
+            }
+            uint32_t i = 0;
+            for (; i + sizeof(Bytes) <= size; i += sizeof(Bytes)) {
+                Bytes x;
+                std::memcpy(&x, a + i, sizeof(x));
+                if (any(reinterpret_cast<Bytes>(equal ? x == pattern : x != pattern))) {
+                    break;
+                }
+            }
+            for (; i < size; i++) {
+                if ((a[i] == ((i & 1) ? high : low)) == equal) {
+                    return i;
+                }
+            }
+            return size;
+        }
+
+    } // namespace
+
+    const std::array<uint8_t, Memory::PAGE_SIZE> Memory::zeroPage{};
+
+    Memory::Memory(bool sparse) : memory(sparse ? 0 : ADDRESS_SPACE_SIZE), addressMask(MEMORY_SIZE - 1),
+                                  sparse(sparse), dirtyPages{}, changedPages{}, codePages(CODE_PAGE_COUNT),
+                                  codePageVersions(CODE_PAGE_COUNT) {
+        mapRam(0, ADDRESS_SPACE_SIZE);
+    }
+
+    void Memory::setRamPage(uint32_t page) {
+        // A sparse page only has a buffer while it is dirty
+        uint8_t *data = ramPage(page);
+        readPages[page] = data ? data : cleanPage(page);
+        writePages[page] = dirtyPages[page] && changedPages[page] ? data : nullptr;
+        pageTypes[page] = PageType::Ram;
+    }
+
+    void Memory::markDirty(uint32_t page) {
+        if (sparse) {
+            sparsePages[page].reset(new uint8_t[PAGE_SIZE]);
+            std::memcpy(sparsePages[page].get(), cleanPage(page), PAGE_SIZE);
+        }
+        dirtyPages[page] = 1;
+        dirtyList.push_back(page);
+    }
+
+    void Memory::markChanged(uint32_t page) {
+        if (!changedPages[page]) {
+            changedPages[page] = 1;
+            changedList.push_back(page);
+        }
+    }
+
+    void Memory::touchPage(uint32_t page) {
+        if (!dirtyPages[page]) {
+            markDirty(page);
+        }
+        markChanged(page);
+        setRamPage(page);
+    }
+
+    void Memory::checkRegion(uint32_t start, size_t size) const {
+        if (start % PAGE_SIZE != 0 || size % PAGE_SIZE != 0 || size == 0) {
+            throw std::runtime_error("Memory region must be a whole number of pages");
+        }
+        if (start + size > ADDRESS_SPACE_SIZE) {
+            throw std::runtime_error("Memory region out of bounds");
+        }
+    }
+
+    void Memory::invalidateCodePages(uint32_t start, uint32_t size) {
+        for (uint32_t page = start >> CODE_PAGE_SHIFT; page <= (start + size - 1) >> CODE_PAGE_SHIFT; page++) {
+            invalidateCodePage(page << CODE_PAGE_SHIFT);
+        }
+    }
+
+    void Memory::mapRam(uint32_t start, size_t size) {
+        checkRegion(start, size);
+        for (uint32_t address = start; address < start + size; address += PAGE_SIZE) {
+            setRamPage(address >> PAGE_SHIFT);
+        }
+        invalidateCodePages(start, size);
+    }
+
+    void Memory::mapRom(uint32_t start, std::shared_ptr<const std::vector<uint8_t>> image) {
+        if (!image) {
+            throw std::runtime_error("No ROM image to map");
+        }
+        checkRegion(start, image->size());
+        for (uint32_t offset = 0; offset < image->size(); offset += PAGE_SIZE) {
+            uint32_t page = (start + offset) >> PAGE_SHIFT;
+            readPages[page] = image->data() + offset;
+            writePages[page] = nullptr;
+            pageTypes[page] = PageType::Rom;
+        }
+        invalidateCodePages(start, image->size());
+        romImages.push_back(std::move(image));
+    }
+
+    void Memory::mapMmio(uint32_t start, size_t size, MemoryReadHandler read, MemoryWriteHandler write) {
+        checkRegion(start, size);
+        if (devices.size() > UINT8_MAX) {
+            throw std::runtime_error("Too many memory-mapped devices");
+        }
+        devices.push_back({std::move(read), std::move(write)});
+        for (uint32_t address = start; address < start + size; address += PAGE_SIZE) {
+            uint32_t page = address >> PAGE_SHIFT;
+            readPages[page] = nullptr;
+            writePages[page] = nullptr;
+            pageTypes[page] = PageType::Mmio;
+            pageDevices[page] = static_cast<uint8_t>(devices.size() - 1);
+        }
+        invalidateCodePages(start, size);
+    }
+
+    uint8_t Memory::readSlow(uint32_t address) const {
+        // Only MMIO pages have no read pointer
+        const Device &device = devices[pageDevices[address >> PAGE_SHIFT]];
+        return device.read ? device.read(address) : 0xFF;  // Open bus
+    }
+
+    uint16_t Memory::readWordSlow(uint32_t address) const {
+        uint8_t low = readByte(address);
+        uint8_t high = readByte(wrap(address + 1));
+        return static_cast<uint16_t>(low | (high << 8));
+    }
+
+    void Memory::writeSlow(uint32_t address, uint8_t value) {
+        uint32_t page = address >> PAGE_SHIFT;
+        switch (pageTypes[page]) {
+            case PageType::Ram:
+                // First write to the page since it was last clean or copied
+                // into an image
+                touchPage(page);
+                writePages[page][address & (PAGE_SIZE - 1)] = value;
+                break;
+            case PageType::Rom:
+                return;
+            case PageType::Mmio: {
+                const Device &device = devices[pageDevices[page]];
+                if (device.write) {
+                    device.write(address, value);
+                }
+                break;
+            }
+        }
+        // Code may be fetched from device memory too
+        invalidateCodePage(address);
+    }
+
+    void Memory::writeWordSlow(uint32_t address, uint16_t value) {
+        writeByte(address, static_cast<uint8_t>(value & 0xFF));
+        writeByte(wrap(address + 1), static_cast<uint8_t>(value >> 8));
+    }
+
+    bool Memory::isPlainRange(uint32_t start, uint32_t size, bool write) const {
+        if (start + size > std::min<uint32_t>(addressMask + 1, ADDRESS_SPACE_SIZE)) {
+            return false;  // Would wrap around
+        }
+        for (uint32_t page = start >> PAGE_SHIFT; page <= (start + size - 1) >> PAGE_SHIFT; page++) {
+            if (write ? pageTypes[page] != PageType::Ram : readPages[page] == nullptr) {
+                return false;
+            }
         }
-        return memory[address];
+        return true;
     }
 
-    uint16_t Memory::readWord(uint32_t address) const {
-        if (address + 1 >= MEMORY_SIZE) {
-            throw std::out_of_range("Memory read out of range");
+    uint8_t* Memory::writablePage(uint32_t page) {
+        if (!writePages[page]) {
+            touchPage(page);
         }
-        return memory[address] | (memory[address+1] << 8);
+        return writePages[page];
     }
 
-    void Memory::writeByte(uint32_t address, uint8_t value) {
-        if (address >= MEMORY_SIZE) {
-            throw std::out_of_range("Memory write out of bounds");
+    bool Memory::copyBlock(uint32_t destination, uint32_t source, uint32_t size) {
+        if (size == 0) {
+            return true;
+        }
+        // Copying upwards over itself repeats the start of the source
+        if (destination > source && destination < source + size) {
+            return false;
         }
-        memory[address] = value;
+        if (!isPlainRange(source, size, false) || !isPlainRange(destination, size, true)) {
+            return false;
+        }
+        for (uint32_t done = 0; done < size;) {
+            uint32_t from = source + done;
+            uint32_t to = destination + done;
+            uint32_t chunk = std::min({size - done, PAGE_SIZE - (from & (PAGE_SIZE - 1)), PAGE_SIZE - (to & (PAGE_SIZE - 1))});
+            // The destination page first, as making it dirty can move the
+            // source if they are the same page
+            uint8_t *target = writablePage(to >> PAGE_SHIFT) + (to & (PAGE_SIZE - 1));
+            std::memmove(target, readPages[from >> PAGE_SHIFT] + (from & (PAGE_SIZE - 1)), chunk);
+            done += chunk;
+        }
+        invalidateCodePages(destination, size);
+        return true;
     }
 
-    void Memory::writeWord(uint32_t address, uint16_t value) {
-        if(address + 1 >= MEMORY_SIZE) {
-            throw std::out_of_range("Memory write out of bounds");
+    bool Memory::fillBlock(uint32_t destination, uint32_t size, uint16_t pattern) {
+        if (size == 0) {
+            return true;
         }
+        if (!isPlainRange(destination, size, true)) {
+            return false;
+        }
+        uint8_t low = static_cast<uint8_t>(pattern & 0xFF);
+        uint8_t high = static_cast<uint8_t>(pattern >> 8);
+        // One page of the pattern, plus a byte so that a page can start on
+        // either half of it
+        uint8_t repeated[PAGE_SIZE + 1];
+        uint32_t span = std::min(size, PAGE_SIZE) + 1;
+        if (low != high) {
+            for (uint32_t i = 0; i < span; i++) {
+                repeated[i] = (i & 1) ? high : low;
+            }
+        }
+        for (uint32_t done = 0; done < size;) {
+            uint32_t to = destination + done;
+            uint32_t chunk = std::min(size - done, PAGE_SIZE - (to & (PAGE_SIZE - 1)));
+            uint8_t *target = writablePage(to >> PAGE_SHIFT) + (to & (PAGE_SIZE - 1));
+            if (low == high) {
+                std::memset(target, low, chunk);
+            } else {
+                std::memcpy(target, repeated + (done & 1), chunk);
+            }
+            done += chunk;
+        }
+        invalidateCodePages(destination, size);
+        return true;
+    }
 
-        memory[address] = value & 0xFF; //Low
-        memory[address+1] = (value>>8); //High
+    bool Memory::compareBlock(uint32_t first, uint32_t second, uint32_t size, bool equal, uint32_t &offset) const {
+        offset = 0;
+        if (size == 0) {
+            return true;
+        }
+        if (!isPlainRange(first, size, false) || !isPlainRange(second, size, false)) {
+            return false;
+        }
+        while (offset < size) {
+            uint32_t a = first + offset;
+            uint32_t b = second + offset;
+            uint32_t chunk = std::min({size - offset, PAGE_SIZE - (a & (PAGE_SIZE - 1)), PAGE_SIZE - (b & (PAGE_SIZE - 1))});
+            uint32_t found = findByte(readPages[a >> PAGE_SHIFT] + (a & (PAGE_SIZE - 1)),
+                                      readPages[b >> PAGE_SHIFT] + (b & (PAGE_SIZE - 1)), chunk, equal);
+            offset += found;
+            if (found < chunk) {
+                break;
+            }
+        }
+        return true;
+    }
+
+    bool Memory::scanBlock(uint32_t start, uint32_t size, uint16_t pattern, bool equal, uint32_t &offset) const {
+        offset = 0;
+        if (size == 0) {
+            return true;
+        }
+        if (!isPlainRange(start, size, false)) {
+            return false;
+        }
+        uint8_t low = static_cast<uint8_t>(pattern & 0xFF);
+        uint8_t high = static_cast<uint8_t>(pattern >> 8);
+        while (offset < size) {
+            uint32_t a = start + offset;
+            uint32_t chunk = std::min(size - offset, PAGE_SIZE - (a & (PAGE_SIZE - 1)));
+            // A page may start on either half of the pattern
+            uint32_t found = (offset & 1)
+                ? findByte(readPages[a >> PAGE_SHIFT] + (a & (PAGE_SIZE - 1)), high, low, chunk, equal)
+                : findByte(readPages[a >> PAGE_SHIFT] + (a & (PAGE_SIZE - 1)), low, high, chunk, equal);
+            offset += found;
+            if (found < chunk) {
+                break;
+            }
+        }
+        return true;
     }
 
-    uint32_t Memory::calculatePhysicalAddress(uint16_t segment, uint16_t offset) const {
-        return (static_cast<uint32_t>(segment) << 4) + offset;
+    void Memory::setA20Enabled(bool enabled) {
+        if (enabled == isA20Enabled()) {
+            return;
+        }
+        // Code cached from the first 64 KB above 1 MB, or from the bottom
+        // 64 KB it used to alias, now comes from somewhere else
+        invalidateCodePages(0, 0x10000);
+        invalidateCodePages(MEMORY_SIZE, 0x10000);
+        addressMask = enabled ? (MEMORY_SIZE << 1) - 1 : MEMORY_SIZE - 1;
+    }
+
+    void Memory::restorePage(uint32_t page) {
+        if (sparse) {
+            sparsePages[page].reset();
+        } else {
+            std::memcpy(&memory[page << PAGE_SHIFT], cleanPage(page), PAGE_SIZE);
+        }
+        dirtyPages[page] = 0;
+        markChanged(page);
+        if (pageTypes[page] == PageType::Ram) {
+            setRamPage(page);
+        }
+        invalidateCodePages(page << PAGE_SHIFT, PAGE_SIZE);
+    }
+
+    void Memory::clear() {
+        for (uint32_t page : dirtyList) {
+            restorePage(page);
+        }
+        dirtyList.clear();
+    }
+
+    void Memory::setBaseline() {
+        // Pages that stayed clean already match their baseline. The others
+        // share the image buffer when they match it, and otherwise get a new
+        // one, as the old one may be shared with an image.
+        for (uint32_t page : dirtyList) {
+            if (changedPages[page]) {
+                std::shared_ptr<uint8_t[]> data(new uint8_t[PAGE_SIZE]);
+                std::memcpy(data.get(), ramPage(page), PAGE_SIZE);
+                baselinePages[page] = std::move(data);
+            } else {
+                baselinePages[page] = imagePages[page];
+            }
+            if (sparse) {
+                sparsePages[page].reset();
+            }
+            dirtyPages[page] = 0;
+            if (pageTypes[page] == PageType::Ram) {
+                setRamPage(page);
+            }
+        }
+        dirtyList.clear();
+    }
+
+    Memory::Image Memory::snapshot() {
+        // Clean pages share their baseline buffer, and the pages that weren't
+        // written since the last image keep the one they have there
+        for (uint32_t page : changedList) {
+            if (dirtyPages[page]) {
+                std::shared_ptr<uint8_t[]> data(new uint8_t[PAGE_SIZE]);
+                std::memcpy(data.get(), ramPage(page), PAGE_SIZE);
+                imagePages[page] = std::move(data);
+            } else {
+                imagePages[page] = baselinePages[page];
+            }
+            changedPages[page] = 0;
+            if (pageTypes[page] == PageType::Ram) {
+                setRamPage(page);
+            }
+        }
+        changedList.clear();
+        return imagePages;
+    }
+
+    void Memory::restore(const Image &image) {
+        for (uint32_t page = 0; page < PAGE_COUNT; page++) {
+            if (!changedPages[page] && imagePages[page] == image[page]) {
+                continue;
+            }
+            imagePages[page] = image[page];
+            if (image[page] == baselinePages[page]) {
+                restorePage(page);
+            } else {
+                // The page differs from its baseline, so it stays dirty for
+                // clear() to restore
+                if (sparse && !sparsePages[page]) {
+                    sparsePages[page].reset(new uint8_t[PAGE_SIZE]);
+                }
+                std::memcpy(ramPage(page), image[page] ? image[page].get() : zeroPage.data(), PAGE_SIZE);
+                dirtyPages[page] = 1;
+                invalidateCodePages(page << PAGE_SHIFT, PAGE_SIZE);
+            }
+            changedPages[page] = 0;
+            if (pageTypes[page] == PageType::Ram) {
+                setRamPage(page);
+            }
+        }
+        changedList.clear();
+        dirtyList.clear();
+        for (uint32_t page = 0; page < PAGE_COUNT; page++) {
+            if (dirtyPages[page]) {
+                dirtyList.push_back(page);
+            }
+        }
+    }
+
+    size_t Memory::getResidentSize() const {
+        size_t pages = 0;
+        for (uint32_t page = 0; page < PAGE_COUNT; page++) {
+            pages += (baselinePages[page] != nullptr) + (sparsePages[page] != nullptr) +
+                     (imagePages[page] != nullptr && imagePages[page] != baselinePages[page]);
+        }
+        return (sparse ? 0 : memory.size()) + pages * PAGE_SIZE;
+    }
+
+    void Memory::invalidateCodePage(uint32_t address) {
+        uint32_t page = address >> CODE_PAGE_SHIFT;
+        if (codePages[page]) {
+            codePages[page] = 0;
+            codePageVersions[page]++;
+            codeWriteCount++;
+        }
     }
 
     void Memory::dumpMemory(uint32_t startAddress, uint32_t endAddress) const {
-        if (endAddress > MEMORY_SIZE || startAddress > endAddress) {
+        if (endAddress > ADDRESS_SPACE_SIZE || startAddress > endAddress) {
             throw std::out_of_range("Memory dump out of bounds");
         }
 
@@ -50,15 +467,8 @@ namespace CPU {
                 std::cout << "\n" << std::setw(6) << (startAddress + i) << ": ";
             }
             std::cout << std::setw(2) << std::setfill('0') << std::hex
-                      << static_cast<int>(memory[startAddress + i]) << " ";
+                      << static_cast<int>(readByte(startAddress + i)) << " ";
         }
         std::cout << std::dec << std::endl;
     }
-
-    uint16_t* Memory::getPointer(uint16_t address) {
-       if (address + 1 >= MEMORY_SIZE) {
-           throw std::out_of_range("Memory read out of range");
-       }
-       return reinterpret_cast<uint16_t*>(&memory[address]);
-    }
 }
\ No newline at end of file
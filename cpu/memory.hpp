@@ -1,31 +1,257 @@
 #ifndef MEMORY_HPP
 #define MEMORY_HPP
 
+#include <array>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <vector>
 
 namespace CPU {
+
+    // Handlers for memory-mapped I/O, called with the physical address
+    using MemoryReadHandler = std::function<uint8_t(uint32_t address)>;
+    using MemoryWriteHandler = std::function<void(uint32_t address, uint8_t value)>;
+
+    // What backs a page of the address space
+    enum class PageType : uint8_t {
+        Ram,   // Read and written directly
+        Rom,   // Read directly from a shared image, writes ignored
+        Mmio,  // Reads and writes go to a device's handlers
+    };
+
     class Memory {
+    public:
+        static constexpr size_t MEMORY_SIZE = 1 << 20; // 1 MB
+        static constexpr size_t ADDRESS_SPACE_SIZE = MEMORY_SIZE + 0x10000; // 1 MB + 64 KB, the reach of A20 (HMA included)
+        static constexpr uint32_t PAGE_SHIFT = 12; // 4 KB pages in the memory map
+        static constexpr uint32_t PAGE_SIZE = 1 << PAGE_SHIFT;
+        static constexpr size_t PAGE_COUNT = ADDRESS_SPACE_SIZE >> PAGE_SHIFT;
+        static constexpr uint32_t CODE_PAGE_SHIFT = 8; // 256-byte code pages
+        static constexpr size_t CODE_PAGE_COUNT = ADDRESS_SPACE_SIZE >> CODE_PAGE_SHIFT;
+
+        // Contents of RAM as one read-only buffer per page, nullptr for a
+        // page of zeroes. Buffers are never written once captured, so images
+        // taken from the same instance share every page they have in common.
+        using Image = std::array<std::shared_ptr<const uint8_t[]>, PAGE_COUNT>;
+
     private:
+        // Backing store for everything A20 can reach: FFFF:FFFF is 10FFEFh.
+        // Every physical address is wrapped into it (see wrap()), so no
+        // access can land outside and none has to be checked.
         std::vector<uint8_t> memory;
+        uint32_t addressMask;
+
+        // Masked to 20 bits with A20 gated off, 21 with it on. Only host code
+        // can ask for an address past the end, and it wraps to the start.
+        uint32_t wrap(uint32_t address) const {
+            address &= addressMask;
+            return address < ADDRESS_SPACE_SIZE ? address : address - ADDRESS_SPACE_SIZE;
+        }
+
+        // Sparse mode leaves memory empty and gives each RAM page its own
+        // buffer on the first write to it. Until then the page reads from
+        // its baseline, or from zeroPage, which every instance shares.
+        bool sparse;
+        std::array<std::unique_ptr<uint8_t[]>, PAGE_COUNT> sparsePages;
+        static const std::array<uint8_t, PAGE_SIZE> zeroPage;
+
+        // Dirty page tracking. A RAM page has no write pointer until it is
+        // first written after a clear() or setBaseline(), so that write takes
+        // the slow path and lists the page; clear() then only has to restore
+        // the listed pages, from baselinePages or with zeroes.
+        std::array<uint8_t, PAGE_COUNT> dirtyPages;
+        std::vector<uint32_t> dirtyList;
+        Image baselinePages;
+
+        // Snapshot tracking, kept apart from the baseline. imagePages is the
+        // image last returned by snapshot() or given to restore(), and the
+        // changed pages are those written since, which the next snapshot()
+        // copies. A page only has a write pointer while it is both dirty and
+        // changed, so the first write after either event is listed.
+        std::array<uint8_t, PAGE_COUNT> changedPages;
+        std::vector<uint32_t> changedList;
+        Image imagePages;
+
+        // Page map. readPages/writePages hold the host address of each page
+        // that can be accessed directly; the rest (ROM writes, MMIO) are
+        // nullptr and take the slow path through pageTypes and pageDevices.
+        struct Device {
+            MemoryReadHandler read;
+            MemoryWriteHandler write;
+        };
+        std::array<const uint8_t*, PAGE_COUNT> readPages;
+        std::array<uint8_t*, PAGE_COUNT> writePages;
+        std::array<PageType, PAGE_COUNT> pageTypes;
+        std::array<uint8_t, PAGE_COUNT> pageDevices;  // Index into devices for MMIO pages
+        std::vector<Device> devices;
+        std::vector<std::shared_ptr<const std::vector<uint8_t>>> romImages;  // Keeps mapped images alive
+
+        // Self-modifying code tracking: pages that hold decoded instructions are
+        // flagged, and a write into a flagged page bumps its version so that any
+        // cached decode of that page is dropped on its next lookup.
+        std::vector<uint8_t> codePages;
+        std::vector<uint32_t> codePageVersions;
+        uint32_t codeWriteCount = 0;  // Number of code page invalidations so far
+
+        void invalidateCodePage(uint32_t address);
+        void invalidateCodePages(uint32_t start, uint32_t size);
+        void setRamPage(uint32_t page);
+        void markDirty(uint32_t page);
+        void markChanged(uint32_t page);
+        void touchPage(uint32_t page);
+        void restorePage(uint32_t page);
+        uint8_t* ramPage(uint32_t page) { return sparse ? sparsePages[page].get() : &memory[page << PAGE_SHIFT]; }
+        const uint8_t* cleanPage(uint32_t page) const {
+            return baselinePages[page] ? baselinePages[page].get() : zeroPage.data();
+        }
+        void checkRegion(uint32_t start, size_t size) const;
+        bool isPlainRange(uint32_t start, uint32_t size, bool write) const;
+        uint8_t* writablePage(uint32_t page);
+
+        // Accesses that aren't a plain load or store: MMIO, ROM writes, and
+        // words that straddle two pages
+        uint8_t readSlow(uint32_t address) const;
+        uint16_t readWordSlow(uint32_t address) const;
+        void writeSlow(uint32_t address, uint8_t value);
+        void writeWordSlow(uint32_t address, uint16_t value);
     public:
-        static constexpr size_t MEMORY_SIZE = 1 << 20; // 1 MB
+        // Constructor, all of memory mapped as RAM. A sparse instance only
+        // allocates the pages that are written.
+        explicit Memory(bool sparse = false);
+
+        // The page map points into this instance's buffer
+        Memory(const Memory&) = delete;
+        Memory& operator=(const Memory&) = delete;
+
+        // The A20 gate. Off (the 8086's behaviour, and the default) addresses
+        // wrap at 1 MB; on, FFFF:0010-FFFF:FFFF reach the 64 KB above it.
+        void setA20Enabled(bool enabled);
+        bool isA20Enabled() const { return addressMask != MEMORY_SIZE - 1; }
+
+        // Memory map. Regions are page aligned and a whole number of pages.
+        // A ROM image is mapped in place, not copied, so instances can share
+        // one; its size sets the size of the region.
+        void mapRam(uint32_t start, size_t size);
+        void mapRom(uint32_t start, std::shared_ptr<const std::vector<uint8_t>> image);
+        void mapMmio(uint32_t start, size_t size, MemoryReadHandler read, MemoryWriteHandler write);
+        PageType getPageType(uint32_t address) const { return pageTypes[wrap(address) >> PAGE_SHIFT]; }
+
+        // Guest words are little-endian, as on the host, so RAM and ROM
+        // words are read and written with a single unaligned access unless
+        // they straddle two pages.
+        uint8_t readByte(uint32_t address) const {
+            address = wrap(address);
+            const uint8_t *page = readPages[address >> PAGE_SHIFT];
+            if (page) {
+                return page[address & (PAGE_SIZE - 1)];
+            }
+            return readSlow(address);
+        }
+
+        uint16_t readWord(uint32_t address) const {
+            address = wrap(address);
+            const uint8_t *page = readPages[address >> PAGE_SHIFT];
+            uint32_t offset = address & (PAGE_SIZE - 1);
+            if (page && offset != PAGE_SIZE - 1) {
+                uint16_t value;
+                std::memcpy(&value, page + offset, sizeof(value));
+                return value;
+            }
+            return readWordSlow(address);
+        }
+
+        void writeByte(uint32_t address, uint8_t value) {
+            address = wrap(address);
+            uint8_t *page = writePages[address >> PAGE_SHIFT];
+            if (!page) {
+                writeSlow(address, value);
+                return;
+            }
+            page[address & (PAGE_SIZE - 1)] = value;
+            if (codePages[address >> CODE_PAGE_SHIFT]) {
+                invalidateCodePage(address);
+            }
+        }
 
-        Memory() : memory(MEMORY_SIZE){} // Constructor
+        void writeWord(uint32_t address, uint16_t value) {
+            address = wrap(address);
+            uint8_t *page = writePages[address >> PAGE_SHIFT];
+            uint32_t offset = address & (PAGE_SIZE - 1);
+            if (!page || offset == PAGE_SIZE - 1) {
+                writeWordSlow(address, value);
+                return;
+            }
+            std::memcpy(page + offset, &value, sizeof(value));
+            if (codePages[address >> CODE_PAGE_SHIFT] || codePages[(address + 1) >> CODE_PAGE_SHIFT]) {
+                invalidateCodePage(address);
+                invalidateCodePage(address + 1);
+            }
+        }
 
-        uint8_t readByte(uint32_t address) const;
-        uint16_t readWord(uint32_t address) const;
-        uint16_t* getPointer(uint16_t address);
+        // Block moves for REP MOVS/STOS. Each returns false without touching
+        // anything if a range isn't plain memory (the source readable
+        // directly, the destination RAM) or runs past the end of the address
+        // space, and the caller falls back to single accesses. copyBlock()
+        // leaves the same result as copying a byte at a time from the bottom
+        // up, so the destination may only overlap the source from below.
+        // fillBlock() repeats the two bytes of pattern, low byte first.
+        bool copyBlock(uint32_t destination, uint32_t source, uint32_t size);
+        bool fillBlock(uint32_t destination, uint32_t size, uint16_t pattern);
 
-        void writeByte(uint32_t addrses, uint8_t value);
-        void writeWord(uint32_t address, uint16_t value);
+        // Scans for REPE/REPNE CMPS/SCAS, a vector of bytes at a time. offset
+        // is set to that of the first byte that is equal (equal = true) or
+        // different to its counterpart: the byte as far into second, or the
+        // byte of pattern, low byte at even offsets. It is size if there is
+        // none. Returns false if a range can't be read directly (MMIO, where
+        // reads may have side effects) or runs past the end of the address
+        // space.
+        bool compareBlock(uint32_t first, uint32_t second, uint32_t size, bool equal, uint32_t &offset) const;
+        bool scanBlock(uint32_t start, uint32_t size, uint16_t pattern, bool equal, uint32_t &offset) const;
 
-        uint32_t calculatePhysicalAddress(uint16_t segment, uint16_t offset) const;
+        // Return RAM to its baseline (all zeroes unless setBaseline() was
+        // called), restoring only the pages written since the last clear().
+        // A sparse instance gives those pages back.
+        void clear();
+
+        // Make the current contents of RAM what clear() returns to, e.g.
+        // once a program has been loaded
+        void setBaseline();
+
+        // Copy-on-write snapshots of RAM. snapshot() returns an image of it,
+        // copying only the pages written since the last one; restore() makes
+        // an image the contents of RAM, rewriting only the pages that differ
+        // from it. Neither changes the baseline that clear() goes back to.
+        Image snapshot();
+        void restore(const Image &image);
+
+        bool isSparse() const { return sparse; }
+        // Bytes of RAM actually allocated, baseline included
+        size_t getResidentSize() const;
+
+        uint32_t calculatePhysicalAddress(uint16_t segment, uint16_t offset) const {
+            return wrap((static_cast<uint32_t>(segment) << 4) + offset);
+        }
+
+        // Code page tracking used by the decode cache
+        void markCodePage(uint32_t address) { codePages[wrap(address) >> CODE_PAGE_SHIFT] = 1; }
+        bool isCodePage(uint32_t address) const { return codePages[wrap(address) >> CODE_PAGE_SHIFT]; }
+        uint32_t getCodePageVersion(uint32_t address) const { return codePageVersions[wrap(address) >> CODE_PAGE_SHIFT]; }
+        uint32_t getCodeWriteCount() const { return codeWriteCount; }
 
         void dumpMemory(uint32_t startAddreses, uint32_t endAddress) const;
     };
+
+    // Common regions of the PC memory map
+    enum CommonRegions {
+        VIDEO_MEMORY = 0xB8000,  // Colour text mode buffer, 32 KB
+        VIDEO_MEMORY_SIZE = 0x8000,
+        BIOS_ROM = 0xF0000,      // System BIOS, 64 KB
+        BIOS_ROM_SIZE = 0x10000
+    };
 }
 
-#endif // MEMORY_HPP
\ No newline at end of file
+#endif // MEMORY_HPP
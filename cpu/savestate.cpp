@@ -0,0 +1,344 @@
+#include "savestate.hpp"
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define EMU8086_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace CPU {
+
+    namespace {
+
+        constexpr char MAGIC[8] = {'E', 'M', 'U', '8', '0', '8', '6', 'S'};
+
+        struct FileHeader {
+            char     magic[8];
+            uint32_t version;
+            uint32_t pageSize;
+            uint32_t pageCount;
+            uint32_t portCount;
+            uint64_t totalCycles;
+            uint64_t instructionCount;
+            uint16_t registers[13];  // AX, BX, CX, DX, SI, DI, SP, BP, CS, DS, SS, ES, IP
+            uint16_t flags;
+            uint8_t  halted;
+            uint8_t  a20Enabled;
+            uint8_t  reserved[2];
+        };
+        static_assert(sizeof(FileHeader) == 72, "FileHeader layout is part of the file format");
+
+        struct PortEntry {
+            uint16_t port;
+            uint8_t  value;
+            uint8_t  reserved;
+        };
+
+        // One PIT channel (IO::PIT::ChannelState)
+        struct TimerEntry {
+            uint64_t start;
+            uint64_t pausedTicks;
+            uint64_t nextStart;
+            uint32_t reload;
+            uint32_t held;
+            uint32_t nextReload;
+            uint16_t latchedCount;
+            uint8_t  mode;
+            uint8_t  access;
+            uint8_t  bcd;
+            uint8_t  lowByte;
+            uint8_t  writeHigh;
+            uint8_t  readHigh;
+            uint8_t  state;
+            uint8_t  idleOutput;
+            uint8_t  hasNext;
+            uint8_t  countLatched;
+            uint8_t  statusLatched;
+            uint8_t  latchedStatus;
+            uint8_t  gate;
+            uint8_t  reserved[5];
+        };
+        static_assert(sizeof(TimerEntry) == 56, "TimerEntry layout is part of the file format");
+        constexpr size_t TIMER_CHANNELS = std::tuple_size<IO::PIT::State>::value;
+
+        TimerEntry toEntry(const IO::PIT::ChannelState &ch) {
+            TimerEntry entry{};
+            entry.start = ch.start;
+            entry.pausedTicks = ch.pausedTicks;
+            entry.nextStart = ch.nextStart;
+            entry.reload = ch.reload;
+            entry.held = ch.held;
+            entry.nextReload = ch.nextReload;
+            entry.latchedCount = ch.latchedCount;
+            entry.mode = ch.mode;
+            entry.access = ch.access;
+            entry.bcd = ch.bcd;
+            entry.lowByte = ch.lowByte;
+            entry.writeHigh = ch.writeHigh;
+            entry.readHigh = ch.readHigh;
+            entry.state = static_cast<uint8_t>(ch.state);
+            entry.idleOutput = ch.idleOutput;
+            entry.hasNext = ch.hasNext;
+            entry.countLatched = ch.countLatched;
+            entry.statusLatched = ch.statusLatched;
+            entry.latchedStatus = ch.latchedStatus;
+            entry.gate = ch.gate;
+            return entry;
+        }
+
+        IO::PIT::ChannelState fromEntry(const TimerEntry &entry) {
+            IO::PIT::ChannelState ch;
+            ch.start = entry.start;
+            ch.pausedTicks = entry.pausedTicks;
+            ch.nextStart = entry.nextStart;
+            ch.reload = entry.reload;
+            ch.held = entry.held;
+            ch.nextReload = entry.nextReload;
+            ch.latchedCount = entry.latchedCount;
+            ch.mode = entry.mode;
+            ch.access = entry.access;
+            ch.bcd = entry.bcd != 0;
+            ch.lowByte = entry.lowByte;
+            ch.writeHigh = entry.writeHigh != 0;
+            ch.readHigh = entry.readHigh != 0;
+            ch.state = static_cast<IO::PIT::CounterState>(entry.state);
+            ch.idleOutput = entry.idleOutput != 0;
+            ch.hasNext = entry.hasNext != 0;
+            ch.countLatched = entry.countLatched != 0;
+            ch.statusLatched = entry.statusLatched != 0;
+            ch.latchedStatus = entry.latchedStatus;
+            ch.gate = entry.gate != 0;
+            return ch;
+        }
+
+        // One 8259A (IO::PIC::ChipState)
+        struct InterruptControllerEntry {
+            uint8_t irr;
+            uint8_t isr;
+            uint8_t imr;
+            uint8_t lines;
+            uint8_t vectorBase;
+            uint8_t cascade;
+            uint8_t lowestPriority;
+            uint8_t initStep;
+            uint8_t needICW4;
+            uint8_t single;
+            uint8_t levelTriggered;
+            uint8_t autoEOI;
+            uint8_t rotateOnAutoEOI;
+            uint8_t specialMask;
+            uint8_t readISR;
+            uint8_t poll;
+        };
+        static_assert(sizeof(InterruptControllerEntry) == 16, "InterruptControllerEntry layout is part of the file format");
+        constexpr size_t INTERRUPT_CONTROLLERS = std::tuple_size<IO::PIC::State>::value;
+
+        InterruptControllerEntry toEntry(const IO::PIC::ChipState &chip) {
+            return InterruptControllerEntry{chip.irr, chip.isr, chip.imr, chip.lines, chip.vectorBase, chip.cascade,
+                                            chip.lowestPriority, chip.initStep, chip.needICW4, chip.single,
+                                            chip.levelTriggered, chip.autoEOI, chip.rotateOnAutoEOI,
+                                            chip.specialMask, chip.readISR, chip.poll};
+        }
+
+        IO::PIC::ChipState fromEntry(const InterruptControllerEntry &entry) {
+            IO::PIC::ChipState chip;
+            chip.irr = entry.irr;
+            chip.isr = entry.isr;
+            chip.imr = entry.imr;
+            chip.lines = entry.lines;
+            chip.vectorBase = entry.vectorBase;
+            chip.cascade = entry.cascade;
+            chip.lowestPriority = entry.lowestPriority;
+            chip.initStep = entry.initStep;
+            chip.needICW4 = entry.needICW4 != 0;
+            chip.single = entry.single != 0;
+            chip.levelTriggered = entry.levelTriggered != 0;
+            chip.autoEOI = entry.autoEOI != 0;
+            chip.rotateOnAutoEOI = entry.rotateOnAutoEOI != 0;
+            chip.specialMask = entry.specialMask != 0;
+            chip.readISR = entry.readISR != 0;
+            chip.poll = entry.poll != 0;
+            return chip;
+        }
+
+        constexpr size_t alignToPage(size_t offset) {
+            return (offset + Memory::PAGE_SIZE - 1) & ~static_cast<size_t>(Memory::PAGE_SIZE - 1);
+        }
+
+        // The whole file, read-only, kept alive by the pages pointing into it
+        std::shared_ptr<const uint8_t> mapFile(const std::string &path, size_t &size) {
+#ifdef EMU8086_MMAP
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                throw std::runtime_error("Failed to open save state: " + path);
+            }
+            struct stat info;
+            if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+                close(fd);
+                throw std::runtime_error("Failed to read save state: " + path);
+            }
+            size = static_cast<size_t>(info.st_size);
+            void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (data == MAP_FAILED) {
+                throw std::runtime_error("Failed to map save state: " + path);
+            }
+            return std::shared_ptr<const uint8_t>(static_cast<const uint8_t*>(data),
+                                                  [size](const uint8_t *p) { munmap(const_cast<uint8_t*>(p), size); });
+#else
+            std::ifstream file(path, std::ios::binary | std::ios::ate);
+            if (!file.is_open()) {
+                throw std::runtime_error("Failed to open save state: " + path);
+            }
+            size = static_cast<size_t>(file.tellg());
+            auto buffer = std::make_shared<std::vector<uint8_t>>(size);
+            file.seekg(0, std::ios::beg);
+            if (!file.read(reinterpret_cast<char*>(buffer->data()), size)) {
+                throw std::runtime_error("Failed to read save state: " + path);
+            }
+            return std::shared_ptr<const uint8_t>(buffer, buffer->data());
+#endif
+        }
+
+    } // namespace
+
+    void saveState(const Snapshot &state, const std::string &path) {
+        const Registers &r = state.registers;
+        FileHeader header{};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = SAVE_STATE_VERSION;
+        header.pageSize = Memory::PAGE_SIZE;
+        header.pageCount = Memory::PAGE_COUNT;
+        header.portCount = static_cast<uint32_t>(state.portValues.size());
+        header.totalCycles = state.totalCycles;
+        header.instructionCount = state.instructionCount;
+        const uint16_t registers[13] = {r.AX.value, r.BX.value, r.CX.value, r.DX.value, r.SI, r.DI,
+                                        r.SP, r.BP, r.CS, r.DS, r.SS, r.ES, r.IP};
+        std::memcpy(header.registers, registers, sizeof(registers));
+        header.flags = state.flags.getValue();
+        header.halted = state.halted;
+        header.a20Enabled = state.a20Enabled;
+
+        std::vector<PortEntry> ports;
+        for (const auto &[port, value] : state.portValues) {
+            ports.push_back({port, value, 0});
+        }
+
+        TimerEntry timer[TIMER_CHANNELS];
+        for (size_t i = 0; i < TIMER_CHANNELS; i++) {
+            timer[i] = toEntry(state.timer[i]);
+        }
+        InterruptControllerEntry interruptControllers[INTERRUPT_CONTROLLERS];
+        for (size_t i = 0; i < INTERRUPT_CONTROLLERS; i++) {
+            interruptControllers[i] = toEntry(state.interruptController[i]);
+        }
+
+        // Pages are laid out in address order after the tables
+        std::vector<uint64_t> pageOffsets(Memory::PAGE_COUNT);
+        size_t offset = alignToPage(sizeof(header) + ports.size() * sizeof(PortEntry) + sizeof(timer) + sizeof(interruptControllers) +
+                                    pageOffsets.size() * sizeof(uint64_t));
+        for (size_t page = 0; page < Memory::PAGE_COUNT; page++) {
+            if (state.memory[page]) {
+                pageOffsets[page] = offset;
+                offset += Memory::PAGE_SIZE;
+            }
+        }
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to create save state: " + path);
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(ports.data()), ports.size() * sizeof(PortEntry));
+        file.write(reinterpret_cast<const char*>(timer), sizeof(timer));
+        file.write(reinterpret_cast<const char*>(interruptControllers), sizeof(interruptControllers));
+        file.write(reinterpret_cast<const char*>(pageOffsets.data()), pageOffsets.size() * sizeof(uint64_t));
+        std::vector<char> padding(alignToPage(file.tellp()) - file.tellp());
+        file.write(padding.data(), padding.size());
+        for (size_t page = 0; page < Memory::PAGE_COUNT; page++) {
+            if (state.memory[page]) {
+                file.write(reinterpret_cast<const char*>(state.memory[page].get()), Memory::PAGE_SIZE);
+            }
+        }
+        if (!file) {
+            throw std::runtime_error("Failed to write save state: " + path);
+        }
+    }
+
+    Snapshot loadState(const std::string &path) {
+        size_t size = 0;
+        std::shared_ptr<const uint8_t> data = mapFile(path, size);
+
+        FileHeader header;
+        if (size < sizeof(header)) {
+            throw std::runtime_error("Save state is truncated: " + path);
+        }
+        std::memcpy(&header, data.get(), sizeof(header));
+        if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+            throw std::runtime_error("Not a save state: " + path);
+        }
+        if (header.version != SAVE_STATE_VERSION || header.pageSize != Memory::PAGE_SIZE ||
+            header.pageCount != Memory::PAGE_COUNT) {
+            throw std::runtime_error("Unsupported save state version: " + path);
+        }
+        size_t portsOffset = sizeof(header);
+        size_t timerOffset = portsOffset + static_cast<size_t>(header.portCount) * sizeof(PortEntry);
+        size_t interruptControllersOffset = timerOffset + TIMER_CHANNELS * sizeof(TimerEntry);
+        size_t pagesOffset = interruptControllersOffset + INTERRUPT_CONTROLLERS * sizeof(InterruptControllerEntry);
+        if (pagesOffset + Memory::PAGE_COUNT * sizeof(uint64_t) > size) {
+            throw std::runtime_error("Save state is truncated: " + path);
+        }
+
+        Snapshot state;
+        Registers &r = state.registers;
+        const uint16_t *registers = header.registers;
+        r.AX.value = registers[0]; r.BX.value = registers[1]; r.CX.value = registers[2]; r.DX.value = registers[3];
+        r.SI = registers[4]; r.DI = registers[5]; r.SP = registers[6]; r.BP = registers[7];
+        r.CS = registers[8]; r.DS = registers[9]; r.SS = registers[10]; r.ES = registers[11];
+        r.IP = registers[12];
+        state.flags.setValue(header.flags);
+        state.halted = header.halted != 0;
+        state.a20Enabled = header.a20Enabled != 0;
+        state.totalCycles = header.totalCycles;
+        state.instructionCount = header.instructionCount;
+
+        for (uint32_t i = 0; i < header.portCount; i++) {
+            PortEntry entry;
+            std::memcpy(&entry, data.get() + portsOffset + i * sizeof(PortEntry), sizeof(entry));
+            state.portValues[entry.port] = entry.value;
+        }
+
+        for (size_t i = 0; i < TIMER_CHANNELS; i++) {
+            TimerEntry entry;
+            std::memcpy(&entry, data.get() + timerOffset + i * sizeof(TimerEntry), sizeof(entry));
+            state.timer[i] = fromEntry(entry);
+        }
+        for (size_t i = 0; i < INTERRUPT_CONTROLLERS; i++) {
+            InterruptControllerEntry entry;
+            std::memcpy(&entry, data.get() + interruptControllersOffset + i * sizeof(entry), sizeof(entry));
+            state.interruptController[i] = fromEntry(entry);
+        }
+
+        for (size_t page = 0; page < Memory::PAGE_COUNT; page++) {
+            uint64_t offset;
+            std::memcpy(&offset, data.get() + pagesOffset + page * sizeof(uint64_t), sizeof(offset));
+            if (offset == 0) {
+                continue;
+            }
+            if (offset % Memory::PAGE_SIZE != 0 || offset > size || size - offset < Memory::PAGE_SIZE) {
+                throw std::runtime_error("Save state is truncated: " + path);
+            }
+            // Shares ownership of the mapping
+            state.memory[page] = std::shared_ptr<const uint8_t[]>(data, data.get() + offset);
+        }
+        return state;
+    }
+
+} // namespace CPU
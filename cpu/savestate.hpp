@@ -0,0 +1,29 @@
+#ifndef SAVESTATE_HPP
+#define SAVESTATE_HPP
+
+#include <cstdint>
+#include <string>
+#include "cpu.hpp"
+
+namespace CPU {
+
+    // Save-state files hold a Snapshot: a fixed header with the registers,
+    // flags and counters, the I/O port values, the timer channels, the
+    // interrupt controllers, a table with the file offset of every RAM page
+    // (0 for a page of zeroes), then the pages themselves, each on a page
+    // boundary. Numbers are stored in host byte order.
+    constexpr uint32_t SAVE_STATE_VERSION = 3;
+
+    // Write state to path. Throws std::runtime_error if it can't be written.
+    void saveState(const Snapshot &state, const std::string &path);
+
+    // Map a save-state file with MAP_PRIVATE and return it as a snapshot
+    // whose memory pages point straight into the mapping, so nothing is
+    // copied until the pages are restored into a dense CPU or written to.
+    // Throws std::runtime_error if the file is unreadable, truncated or
+    // of another version.
+    Snapshot loadState(const std::string &path);
+
+} // namespace CPU
+
+#endif // SAVESTATE_HPP
@@ -0,0 +1,53 @@
+#include "scheduler.hpp"
+#include <algorithm>
+#include <utility>
+
+namespace CPU {
+
+    Scheduler::EventId Scheduler::schedule(uint64_t due, EventCallback callback) {
+        EventId id = nextId++;
+        events.push_back(Event{due, id, std::move(callback)});
+        std::push_heap(events.begin(), events.end(), later);
+        updateNext();
+        return id;
+    }
+
+    bool Scheduler::cancel(EventId id) {
+        // Only a handful of devices have events pending, so a scan is cheap
+        auto it = std::find_if(events.begin(), events.end(), [id](const Event &event) { return event.id == id; });
+        if (it == events.end()) {
+            return false;
+        }
+        *it = std::move(events.back());
+        events.pop_back();
+        std::make_heap(events.begin(), events.end(), later);
+        updateNext();
+        return true;
+    }
+
+    void Scheduler::runDue(uint64_t now) {
+        while (!events.empty() && events.front().due <= now) {
+            // Taken off the heap first, as the callback may change it
+            std::pop_heap(events.begin(), events.end(), later);
+            Event event = std::move(events.back());
+            events.pop_back();
+            updateNext();
+            event.callback(event.due);
+        }
+    }
+
+    void Scheduler::rebase(uint64_t from, uint64_t to) {
+        for (Event &event : events) {
+            // Events already overdue stay due right away
+            event.due = event.due > from ? to + (event.due - from) : to;
+        }
+        std::make_heap(events.begin(), events.end(), later);
+        updateNext();
+    }
+
+    void Scheduler::clear() {
+        events.clear();
+        updateNext();
+    }
+
+} // namespace CPU
@@ -0,0 +1,70 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <vector>
+
+namespace CPU {
+
+    // Called when an event comes due, with the cycle it was scheduled for.
+    // Periodic devices schedule their next event from that rather than from
+    // the current cycle count, so lateness doesn't add up.
+    using EventCallback = std::function<void(uint64_t due)>;
+
+    // Events for devices, keyed on the guest cycle count. The CPU only
+    // compares its cycle count with nextDeadline() between instructions (or
+    // blocks), so nothing is polled while no event is due; an event fires
+    // late by at most the instruction or block that crossed its deadline.
+    class Scheduler {
+    public:
+        using EventId = uint64_t;
+        static constexpr uint64_t NEVER = std::numeric_limits<uint64_t>::max();
+
+        // Run callback once the cycle count reaches due. Events due on the
+        // same cycle fire in the order they were scheduled. Callbacks may
+        // schedule and cancel events, their own included.
+        EventId schedule(uint64_t due, EventCallback callback);
+
+        // Drop a pending event. Returns false if it has fired or was never
+        // scheduled.
+        bool cancel(EventId id);
+
+        // Cycle of the earliest pending event, NEVER if there is none
+        uint64_t nextDeadline() const { return next; }
+        bool isDue(uint64_t now) const { return now >= next; }
+        bool empty() const { return events.empty(); }
+
+        // Fire every event due by now, earliest first
+        void runDue(uint64_t now);
+
+        // Move every pending event by the change of the cycle count from
+        // from to to, so it stays as many cycles away (for a CPU reset or a
+        // restored snapshot)
+        void rebase(uint64_t from, uint64_t to);
+
+        // Drop every pending event
+        void clear();
+
+    private:
+        struct Event {
+            uint64_t due;
+            EventId id;  // Increasing, so it also orders events due together
+            EventCallback callback;
+        };
+
+        // Binary min-heap on (due, id)
+        std::vector<Event> events;
+        EventId nextId = 0;
+        uint64_t next = NEVER;
+
+        static bool later(const Event &a, const Event &b) {
+            return a.due != b.due ? a.due > b.due : a.id > b.id;
+        }
+        void updateNext() { next = events.empty() ? NEVER : events.front().due; }
+    };
+
+} // namespace CPU
+
+#endif // SCHEDULER_HPP
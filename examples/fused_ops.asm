@@ -0,0 +1,197 @@
+; Superinstruction example for emu8086
+; The threaded and JIT modes run some instruction pairs and triples as
+; one op: CMP, INC or DEC followed by a conditional jump, INC then CMP
+; then a conditional jump, and MOV reg, [mem] followed by an ALU op on
+; the loaded register. This program runs each of those shapes and
+; prints what they left behind, each byte as two hex digits and a
+; space, which has to come out the same in every mode.
+; The assembler gets memory operands, register moves, most ALU forms
+; and jumps to labels wrong, so those instructions are written out with
+; DB. JNE, JG, JGE, JL and JLE take a 16-bit displacement, JE an 8-bit one.
+; Prints: 5D 04 0F 0A 01 11 02 04 EF 92 A2 22
+
+    DB 0xEB, 0x39         ; JMP START, over the two routines
+
+; PRINT_HEX (INT 60h): AL as two hex digits and a space. Uses AX and BX.
+PRINT_HEX:
+    AND AX, 0x00FF
+    DB 0x89, 0xC3         ; MOV BX, AX
+    MOV CL, 4
+    SHR AX, CL            ; High nibble
+    INT 0x61
+    DB 0x89, 0xD8         ; MOV AX, BX
+    AND AX, 0x000F        ; Low nibble
+    INT 0x61
+    MOV AX, 0x0E20        ; Space
+    INT 0x10
+    IRET
+
+; PRINT_DIGIT (INT 61h): AX (0-15) as a hex digit, which is n + '0',
+; plus 7 past 9. (n + 6) >> 4 is 1 exactly then. Uses AX.
+PRINT_DIGIT:
+    PUSH CX
+    PUSH AX
+    ADD AX, 0x0006
+    SHR AX, 1
+    SHR AX, 1
+    SHR AX, 1
+    SHR AX, 1             ; 1 past 9
+    DB 0x89, 0xC1         ; MOV CX, AX
+    ADD AX, AX
+    ADD CX, AX            ; 3 past 9
+    ADD AX, AX
+    ADD AX, CX            ; 7 past 9
+    POP CX
+    ADD AX, CX
+    ADD AX, 0x0E30        ; AH = 0Eh (teletype), AL = the digit
+    INT 0x10
+    POP CX
+    IRET
+
+START:
+    ; Point INT 60h at PRINT_HEX (0000:7C02) and INT 61h at PRINT_DIGIT
+    ; (0000:7C1A)
+    MOV BX, 0x0180        ; 60h * 4
+    MOV AX, 0x7C02
+    DB 0x89, 0x07         ; MOV [BX], AX
+    XOR AX, AX
+    DB 0x89, 0x47, 0x02   ; MOV [BX+2], AX
+    MOV BX, 0x0184
+    MOV AX, 0x7C1A
+    DB 0x89, 0x07         ; MOV [BX], AX
+    XOR AX, AX
+    DB 0x89, 0x47, 0x02   ; MOV [BX+2], AX
+
+    ; CMP, INC or DEC, then a conditional jump. Each case shifts BX left
+    ; and jumps over an INC BX, so a taken branch leaves a 0 bit and one
+    ; that falls through a 1: 0101 1101 (5D).
+    XOR AX, AX
+    DB 0x89, 0xC3         ; MOV BX, AX
+    MOV AX, 0xFFFE
+    DB 0x01, 0xDB         ; ADD BX, BX
+    DB 0x3D, 0x03, 0x00   ; CMP AX, 3
+    DB 0x7C, 0x01, 0x00   ; JL +1: -2 < 3, taken
+    INC BX
+    MOV AL, 0x80
+    DB 0x01, 0xDB         ; ADD BX, BX
+    DB 0x3C, 0x7F         ; CMP AL, 7Fh
+    DB 0x77, 0x01, 0x00   ; JG +1: -128 > 127 fails
+    INC BX
+    MOV CX, 0x0005
+    MOV DX, 0x0005
+    DB 0x01, 0xDB         ; ADD BX, BX
+    DB 0x39, 0xD1         ; CMP CX, DX
+    DB 0x74, 0x01         ; JE +1: taken
+    INC BX
+    MOV CL, 0x10
+    MOV DL, 0x20
+    DB 0x01, 0xDB         ; ADD BX, BX
+    DB 0x3A, 0xD1         ; CMP DL, CL
+    DB 0x7E, 0x01, 0x00   ; JLE +1: 20h <= 10h fails
+    INC BX
+    MOV SI, 0x8000
+    DB 0x01, 0xDB         ; ADD BX, BX
+    DB 0x83, 0xFE, 0xFF   ; CMP SI, -1
+    DB 0x7D, 0x01, 0x00   ; JGE +1: -32768 >= -1 fails
+    INC BX
+    MOV DI, 0x1234
+    DB 0x01, 0xDB         ; ADD BX, BX
+    DB 0x81, 0xFF, 0x34, 0x12 ; CMP DI, 1234h
+    DB 0x75, 0x01, 0x00   ; JNE +1: equal, falls through
+    INC BX
+    MOV CX, 0x0002
+    DB 0x01, 0xDB         ; ADD BX, BX
+    DB 0x49               ; DEC CX
+    DB 0x75, 0x01, 0x00   ; JNE +1: CX = 1, taken
+    INC BX
+    MOV DX, 0x7FFF
+    DB 0x01, 0xDB         ; ADD BX, BX
+    DB 0x42               ; INC DX
+    DB 0x7C, 0x01, 0x00   ; JL +1: 8000h overflowed, SF = OF, falls through
+    INC BX
+    DB 0x89, 0xD8         ; MOV AX, BX
+    INT 0x60
+
+    ; A DEC CX / JNE loop leaves the carry flag alone (4), and a fused
+    ; CMP leaves the borrow for a later SBB (10h - 1 = 0F)
+    MOV CX, 0x0003
+    MOV DX, 0x0000
+    DB 0xF9               ; STC
+    DB 0x42               ; INC DX
+    DB 0x49               ; DEC CX
+    DB 0x75, 0xFB, 0xFF   ; JNE -5
+    DB 0x83, 0xD2, 0x00   ; ADC DX, 0
+    DB 0x89, 0xD0         ; MOV AX, DX
+    INT 0x60
+    MOV AX, 0x0001
+    MOV BX, 0x0002
+    DB 0x39, 0xD8         ; CMP AX, BX
+    DB 0x74, 0x00         ; JE +0
+    MOV AX, 0x0010
+    DB 0x83, 0xD8, 0x00   ; SBB AX, 0
+    INT 0x60
+
+    ; INC, CMP, then a conditional jump: a word loop summing 0-4 (0A),
+    ; a byte compare that runs AX up to 100h (AH = 01), and a JE that
+    ; skips over the MOV that would spoil AL (11)
+    MOV SI, 0x0000
+    MOV DX, 0x0000
+    DB 0x01, 0xF2         ; ADD DX, SI
+    DB 0x46               ; INC SI
+    DB 0x83, 0xFE, 0x05   ; CMP SI, 5
+    DB 0x7C, 0xF7, 0xFF   ; JL -9
+    DB 0x89, 0xD0         ; MOV AX, DX
+    INT 0x60
+    MOV AX, 0x00FD
+    DB 0x40               ; INC AX
+    DB 0x3C, 0x00         ; CMP AL, 0
+    DB 0x75, 0xFA, 0xFF   ; JNE -6
+    DB 0x88, 0xE0         ; MOV AL, AH
+    INT 0x60
+    MOV CX, 0x0009
+    MOV DX, 0x000A
+    MOV AL, 0x11
+    DB 0x41               ; INC CX
+    DB 0x39, 0xD1         ; CMP CX, DX
+    DB 0x74, 0x02         ; JE +2
+    MOV AL, 0xEE
+    INT 0x60
+
+    ; MOV reg, [mem] then an ALU op on the register, with 1234h and 00F0h
+    ; stored at 0000:0600
+    MOV BX, 0x0600
+    MOV AX, 0x1234
+    DB 0x89, 0x07         ; MOV [BX], AX
+    MOV AX, 0x00F0
+    DB 0x89, 0x47, 0x02   ; MOV [BX+2], AX
+    MOV CX, 0x0F0F
+    DB 0x8B, 0x17         ; MOV DX, [BX]
+    DB 0x21, 0xCA         ; AND DX, CX: 0204
+    DB 0x88, 0xF0         ; MOV AL, DH
+    INT 0x60
+    DB 0x88, 0xD0         ; MOV AL, DL
+    INT 0x60
+    MOV BX, 0x0600
+    DB 0x8B, 0x47, 0x02   ; MOV AX, [BX+2]
+    DB 0x2D, 0x01, 0x00   ; SUB AX, 1: EF
+    INT 0x60
+    MOV BX, 0x0600
+    MOV CL, 0x80
+    DB 0x8A, 0x47, 0x01   ; MOV AL, [BX+1]
+    DB 0x00, 0xC1         ; ADD CL, AL: 80h + 12h = 92
+    DB 0x8A, 0x17         ; MOV DL, [BX]
+    DB 0x2A, 0xD1         ; SUB DL, CL: 34h - 92h = A2
+    DB 0x88, 0xC8         ; MOV AL, CL
+    INT 0x60
+    DB 0x88, 0xD0         ; MOV AL, DL
+    INT 0x60
+    MOV BX, 0x0600
+    MOV DL, 0x22
+    DB 0x8B, 0x07         ; MOV AX, [BX]
+    DB 0x3D, 0x34, 0x12   ; CMP AX, 1234h
+    DB 0x74, 0x02         ; JE +2
+    MOV DL, 0xEE
+    DB 0x88, 0xD0         ; MOV AL, DL
+    INT 0x60
+
+    HLT
@@ -0,0 +1,123 @@
+; Interrupt hook example for emu8086
+; INT 21h is served the way a BIOS serves it: its vector points at a
+; stub in ROM at F000:0084. This program hooks the vector with a handler
+; that prints '>' and then chains to whatever the vector held before,
+; so every DOS call still gets done, then unhooks it again.
+; The assembler has no IN/OUT yet and gets memory operands and register
+; moves wrong, so those instructions are written out with DB.
+; Prints: F0 00 00 84 >A>BC
+
+    DB 0xEB, 0x55         ; JMP START, over the routines and the hook
+
+; PRINT_HEX (INT 60h): AL as two hex digits and a space. Uses AX and BX.
+PRINT_HEX:
+    AND AX, 0x00FF
+    DB 0x89, 0xC3         ; MOV BX, AX
+    MOV CL, 4
+    SHR AX, CL            ; High nibble
+    INT 0x61
+    DB 0x89, 0xD8         ; MOV AX, BX
+    AND AX, 0x000F        ; Low nibble
+    INT 0x61
+    MOV AX, 0x0E20        ; Space
+    INT 0x10
+    IRET
+
+; PRINT_DIGIT (INT 61h): AX (0-15) as a hex digit, which is n + '0',
+; plus 7 past 9. (n + 6) >> 4 is 1 exactly then. Uses AX.
+PRINT_DIGIT:
+    PUSH CX
+    PUSH AX
+    ADD AX, 0x0006
+    SHR AX, 1
+    SHR AX, 1
+    SHR AX, 1
+    SHR AX, 1             ; 1 past 9
+    DB 0x89, 0xC1         ; MOV CX, AX
+    ADD AX, AX
+    ADD CX, AX            ; 3 past 9
+    ADD AX, AX
+    ADD AX, CX            ; 7 past 9
+    POP CX
+    ADD AX, CX
+    ADD AX, 0x0E30        ; AH = 0Eh (teletype), AL = the digit
+    INT 0x10
+    POP CX
+    IRET
+
+; HOOK (INT 21h): prints '>' and chains to the old handler, saved at
+; 0000:0500. Without a far jump the chaining is an IRET to the old
+; handler through a frame built for it, which leaves the caller's INT
+; frame on top of the stack just as if INT 21h had gone there itself.
+HOOK:
+    DB 0x89, 0x06, 0x04, 0x05 ; MOV [0504h], AX, the caller's AX
+    MOV AX, 0x0E3E        ; '>'
+    INT 0x10
+    MOV AX, 0x0002        ; FLAGS as the INT left them, IF clear
+    PUSH AX
+    DB 0x8B, 0x06, 0x02, 0x05 ; MOV AX, [0502h]
+    PUSH AX
+    DB 0x8B, 0x06, 0x00, 0x05 ; MOV AX, [0500h]
+    PUSH AX
+    DB 0x8B, 0x06, 0x04, 0x05 ; MOV AX, [0504h]
+    IRET
+
+START:
+    ; Point INT 60h at PRINT_HEX (0000:7C02) and INT 61h at PRINT_DIGIT
+    ; (0000:7C1A)
+    MOV BX, 0x0180        ; 60h * 4
+    MOV AX, 0x7C02
+    DB 0x89, 0x07         ; MOV [BX], AX
+    XOR AX, AX
+    DB 0x89, 0x47, 0x02   ; MOV [BX+2], AX
+    MOV BX, 0x0184
+    MOV AX, 0x7C1A
+    DB 0x89, 0x07         ; MOV [BX], AX
+    XOR AX, AX
+    DB 0x89, 0x47, 0x02   ; MOV [BX+2], AX
+
+    ; Save the INT 21h vector (0000:0084) at 0000:0500 and print it,
+    ; segment then offset (F0 00 00 84, the stub)
+    MOV BX, 0x0084        ; 21h * 4
+    DB 0x8B, 0x07         ; MOV AX, [BX]
+    DB 0x89, 0x06, 0x00, 0x05 ; MOV [0500h], AX
+    DB 0x8B, 0x47, 0x02   ; MOV AX, [BX+2]
+    DB 0x89, 0x06, 0x02, 0x05 ; MOV [0502h], AX
+    MOV CL, 8
+    SHR AX, CL
+    INT 0x60
+    DB 0x8B, 0x06, 0x02, 0x05 ; MOV AX, [0502h]
+    INT 0x60
+    DB 0x8B, 0x06, 0x00, 0x05 ; MOV AX, [0500h]
+    MOV CL, 8
+    SHR AX, CL
+    INT 0x60
+    DB 0x8B, 0x06, 0x00, 0x05 ; MOV AX, [0500h]
+    INT 0x60
+
+    ; Point INT 21h at HOOK (0000:7C3B)
+    MOV BX, 0x0084
+    MOV AX, 0x7C3B
+    DB 0x89, 0x07         ; MOV [BX], AX
+    XOR AX, AX
+    DB 0x89, 0x47, 0x02   ; MOV [BX+2], AX
+
+    ; Character output through the hook (>A>B)
+    MOV AH, 0x02
+    MOV DL, 'A'
+    INT 0x21
+    MOV AH, 0x02
+    MOV DL, 'B'
+    INT 0x21
+
+    ; Put the old vector back: straight to the stub again (C)
+    MOV BX, 0x0084
+    DB 0x8B, 0x06, 0x00, 0x05 ; MOV AX, [0500h]
+    DB 0x89, 0x07         ; MOV [BX], AX
+    DB 0x8B, 0x06, 0x02, 0x05 ; MOV AX, [0502h]
+    DB 0x89, 0x47, 0x02   ; MOV [BX+2], AX
+    MOV AH, 0x02
+    MOV DL, 'C'
+    INT 0x21
+
+    HLT
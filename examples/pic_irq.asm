@@ -0,0 +1,160 @@
+; PIC example for emu8086
+; Initialises the two 8259A interrupt controllers on ports 20h/21h and
+; A0h/A1h the way a PC BIOS does (IRQ0-7 on vectors 08h-0Fh, IRQ8-15 on
+; 70h-77h, the slave on IRQ2), then takes timer interrupts through
+; IRQ0 and prints the controller's registers, each byte as two hex
+; digits and a space.
+; The assembler has no IN/OUT yet and gets memory operands and register
+; moves wrong, so those instructions are written out with DB.
+; Prints: FE FF 01 01 01 00 01 01
+
+    DB 0xEB, 0x4A         ; JMP START, over the routines and the handler
+
+; PRINT_HEX (INT 60h): AL as two hex digits and a space. Uses AX and BX.
+PRINT_HEX:
+    AND AX, 0x00FF
+    DB 0x89, 0xC3         ; MOV BX, AX
+    MOV CL, 4
+    SHR AX, CL            ; High nibble
+    INT 0x61
+    DB 0x89, 0xD8         ; MOV AX, BX
+    AND AX, 0x000F        ; Low nibble
+    INT 0x61
+    MOV AX, 0x0E20        ; Space
+    INT 0x10
+    IRET
+
+; PRINT_DIGIT (INT 61h): AX (0-15) as a hex digit, which is n + '0',
+; plus 7 past 9. (n + 6) >> 4 is 1 exactly then. Uses AX.
+PRINT_DIGIT:
+    PUSH CX
+    PUSH AX
+    ADD AX, 0x0006
+    SHR AX, 1
+    SHR AX, 1
+    SHR AX, 1
+    SHR AX, 1             ; 1 past 9
+    DB 0x89, 0xC1         ; MOV CX, AX
+    ADD AX, AX
+    ADD CX, AX            ; 3 past 9
+    ADD AX, AX
+    ADD AX, CX            ; 7 past 9
+    POP CX
+    ADD AX, CX
+    ADD AX, 0x0E30        ; AH = 0Eh (teletype), AL = the digit
+    INT 0x10
+    POP CX
+    IRET
+
+; TICK (INT 08h, IRQ0): prints the in-service register, which has
+; IRQ0's bit set while this runs, then ends the interrupt with a
+; specific EOI for IRQ0.
+TICK:
+    PUSH AX
+    PUSH CX
+    MOV AL, 0x0B          ; OCW3: read the ISR
+    DB 0xE6, 0x20         ; OUT 20h, AL
+    DB 0xE4, 0x20         ; IN AL, 20h
+    INT 0x60
+    MOV AL, 0x60          ; OCW2: specific EOI, IRQ0
+    DB 0xE6, 0x20         ; OUT 20h, AL
+    POP CX
+    POP AX
+    IRET
+
+START:
+    ; Point INT 60h at PRINT_HEX (0000:7C02), INT 61h at PRINT_DIGIT
+    ; (0000:7C1A) and INT 08h at TICK (0000:7C3B)
+    MOV BX, 0x0180        ; 60h * 4
+    MOV AX, 0x7C02
+    DB 0x89, 0x07         ; MOV [BX], AX
+    XOR AX, AX
+    DB 0x89, 0x47, 0x02   ; MOV [BX+2], AX
+    MOV BX, 0x0184
+    MOV AX, 0x7C1A
+    DB 0x89, 0x07         ; MOV [BX], AX
+    XOR AX, AX
+    DB 0x89, 0x47, 0x02   ; MOV [BX+2], AX
+    MOV BX, 0x0020
+    MOV AX, 0x7C3B
+    DB 0x89, 0x07         ; MOV [BX], AX
+    XOR AX, AX
+    DB 0x89, 0x47, 0x02   ; MOV [BX+2], AX
+
+    ; Timer channel 0 in mode 2 with a count of 400h, so IRQ0 comes
+    ; round every 1024 timer clocks. It goes first, as ICW1 drops
+    ; whatever request setting the mode raised.
+    MOV AL, 0x34
+    DB 0xE6, 0x43         ; OUT 43h, AL
+    MOV AL, 0x00
+    DB 0xE6, 0x40         ; OUT 40h, AL
+    MOV AL, 0x04
+    DB 0xE6, 0x40         ; OUT 40h, AL
+
+    ; Master: ICW1 (edge triggered, cascaded, ICW4 follows), ICW2
+    ; (vector base 08h), ICW3 (slave on IRQ2), ICW4 (8086 mode)
+    MOV AL, 0x11
+    DB 0xE6, 0x20         ; OUT 20h, AL
+    MOV AL, 0x08
+    DB 0xE6, 0x21         ; OUT 21h, AL
+    MOV AL, 0x04
+    DB 0xE6, 0x21         ; OUT 21h, AL
+    MOV AL, 0x01
+    DB 0xE6, 0x21         ; OUT 21h, AL
+
+    ; Slave: the same, with vector base 70h and its cascade identity 2
+    MOV AL, 0x11
+    DB 0xE6, 0xA0         ; OUT A0h, AL
+    MOV AL, 0x70
+    DB 0xE6, 0xA1         ; OUT A1h, AL
+    MOV AL, 0x02
+    DB 0xE6, 0xA1         ; OUT A1h, AL
+    MOV AL, 0x01
+    DB 0xE6, 0xA1         ; OUT A1h, AL
+
+    ; OCW1: everything masked but the timer on the master and the slave
+    ; line, and all of the slave. Reading a data port gives the mask
+    ; back (FE FF).
+    MOV AL, 0xFE
+    DB 0xE6, 0x21         ; OUT 21h, AL
+    MOV AL, 0xFF
+    DB 0xE6, 0xA1         ; OUT A1h, AL
+    DB 0xE4, 0x21         ; IN AL, 21h
+    INT 0x60
+    DB 0xE4, 0xA1         ; IN AL, A1h
+    INT 0x60
+
+    ; Wait for three ticks. Each HLT ends with an interrupt, and TICK
+    ; prints the ISR with IRQ0 in service (01 01 01).
+    STI
+    HLT
+    HLT
+    HLT
+
+    ; With the interrupt over, nothing is in service (00)
+    CLI
+    MOV AL, 0x0B          ; OCW3: read the ISR
+    DB 0xE6, 0x20         ; OUT 20h, AL
+    DB 0xE4, 0x20         ; IN AL, 20h
+    INT 0x60
+
+    ; Mask IRQ0 and let the next tick come due. It is held in the
+    ; request register (01) without being delivered, even with IF set.
+    MOV AL, 0xFF
+    DB 0xE6, 0x21         ; OUT 21h, AL
+    STI
+    MOV CX, 0x0400
+    DB 0x49               ; DELAY: DEC CX
+    DB 0x74, 0x02         ; JZ over the JMP
+    DB 0xEB, 0xFB         ; JMP DELAY
+    MOV AL, 0x0A          ; OCW3: read the IRR
+    DB 0xE6, 0x20         ; OUT 20h, AL
+    DB 0xE4, 0x20         ; IN AL, 20h
+    INT 0x60
+
+    ; Unmasking it delivers the pending tick at once (01 from TICK),
+    ; and the program halts for good with interrupts off
+    MOV AL, 0xFE
+    DB 0xE6, 0x21         ; OUT 21h, AL
+    CLI
+    HLT
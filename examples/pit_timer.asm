@@ -0,0 +1,108 @@
+; PIT example for emu8086
+; Programs the 8254 interval timer on ports 40h-43h and prints what it
+; reads back, each byte as two hex digits and a space.
+; The assembler has no IN/OUT yet and gets memory operands and register
+; moves wrong, so those instructions are written out with DB.
+; Prints: 12 32 B4 10 7E 90
+
+    DB 0xEB, 0x39         ; JMP START, over the two routines
+
+; PRINT_HEX (INT 60h): AL as two hex digits and a space. Uses AX and BX.
+PRINT_HEX:
+    AND AX, 0x00FF
+    DB 0x89, 0xC3         ; MOV BX, AX
+    MOV CL, 4
+    SHR AX, CL            ; High nibble
+    INT 0x61
+    DB 0x89, 0xD8         ; MOV AX, BX
+    AND AX, 0x000F        ; Low nibble
+    INT 0x61
+    MOV AX, 0x0E20        ; Space
+    INT 0x10
+    IRET
+
+; PRINT_DIGIT (INT 61h): AX (0-15) as a hex digit, which is n + '0',
+; plus 7 past 9. (n + 6) >> 4 is 1 exactly then. Uses AX.
+PRINT_DIGIT:
+    PUSH CX
+    PUSH AX
+    ADD AX, 0x0006
+    SHR AX, 1
+    SHR AX, 1
+    SHR AX, 1
+    SHR AX, 1             ; 1 past 9
+    DB 0x89, 0xC1         ; MOV CX, AX
+    ADD AX, AX
+    ADD CX, AX            ; 3 past 9
+    ADD AX, AX
+    ADD AX, CX            ; 7 past 9
+    POP CX
+    ADD AX, CX
+    ADD AX, 0x0E30        ; AH = 0Eh (teletype), AL = the digit
+    INT 0x10
+    POP CX
+    IRET
+
+START:
+    ; Point INT 60h at PRINT_HEX (0000:7C02) and INT 61h at PRINT_DIGIT
+    ; (0000:7C1A)
+    MOV BX, 0x0180        ; 60h * 4
+    MOV AX, 0x7C02
+    DB 0x89, 0x07         ; MOV [BX], AX
+    XOR AX, AX
+    DB 0x89, 0x47, 0x02   ; MOV [BX+2], AX
+    MOV BX, 0x0184
+    MOV AX, 0x7C1A
+    DB 0x89, 0x07         ; MOV [BX], AX
+    XOR AX, AX
+    DB 0x89, 0x47, 0x02   ; MOV [BX+2], AX
+
+    ; Channel 0, mode 2 (rate generator), low then high byte, count 1234h
+    MOV AL, 0x34
+    DB 0xE6, 0x43         ; OUT 43h, AL
+    MOV AL, 0x34
+    DB 0xE6, 0x40         ; OUT 40h, AL
+    MOV AL, 0x12
+    DB 0xE6, 0x40         ; OUT 40h, AL
+
+    ; Counter latch command for channel 0, then the count it froze,
+    ; printed high byte first. It has counted down a little by now.
+    MOV AL, 0x00
+    DB 0xE6, 0x43         ; OUT 43h, AL
+    DB 0xE4, 0x40         ; IN AL, 40h
+    DB 0x88, 0xC2         ; MOV DL, AL
+    DB 0xE4, 0x40         ; IN AL, 40h
+    INT 0x60
+    DB 0x88, 0xD0         ; MOV AL, DL
+    INT 0x60
+
+    ; Read-back command latching channel 0's status only: output high,
+    ; count loaded, low/high access, mode 2, binary (B4)
+    MOV AL, 0xE2
+    DB 0xE6, 0x43         ; OUT 43h, AL
+    DB 0xE4, 0x40         ; IN AL, 40h
+    INT 0x60
+
+    ; Channel 2, mode 0 (interrupt on terminal count), low byte only,
+    ; count 80h. A read-back command latches its status and count
+    ; together: the status reads first, output low and the count loaded
+    ; (10), then the count, frozen a tick or two in.
+    MOV AL, 0x90
+    DB 0xE6, 0x43         ; OUT 43h, AL
+    MOV AL, 0x80
+    DB 0xE6, 0x42         ; OUT 42h, AL
+    MOV AL, 0xC8
+    DB 0xE6, 0x43         ; OUT 43h, AL
+    DB 0xE4, 0x42         ; IN AL, 42h
+    INT 0x60
+    DB 0xE4, 0x42         ; IN AL, 42h
+    INT 0x60
+
+    ; Printing took long enough for the count to run out: the output has
+    ; gone high (90)
+    MOV AL, 0xE8
+    DB 0xE6, 0x43         ; OUT 43h, AL
+    DB 0xE4, 0x42         ; IN AL, 42h
+    INT 0x60
+
+    HLT
@@ -0,0 +1,269 @@
+; String compare example for emu8086
+; REPE/REPNE CMPS and SCAS are scanned ahead a vector at a time, 16 or
+; 32 bytes depending on the host, and only the element they stop at is
+; stepped. This program runs them over buffers whose first mismatch or
+; match sits either side of a vector boundary, over words whose low
+; byte matches but whose high byte doesn't, and across the end of a
+; segment, where the scan has to stop and the rest is stepped. After each
+; one it prints ZF and CF ('Z' and 'C', '-' when clear), then CX, SI and
+; DI as four hex digits each, one line per case.
+; The assembler gets memory operands, register moves and most ALU forms
+; wrong and has no string instructions, so those are written out with DB.
+; Prints:
+; -- 0006 1022 2022
+; Z- 0000 1020 2020
+; Z- 0017 1011 2011
+; -C 000B 1012 2012
+; Z- 0020 1012 2020
+; -- 0010 1012 2020
+; Z- 001B 1012 202A
+; Z- 0015 1016 2016
+; -- 0003 0005 200D
+; Z- 0009 0005 0003
+
+    DB 0xE9, 0x84, 0x00   ; JMP START, over the routines
+
+; PRINT_WORD (INT 60h): AX as four hex digits and a space. Uses AX, BX
+; and CX.
+PRINT_WORD:
+    DB 0x89, 0xC3         ; MOV BX, AX
+    MOV CL, 12
+    SHR AX, CL
+    INT 0x61
+    DB 0x89, 0xD8         ; MOV AX, BX
+    MOV CL, 8
+    SHR AX, CL
+    AND AX, 0x000F
+    INT 0x61
+    DB 0x89, 0xD8         ; MOV AX, BX
+    MOV CL, 4
+    SHR AX, CL
+    AND AX, 0x000F
+    INT 0x61
+    DB 0x89, 0xD8         ; MOV AX, BX
+    AND AX, 0x000F
+    INT 0x61
+    MOV AX, 0x0E20        ; Space
+    INT 0x10
+    IRET
+
+; PRINT_DIGIT (INT 61h): AX (0-15) as a hex digit, which is n + '0',
+; plus 7 past 9. (n + 6) >> 4 is 1 exactly then. Uses AX.
+PRINT_DIGIT:
+    PUSH CX
+    PUSH AX
+    ADD AX, 0x0006
+    SHR AX, 1
+    SHR AX, 1
+    SHR AX, 1
+    SHR AX, 1             ; 1 past 9
+    DB 0x89, 0xC1         ; MOV CX, AX
+    ADD AX, AX
+    ADD CX, AX            ; 3 past 9
+    ADD AX, AX
+    ADD AX, CX            ; 7 past 9
+    POP CX
+    ADD AX, CX
+    ADD AX, 0x0E30        ; AH = 0Eh (teletype), AL = the digit
+    INT 0x10
+    POP CX
+    IRET
+
+; PRINT_STATE (INT 62h): ZF and CF, then CX, SI and DI, and a new line.
+; Uses AX, BX and CX.
+PRINT_STATE:
+    PUSH CX
+    MOV BX, 0x2D2D        ; '-' for both flags
+    DB 0x75, 0x02, 0x00   ; JNE +2
+    MOV BL, 0x5A          ; 'Z'
+    MOV AX, 0x0000
+    DB 0x14, 0x00         ; ADC AL, 0: AL = CF, ZF = !CF
+    DB 0x74, 0x02         ; JE +2
+    MOV BH, 0x43          ; 'C'
+    MOV AH, 0x0E
+    DB 0x88, 0xD8         ; MOV AL, BL
+    INT 0x10
+    DB 0x88, 0xF8         ; MOV AL, BH
+    INT 0x10
+    MOV AL, 0x20
+    INT 0x10
+    POP CX
+    DB 0x89, 0xC8         ; MOV AX, CX
+    INT 0x60
+    DB 0x89, 0xF0         ; MOV AX, SI
+    INT 0x60
+    DB 0x89, 0xF8         ; MOV AX, DI
+    INT 0x60
+    MOV AX, 0x0E0D        ; CR
+    INT 0x10
+    MOV AX, 0x0E0A        ; LF
+    INT 0x10
+    IRET
+
+START:
+    ; The stack starts at the top of segment 0, which the last cases use
+    MOV SP, 0x7000
+    DB 0xFC               ; CLD
+
+    ; Point INT 60h at PRINT_WORD (0000:7C03), INT 61h at PRINT_DIGIT
+    ; (0000:7C2E) and INT 62h at PRINT_STATE (0000:7C4F)
+    MOV BX, 0x0180        ; 60h * 4
+    MOV AX, 0x7C03
+    DB 0x89, 0x07         ; MOV [BX], AX
+    XOR AX, AX
+    DB 0x89, 0x47, 0x02   ; MOV [BX+2], AX
+    MOV BX, 0x0184
+    MOV AX, 0x7C2E
+    DB 0x89, 0x07         ; MOV [BX], AX
+    XOR AX, AX
+    DB 0x89, 0x47, 0x02   ; MOV [BX+2], AX
+    MOV BX, 0x0188
+    MOV AX, 0x7C4F
+    DB 0x89, 0x07         ; MOV [BX], AX
+    XOR AX, AX
+    DB 0x89, 0x47, 0x02   ; MOV [BX+2], AX
+
+    ; REPE CMPSB over 40 bytes of 55h that differ at byte 33, past a
+    ; whole 32-byte vector
+    MOV DI, 0x1000
+    MOV CX, 0x0040
+    MOV AL, 0x55
+    DB 0xF3, 0xAA         ; REP STOSB
+    MOV DI, 0x2000
+    MOV CX, 0x0040
+    DB 0xF3, 0xAA         ; REP STOSB
+    MOV BX, 0x2021
+    MOV AL, 0x66
+    DB 0x88, 0x07         ; MOV [BX], AL
+    MOV SI, 0x1000
+    MOV DI, 0x2000
+    MOV CX, 0x0028
+    DB 0xF3, 0xA6         ; REPE CMPSB
+    INT 0x62
+
+    ; REPE CMPSB over exactly 32 equal bytes: runs out of count
+    MOV SI, 0x1000
+    MOV DI, 0x2000
+    MOV CX, 0x0020
+    DB 0xF3, 0xA6         ; REPE CMPSB
+    INT 0x62
+
+    ; REPNE CMPSB over bytes that only agree at byte 16, just past a
+    ; 16-byte vector
+    MOV DI, 0x2000
+    MOV CX, 0x0040
+    MOV AL, 0xAA
+    DB 0xF3, 0xAA         ; REP STOSB
+    MOV BX, 0x1010
+    DB 0x88, 0x07         ; MOV [BX], AL
+    MOV SI, 0x1000
+    MOV DI, 0x2000
+    MOV CX, 0x0028
+    DB 0xF2, 0xA6         ; REPNE CMPSB
+    INT 0x62
+
+    ; REPE CMPSW over words of 5555h where word 8 is 5455h: only its
+    ; high byte differs
+    MOV DI, 0x2000
+    MOV CX, 0x0040
+    MOV AL, 0x55
+    DB 0xF3, 0xAA         ; REP STOSB
+    MOV DI, 0x1000
+    MOV CX, 0x0040
+    DB 0xF3, 0xAA         ; REP STOSB
+    MOV BX, 0x2011
+    MOV AL, 0x54
+    DB 0x88, 0x07         ; MOV [BX], AL
+    MOV SI, 0x1000
+    MOV DI, 0x2000
+    MOV CX, 0x0014
+    DB 0xF3, 0xA7         ; REPE CMPSW
+    INT 0x62
+
+    ; REPNE SCASB for 77h, which is byte 31, the last of a 32-byte vector
+    MOV DI, 0x2000
+    MOV CX, 0x0040
+    MOV AL, 0xAA
+    DB 0xF3, 0xAA         ; REP STOSB
+    MOV BX, 0x201F
+    MOV AL, 0x77
+    DB 0x88, 0x07         ; MOV [BX], AL
+    MOV DI, 0x2000
+    MOV CX, 0x0040
+    DB 0xF2, 0xAE         ; REPNE SCASB
+    INT 0x62
+
+    ; REPE SCASW for AAAAh over the same bytes: word 15 is 77AAh
+    MOV AX, 0xAAAA
+    MOV DI, 0x2000
+    MOV CX, 0x0020
+    DB 0xF3, 0xAF         ; REPE SCASW
+    INT 0x62
+
+    ; REPNE SCASW for 1234h over words of 3434h, whose low bytes all
+    ; match. Bytes 5 and 6 read 34h 12h, but straddle two words; word 20
+    ; is the first real match.
+    MOV DI, 0x2000
+    MOV CX, 0x0040
+    MOV AL, 0x34
+    DB 0xF3, 0xAA         ; REP STOSB
+    MOV BX, 0x2006
+    MOV AL, 0x12
+    DB 0x88, 0x07         ; MOV [BX], AL
+    MOV BX, 0x2029
+    DB 0x88, 0x07         ; MOV [BX], AL
+    MOV AX, 0x1234
+    MOV DI, 0x2000
+    MOV CX, 0x0030
+    DB 0xF2, 0xAF         ; REPNE SCASW
+    INT 0x62
+
+    ; REPNE CMPSW of words of 5555h against 6655h, whose low bytes all
+    ; match, up to word 10, which is 5555h too
+    MOV AX, 0x6655
+    MOV DI, 0x2000
+    MOV CX, 0x0020
+    DB 0xF3, 0xAB         ; REP STOSW
+    MOV BX, 0x2015
+    MOV AL, 0x55
+    DB 0x88, 0x07         ; MOV [BX], AL
+    MOV SI, 0x1000
+    MOV DI, 0x2000
+    MOV CX, 0x0020
+    DB 0xF2, 0xA7         ; REPNE CMPSW
+    INT 0x62
+
+    ; REPE CMPSB with SI at FFF8h: SI wraps to 0000h after 8 bytes, so
+    ; the scan stops there and the rest is stepped. Both sides are 55h up
+    ; to byte 12, which is 66h at DI (the first bytes of segment 0 are
+    ; the vectors of INT 0 and 1, which nothing here raises).
+    MOV AL, 0x55
+    MOV DI, 0xFFF8
+    MOV CX, 0x0008
+    DB 0xF3, 0xAA         ; REP STOSB
+    MOV DI, 0x0000
+    MOV CX, 0x0008
+    DB 0xF3, 0xAA         ; REP STOSB
+    MOV DI, 0x2000
+    MOV CX, 0x0010
+    DB 0xF3, 0xAA         ; REP STOSB
+    MOV BX, 0x200C
+    MOV AL, 0x66
+    DB 0x88, 0x07         ; MOV [BX], AL
+    MOV SI, 0xFFF8
+    MOV DI, 0x2000
+    MOV CX, 0x0010
+    DB 0xF3, 0xA6         ; REPE CMPSB
+    INT 0x62
+
+    ; REPNE SCASB for 77h with DI at FFFCh, found at 0000:0002 after DI
+    ; wraps
+    MOV BX, 0x0002
+    MOV AL, 0x77
+    DB 0x88, 0x07         ; MOV [BX], AL
+    MOV DI, 0xFFFC
+    MOV CX, 0x0010
+    DB 0xF2, 0xAE         ; REPNE SCASB
+    INT 0x62
+
+    HLT
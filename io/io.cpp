@@ -1,6 +1,7 @@
 #include "io.hpp"
 #include <iostream>
 #include <stdexcept>
+#include <utility>
 
 namespace IO {
 
@@ -10,15 +11,15 @@ namespace IO {
         // Keyboard data port - returns simulated keypress
         registerInputHandler(KEYBOARD_DATA, [](uint16_t) -> uint8_t {
             return 0;
-        });
+        }, true);
         
         registerOutputHandler(SERIAL_DATA, [](uint16_t, uint8_t value) {
             std::cout << static_cast<char>(value);
         });
     }
 
-    void IOController::registerInputHandler(uint16_t port, InputHandler handler) {
-        inputHandlers[port] = handler;
+    void IOController::registerInputHandler(uint16_t port, InputHandler handler, bool stable) {
+        inputHandlers[port] = InputPort{std::move(handler), stable};
     }
 
     void IOController::registerOutputHandler(uint16_t port, OutputHandler handler) {
@@ -29,7 +30,10 @@ namespace IO {
         // Check if there's a handler for this port
         auto it = inputHandlers.find(port);
         if (it != inputHandlers.end()) {
-            return it->second(port);
+            if (!it->second.stable) {
+                volatileReads++;
+            }
+            return it->second.handler(port);
         }
         
         return portValues.count(port) ? portValues[port] : 0;
@@ -14,18 +14,29 @@ namespace IO {
 
     class IOController {
     private:
+        struct InputPort {
+            InputHandler handler;
+            bool stable;
+        };
+
         // Maps of port addresses to handler functions
-        std::unordered_map<uint16_t, InputHandler> inputHandlers;
+        std::unordered_map<uint16_t, InputPort> inputHandlers;
         std::unordered_map<uint16_t, OutputHandler> outputHandlers;
 
         // Default port values
         std::unordered_map<uint16_t, uint8_t> portValues;
 
+        uint64_t volatileReads = 0;
+
     public:
         IOController();
 
-        // Register custom handlers for specific ports
-        void registerInputHandler(uint16_t port, InputHandler handler);
+        // Register custom handlers for specific ports. A stable input port
+        // reads the same, and reading it changes nothing, until a device
+        // event runs or a port is written; the CPU may then skip ahead
+        // through a loop that polls it. Ports whose value moves with the
+        // cycle counter or the host must not be stable.
+        void registerInputHandler(uint16_t port, InputHandler handler, bool stable = false);
         void registerOutputHandler(uint16_t port, OutputHandler handler);
 
         // Read from and write to I/O ports
@@ -35,10 +46,25 @@ namespace IO {
         // For word operations (for 16-bit ports)
         uint16_t readPortWord(uint16_t port);
         void writePortWord(uint16_t port, uint16_t value);
+
+        // Reads so far of ports that aren't stable. Ports without an input
+        // handler read the last value written, so they are.
+        uint64_t getVolatileReads() const { return volatileReads; }
+
+        // Last value written to each port, for saving and restoring state
+        const std::unordered_map<uint16_t, uint8_t>& getPortValues() const { return portValues; }
+        void setPortValues(const std::unordered_map<uint16_t, uint8_t>& values) { portValues = values; }
+
+        // Forget the values written, as at power-up. Handlers stay.
+        void reset() { portValues.clear(); }
     };
 
     // Common port numbers
     enum CommonPorts {
+        PIC_MASTER_CMD = 0x20,
+        PIC_MASTER_DATA = 0x21,
+        PIC_SLAVE_CMD = 0xA0,
+        PIC_SLAVE_DATA = 0xA1,
         KEYBOARD_DATA = 0x60,
         KEYBOARD_CTRL = 0x64,
         TIMER_COUNTER0 = 0x40,
@@ -0,0 +1,258 @@
+#include "pic.hpp"
+
+namespace IO {
+
+    PIC::PIC() {
+        reset();
+    }
+
+    void PIC::attach(IOController &io) {
+        // Registers only change on a write or an IRQ, and a poll has to be
+        // asked for with a command write first, so reads are stable
+        for (uint16_t port : {PIC_MASTER_CMD, PIC_MASTER_DATA, PIC_SLAVE_CMD, PIC_SLAVE_DATA}) {
+            io.registerInputHandler(port, [this](uint16_t p) { return read(p); }, true);
+            io.registerOutputHandler(port, [this](uint16_t p, uint8_t value) { write(p, value); });
+        }
+    }
+
+    void PIC::reset() {
+        chips = State();
+        master().vectorBase = 0x08;
+        master().cascade = 0x04;  // Slave on IRQ2
+        slave().vectorBase = 0x70;
+        slave().cascade = 0x02;   // Slave ID 2
+        update();
+    }
+
+    void PIC::setState(const State &state) {
+        chips = state;
+        update();
+    }
+
+    //--------------------------------------------------------------------------
+    // Priority
+    //--------------------------------------------------------------------------
+    int PIC::highest(const ChipState &chip, uint8_t bits) {
+        for (int i = 1; i <= 8; i++) {
+            int line = (chip.lowestPriority + i) & 7;
+            if (bits & (1 << line)) {
+                return line;
+            }
+        }
+        return -1;
+    }
+
+    int PIC::pending(const ChipState &chip) {
+        uint8_t requests = chip.irr & ~chip.imr;
+        if (!requests) {
+            return -1;
+        }
+        // In special mask mode, masked levels in service don't hold back
+        // lower ones
+        uint8_t blocking = chip.specialMask ? chip.isr & ~chip.imr : chip.isr;
+        for (int i = 1; i <= 8; i++) {
+            int line = (chip.lowestPriority + i) & 7;
+            if (blocking & (1 << line)) {
+                return -1;
+            }
+            if (requests & (1 << line)) {
+                return line;
+            }
+        }
+        return -1;
+    }
+
+    void PIC::update() {
+        // The slave's output is a level on the master's IRQ2
+        if (isCascaded()) {
+            uint8_t bit = 1 << 2;
+            bool slaveOutput = pending(slave()) >= 0;
+            master().lines = slaveOutput ? master().lines | bit : master().lines & ~bit;
+            master().irr = slaveOutput ? master().irr | bit : master().irr & ~bit;
+        }
+        bool output = pending(master()) >= 0;
+        if (output != requesting) {
+            requesting = output;
+            if (requestHandler) {
+                requestHandler(output);
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    // Requests
+    //--------------------------------------------------------------------------
+    void PIC::setLine(ChipState &chip, int line, bool high) {
+        uint8_t bit = 1 << line;
+        bool wasHigh = chip.lines & bit;
+        chip.lines = high ? chip.lines | bit : chip.lines & ~bit;
+        if (chip.levelTriggered) {
+            chip.irr = high ? chip.irr | bit : chip.irr & ~bit;
+        } else if (high && !wasHigh) {
+            chip.irr |= bit;
+        }
+    }
+
+    void PIC::setIRQ(int irq, bool high) {
+        setLine(chips[irq >> 3], irq & 7, high);
+        update();
+    }
+
+    void PIC::putInService(ChipState &chip, int line) {
+        uint8_t bit = 1 << line;
+        if (!chip.levelTriggered) {
+            chip.irr &= ~bit;
+        }
+        if (chip.autoEOI) {
+            if (chip.rotateOnAutoEOI) {
+                chip.lowestPriority = static_cast<uint8_t>(line);
+            }
+        } else {
+            chip.isr |= bit;
+        }
+    }
+
+    uint8_t PIC::acknowledge() {
+        int line = pending(master());
+        uint8_t vector;
+        if (line < 0) {
+            vector = master().vectorBase | 7;  // Spurious
+        } else if (line == 2 && isCascaded()) {
+            putInService(master(), 2);
+            int slaveLine = pending(slave());
+            if (slaveLine < 0) {
+                vector = slave().vectorBase | 7;
+            } else {
+                putInService(slave(), slaveLine);
+                vector = static_cast<uint8_t>(slave().vectorBase | slaveLine);
+            }
+        } else {
+            putInService(master(), line);
+            vector = static_cast<uint8_t>(master().vectorBase | line);
+        }
+        update();
+        return vector;
+    }
+
+    //--------------------------------------------------------------------------
+    // Ports
+    //--------------------------------------------------------------------------
+    uint8_t PIC::read(uint16_t port) {
+        ChipState &chip = (port & 0x80) ? slave() : master();
+        if (port & 1) {
+            return chip.imr;
+        }
+        if (chip.poll) {
+            return poll(chip);
+        }
+        return chip.readISR ? chip.isr : chip.irr;
+    }
+
+    void PIC::write(uint16_t port, uint8_t value) {
+        ChipState &chip = (port & 0x80) ? slave() : master();
+        if (port & 1) {
+            data(chip, value);
+        } else {
+            command(chip, value);
+        }
+        update();
+    }
+
+    uint8_t PIC::poll(ChipState &chip) {
+        // Acknowledges the request it reports, without a vector
+        chip.poll = false;
+        int line = pending(chip);
+        if (line < 0) {
+            return 0;
+        }
+        putInService(chip, line);
+        update();
+        return static_cast<uint8_t>(0x80 | line);
+    }
+
+    void PIC::command(ChipState &chip, uint8_t value) {
+        if (value & 0x10) {
+            // ICW1 starts initialization over
+            chip.initStep = 2;
+            chip.needICW4 = value & 0x01;
+            chip.single = value & 0x02;
+            chip.levelTriggered = value & 0x08;
+            chip.irr = chip.levelTriggered ? chip.lines : 0;
+            chip.isr = 0;
+            chip.imr = 0;
+            chip.lowestPriority = 7;
+            chip.autoEOI = false;
+            chip.rotateOnAutoEOI = false;
+            chip.specialMask = false;
+            chip.readISR = false;
+            chip.poll = false;
+            return;
+        }
+
+        int level = value & 0x07;
+        if (value & 0x08) {
+            // OCW3
+            if (value & 0x04) {
+                chip.poll = true;
+            }
+            if (value & 0x02) {
+                chip.readISR = value & 0x01;
+            }
+            if (value & 0x40) {
+                chip.specialMask = value & 0x20;
+            }
+            return;
+        }
+
+        // OCW2: end of interrupt and priority rotation
+        uint8_t inService = chip.specialMask ? chip.isr & ~chip.imr : chip.isr;
+        switch (value >> 5) {
+            case 0: chip.rotateOnAutoEOI = false; break;
+            case 4: chip.rotateOnAutoEOI = true; break;
+            case 1:    // Non-specific EOI
+            case 5: {  // Rotate on non-specific EOI
+                int line = highest(chip, inService);
+                if (line >= 0) {
+                    chip.isr &= ~(1 << line);
+                    if (value & 0x80) {
+                        chip.lowestPriority = static_cast<uint8_t>(line);
+                    }
+                }
+                break;
+            }
+            case 3:    // Specific EOI
+            case 7:    // Rotate on specific EOI
+                chip.isr &= ~(1 << level);
+                if (value & 0x80) {
+                    chip.lowestPriority = static_cast<uint8_t>(level);
+                }
+                break;
+            case 6:    // Set priority
+                chip.lowestPriority = static_cast<uint8_t>(level);
+                break;
+            default:   // No operation
+                break;
+        }
+    }
+
+    void PIC::data(ChipState &chip, uint8_t value) {
+        switch (chip.initStep) {
+            case 2:
+                chip.vectorBase = value & 0xF8;
+                chip.initStep = chip.single ? (chip.needICW4 ? 4 : 0) : 3;
+                break;
+            case 3:
+                chip.cascade = value;
+                chip.initStep = chip.needICW4 ? 4 : 0;
+                break;
+            case 4:
+                chip.autoEOI = value & 0x02;
+                chip.initStep = 0;
+                break;
+            default:
+                chip.imr = value;  // OCW1
+                break;
+        }
+    }
+
+} // namespace IO
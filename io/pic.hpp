@@ -0,0 +1,103 @@
+#ifndef PIC_HPP
+#define PIC_HPP
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include "io.hpp"
+
+namespace IO {
+
+    // Called when the INTR line to the CPU changes level
+    using InterruptRequestHandler = std::function<void(bool requesting)>;
+
+    // Pair of 8259A interrupt controllers as wired in a PC/AT: the master on
+    // ports 20h/21h takes IRQ0-7, the slave on A0h/A1h takes IRQ8-15 and is
+    // cascaded into the master's IRQ2. Each has its request, in-service and
+    // mask registers (IRR, ISR, IMR), fully nested or rotating priority,
+    // specific and non-specific EOI, auto-EOI, special mask mode, polling,
+    // and edge- or level-triggered inputs, all programmed through ICW1-4 and
+    // OCW1-3.
+    //
+    // The controllers start out as a BIOS leaves them: vectors 08h and 70h,
+    // edge triggered, nothing masked.
+    class PIC {
+    public:
+        PIC();
+
+        // Take over the controller ports of io
+        void attach(IOController &io);
+
+        uint8_t read(uint16_t port);
+        void write(uint16_t port, uint8_t value);
+
+        // Level of IRQ line 0-15. In edge-triggered mode a request is
+        // latched when the line goes high.
+        void setIRQ(int irq, bool high);
+
+        // INTR to the CPU: there is a request of higher priority than
+        // everything in service
+        bool isRequesting() const { return requesting; }
+        void setRequestHandler(InterruptRequestHandler handler) { requestHandler = std::move(handler); }
+
+        // Interrupt acknowledge: put the highest-priority request in service
+        // and return its vector. Without one, the IRQ7 vector, as on the
+        // real part.
+        uint8_t acknowledge();
+
+        // Back to the state a BIOS leaves the controllers in
+        void reset();
+
+        // Registers and programming of one controller, for snapshots
+        struct ChipState {
+            uint8_t irr = 0;
+            uint8_t isr = 0;
+            uint8_t imr = 0;
+            uint8_t lines = 0;           // Input levels, for edge detection
+            uint8_t vectorBase = 0;      // ICW2, IRQ number in the low 3 bits
+            uint8_t cascade = 0;         // ICW3: slave inputs (master) or ID (slave)
+            uint8_t lowestPriority = 7;  // IRQ after which priority starts over
+            uint8_t initStep = 0;        // ICW expected on the data port next, 0 once initialized
+            bool needICW4 = false;
+            bool single = false;
+            bool levelTriggered = false;
+            bool autoEOI = false;
+            bool rotateOnAutoEOI = false;
+            bool specialMask = false;
+            bool readISR = false;        // Command port reads ISR rather than IRR
+            bool poll = false;           // Next command port read is a poll
+        };
+        using State = std::array<ChipState, 2>;  // Master, slave
+
+        State getState() const { return chips; }
+        void setState(const State &state);
+
+    private:
+        State chips;
+        bool requesting = false;
+        InterruptRequestHandler requestHandler;
+
+        ChipState& master() { return chips[0]; }
+        ChipState& slave() { return chips[1]; }
+        bool isCascaded() { return !master().single && (master().cascade & 0x04); }
+
+        // Highest-priority IRQ of a controller that isn't blocked by one in
+        // service, -1 if none
+        static int pending(const ChipState &chip);
+        static int highest(const ChipState &chip, uint8_t bits);
+
+        static void setLine(ChipState &chip, int line, bool high);
+        static void putInService(ChipState &chip, int line);
+        static void command(ChipState &chip, uint8_t value);
+        static void data(ChipState &chip, uint8_t value);
+        uint8_t poll(ChipState &chip);
+
+        // Feed the slave's output into the master and tell the CPU about a
+        // change of INTR
+        void update();
+    };
+
+} // namespace IO
+
+#endif // PIC_HPP
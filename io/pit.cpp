@@ -0,0 +1,431 @@
+#include "pit.hpp"
+#include <algorithm>
+#include <utility>
+
+namespace IO {
+
+    PIT::PIT(CPU::Scheduler &scheduler, const uint64_t &cycles) : scheduler(scheduler), cycles(cycles) {
+    }
+
+    void PIT::attach(IOController &io) {
+        for (uint16_t port = TIMER_COUNTER0; port <= TIMER_CTRL; port++) {
+            io.registerInputHandler(port, [this](uint16_t p) { return read(p); });
+            io.registerOutputHandler(port, [this](uint16_t p, uint8_t value) { write(p, value); });
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    // Counting, worked out from the cycle counter
+    //--------------------------------------------------------------------------
+    uint64_t PIT::elapsed(const Channel &ch, uint64_t now, uint32_t &reload) const {
+        bool next = ch.hasNext && now >= ch.nextStart;
+        reload = next ? ch.nextReload : ch.reload;
+        switch (ch.state) {
+            case CounterState::Idle:
+                return 0;
+            case CounterState::Paused:
+                return ch.pausedTicks;
+            case CounterState::Counting:
+                break;
+        }
+        uint64_t start = next ? ch.nextStart : ch.start;
+        return now > start ? (now - start) / CYCLES_PER_TICK : 0;
+    }
+
+    uint32_t PIT::countAt(const Channel &ch, uint64_t now) const {
+        if (ch.state == CounterState::Idle) {
+            return ch.held;
+        }
+        uint32_t n;
+        uint64_t k = elapsed(ch, now, n);
+        uint32_t m = modulus(ch);
+        switch (ch.mode) {
+            case 2:
+                return (n - static_cast<uint32_t>(k % n)) % m;
+            case 3: {
+                // Counts down by two through each half of the period, the
+                // high half a tick longer for odd counts
+                uint32_t p = static_cast<uint32_t>(k % n);
+                uint32_t high = (n + 1) / 2;
+                uint32_t q = p < high ? p : p - high;
+                return ((n & ~1u) - 2 * q) % m;
+            }
+            default:
+                // Modes 0, 1, 4 and 5 carry on counting past zero
+                return (n + m - static_cast<uint32_t>(k % m)) % m;
+        }
+    }
+
+    uint16_t PIT::encode(const Channel &ch, uint32_t count) const {
+        if (!ch.bcd) {
+            return static_cast<uint16_t>(count);
+        }
+        count %= 10000;
+        return static_cast<uint16_t>((count / 1000) << 12 | (count / 100 % 10) << 8 | (count / 10 % 10) << 4 | count % 10);
+    }
+
+    bool PIT::outputAt(const Channel &ch, uint64_t now) const {
+        if (ch.state == CounterState::Idle) {
+            return ch.idleOutput;
+        }
+        if (ch.state == CounterState::Paused && (ch.mode == 2 || ch.mode == 3)) {
+            return true;  // Held high while the gate is low
+        }
+        uint32_t n;
+        uint64_t k = elapsed(ch, now, n);
+        switch (ch.mode) {
+            case 0:
+            case 1:
+                return k >= n;                    // Low until terminal count
+            case 2:
+                return n == 1 || k % n != n - 1;  // Low for the tick the count is 1
+            case 3:
+                return n == 1 || k % n < (n + 1) / 2;
+            default:
+                return k != n;                    // Low for the tick the count is 0
+        }
+    }
+
+    uint64_t PIT::nextChange(const Channel &ch, uint64_t now) const {
+        if (ch.state != CounterState::Counting) {
+            return CPU::Scheduler::NEVER;
+        }
+        uint32_t reload;
+        uint64_t k = elapsed(ch, now, reload);
+        uint64_t n = reload;
+        bool pending = ch.hasNext && now < ch.nextStart;
+        uint64_t p = k % n;
+        uint64_t next = CPU::Scheduler::NEVER;
+        switch (ch.mode) {
+            case 0:
+            case 1:
+                next = k < n ? n : next;
+                break;
+            case 2:
+                next = n == 1 ? next : (p < n - 1 ? k + (n - 1 - p) : k + 1);
+                break;
+            case 3:
+                next = n == 1 ? next : (p < (n + 1) / 2 ? k + ((n + 1) / 2 - p) : k + (n - p));
+                break;
+            default:
+                next = k < n ? n : (k == n ? n + 1 : next);
+                break;
+        }
+        uint64_t start = ch.hasNext && !pending ? ch.nextStart : ch.start;
+        uint64_t cycle = next == CPU::Scheduler::NEVER ? next : start + next * CYCLES_PER_TICK;
+        return pending ? std::min(cycle, ch.nextStart) : cycle;
+    }
+
+    uint8_t PIT::status(const Channel &ch, uint64_t now) const {
+        bool output = outputAt(ch, now);
+        bool nullCount;
+        if (ch.hasNext) {
+            nullCount = now < ch.nextStart;
+        } else if (ch.state == CounterState::Counting) {
+            nullCount = now < ch.start;
+        } else {
+            nullCount = ch.state == CounterState::Idle;
+        }
+        return static_cast<uint8_t>(output << 7 | nullCount << 6 | ch.access << 4 | ch.mode << 1 | ch.bcd);
+    }
+
+    //--------------------------------------------------------------------------
+    // Ports
+    //--------------------------------------------------------------------------
+    uint8_t PIT::read(uint16_t port) {
+        if (port == TIMER_CTRL) {
+            return 0xFF;  // Write-only
+        }
+        Channel &ch = channels[port - TIMER_COUNTER0];
+        if (ch.statusLatched) {
+            ch.statusLatched = false;
+            return ch.latchedStatus;
+        }
+        uint16_t value = ch.countLatched ? ch.latchedCount : encode(ch, countAt(ch, cycles));
+        bool high;
+        if (ch.access == 3) {
+            high = ch.readHigh;
+            ch.readHigh = !ch.readHigh;
+        } else {
+            high = ch.access == 2;
+        }
+        if (high || ch.access != 3) {
+            ch.countLatched = false;  // Read in full
+        }
+        return static_cast<uint8_t>(high ? value >> 8 : value);
+    }
+
+    void PIT::write(uint16_t port, uint8_t value) {
+        if (port == TIMER_CTRL) {
+            control(value);
+            return;
+        }
+        int index = port - TIMER_COUNTER0;
+        Channel &ch = channels[index];
+        uint64_t now = cycles;
+        catchUp(index, now);
+        switch (ch.access) {
+            case 1:
+                loadCount(ch, value, now);
+                break;
+            case 2:
+                loadCount(ch, static_cast<uint16_t>(value << 8), now);
+                break;
+            default:
+                if (!ch.writeHigh) {
+                    ch.lowByte = value;
+                    ch.writeHigh = true;
+                    if (ch.mode == 0) {
+                        // Mode 0 stops counting until the count is complete
+                        ch.held = countAt(ch, now);
+                        ch.state = CounterState::Idle;
+                        ch.idleOutput = false;
+                        ch.hasNext = false;
+                    }
+                } else {
+                    ch.writeHigh = false;
+                    loadCount(ch, static_cast<uint16_t>(ch.lowByte | value << 8), now);
+                }
+                break;
+        }
+        update(index);
+    }
+
+    void PIT::control(uint8_t value) {
+        uint64_t now = cycles;
+        uint8_t select = value >> 6;
+
+        if (select == 3) {
+            // Read-back (8254): latch the count and/or status of any channels
+            for (int index = 0; index < 3; index++) {
+                if (!(value & (2 << index))) {
+                    continue;
+                }
+                Channel &ch = channels[index];
+                if (!(value & 0x20) && !ch.countLatched) {
+                    ch.countLatched = true;
+                    ch.latchedCount = encode(ch, countAt(ch, now));
+                }
+                if (!(value & 0x10) && !ch.statusLatched) {
+                    ch.statusLatched = true;
+                    ch.latchedStatus = status(ch, now);
+                }
+            }
+            return;
+        }
+
+        Channel &ch = channels[select];
+        uint8_t access = (value >> 4) & 3;
+        catchUp(select, now);
+        if (access == 0) {
+            // Counter latch: later reads see the count as of now
+            if (!ch.countLatched) {
+                ch.countLatched = true;
+                ch.latchedCount = encode(ch, countAt(ch, now));
+            }
+            return;
+        }
+
+        // A new mode stops the channel until a count is written
+        ch.held = countAt(ch, now);
+        ch.mode = (value >> 1) & 7;
+        if (ch.mode > 5) {
+            ch.mode -= 4;  // 6 and 7 are 2 and 3
+        }
+        ch.access = access;
+        ch.bcd = value & 1;
+        ch.state = CounterState::Idle;
+        ch.idleOutput = ch.mode != 0;
+        ch.hasNext = false;
+        ch.nextReload = 0;
+        ch.writeHigh = false;
+        ch.readHigh = false;
+        ch.countLatched = false;
+        ch.statusLatched = false;
+        update(select);
+    }
+
+    void PIT::loadCount(Channel &ch, uint16_t value, uint64_t now) {
+        uint32_t count = value;
+        if (ch.bcd) {
+            count = (value >> 12) * 1000 + (value >> 8 & 0xF) * 100 + (value >> 4 & 0xF) * 10 + (value & 0xF);
+        }
+        if (count == 0) {
+            count = modulus(ch);
+        }
+        ch.nextReload = count;
+
+        switch (ch.mode) {
+            case 1:
+            case 5:
+                // Taken up by the next gate trigger
+                if (ch.state == CounterState::Idle) {
+                    ch.reload = count;
+                }
+                break;
+            case 2:
+            case 3:
+                if (ch.state == CounterState::Counting) {
+                    // The current period runs out first
+                    uint32_t reload;
+                    uint64_t k = elapsed(ch, now, reload);
+                    ch.hasNext = true;
+                    ch.nextStart = ch.start + (k / ch.reload + 1) * ch.reload * CYCLES_PER_TICK;
+                    break;
+                }
+                [[fallthrough]];
+            default:
+                ch.reload = count;
+                if (ch.gate) {
+                    startCounting(ch, now);
+                } else {
+                    ch.state = CounterState::Paused;
+                    ch.pausedTicks = 0;
+                }
+                break;
+        }
+    }
+
+    void PIT::startCounting(Channel &ch, uint64_t now) {
+        // The count is loaded on the next tick of the timer clock
+        ch.state = CounterState::Counting;
+        ch.start = now + CYCLES_PER_TICK;
+        ch.hasNext = false;
+    }
+
+    void PIT::setGate(int channel, bool high) {
+        Channel &ch = channels[channel];
+        if (ch.gate == high) {
+            return;
+        }
+        ch.gate = high;
+        uint64_t now = cycles;
+        catchUp(channel, now);
+        switch (ch.mode) {
+            case 1:
+            case 5:
+                // A rising edge (re)starts the count
+                if (high && ch.nextReload != 0) {
+                    ch.reload = ch.nextReload;
+                    startCounting(ch, now);
+                }
+                break;
+            default:
+                if (!high && ch.state == CounterState::Counting) {
+                    uint32_t reload;
+                    ch.pausedTicks = elapsed(ch, now, reload);
+                    ch.hasNext = false;
+                    ch.state = CounterState::Paused;
+                } else if (high && ch.state == CounterState::Paused) {
+                    if (ch.mode == 2 || ch.mode == 3) {
+                        ch.reload = ch.nextReload;  // Modes 2 and 3 start over
+                        startCounting(ch, now);
+                    } else {
+                        ch.state = CounterState::Counting;
+                        ch.start = now - ch.pausedTicks * CYCLES_PER_TICK;
+                    }
+                }
+                break;
+        }
+        update(channel);
+    }
+
+    //--------------------------------------------------------------------------
+    // Output
+    //--------------------------------------------------------------------------
+    bool PIT::getOutput(int channel) {
+        return outputAt(channels[channel], cycles);
+    }
+
+    void PIT::setOutputHandler(int channel, TimerOutputHandler handler) {
+        Channel &ch = channels[channel];
+        ch.handler = std::move(handler);
+        ch.reportedOutput = outputAt(ch, cycles);
+        reschedule(channel, cycles);
+    }
+
+    void PIT::catchUp(int channel, uint64_t now) {
+        Channel &ch = channels[channel];
+        while (ch.eventPending && ch.eventDue <= now) {
+            scheduler.cancel(ch.event);
+            fire(channel, ch.eventDue);
+        }
+        if (ch.hasNext && now >= ch.nextStart) {
+            ch.reload = ch.nextReload;
+            ch.start = ch.nextStart;
+            ch.hasNext = false;
+        }
+    }
+
+    void PIT::update(int channel) {
+        report(channels[channel], outputAt(channels[channel], cycles));
+        reschedule(channel, cycles);
+    }
+
+    void PIT::report(Channel &ch, bool output) {
+        if (output != ch.reportedOutput) {
+            ch.reportedOutput = output;
+            if (ch.handler) {
+                ch.handler(output);
+            }
+        }
+    }
+
+    void PIT::reschedule(int channel, uint64_t from) {
+        Channel &ch = channels[channel];
+        if (ch.eventPending) {
+            scheduler.cancel(ch.event);
+            ch.eventPending = false;
+        }
+        if (!ch.handler) {
+            return;
+        }
+        uint64_t due = nextChange(ch, from);
+        if (due != CPU::Scheduler::NEVER) {
+            ch.event = scheduler.schedule(due, [this, channel](uint64_t when) { fire(channel, when); });
+            ch.eventPending = true;
+            ch.eventDue = due;
+        }
+    }
+
+    void PIT::fire(int channel, uint64_t due) {
+        // Worked out as of the deadline, which the CPU may be past by a
+        // block, so that short pulses aren't missed
+        Channel &ch = channels[channel];
+        ch.eventPending = false;
+        report(ch, outputAt(ch, due));
+        reschedule(channel, due);
+    }
+
+    //--------------------------------------------------------------------------
+    // State
+    //--------------------------------------------------------------------------
+    void PIT::reset() {
+        for (Channel &ch : channels) {
+            static_cast<ChannelState&>(ch) = ChannelState();
+        }
+        for (int channel = 0; channel < 3; channel++) {
+            update(channel);
+        }
+    }
+
+    PIT::State PIT::getState() const {
+        State state;
+        for (size_t i = 0; i < channels.size(); i++) {
+            state[i] = channels[i];
+        }
+        return state;
+    }
+
+    void PIT::setState(const State &state) {
+        // Handlers are told about nothing: whatever OUT drives is restored
+        // along with it
+        for (int channel = 0; channel < 3; channel++) {
+            Channel &ch = channels[channel];
+            static_cast<ChannelState&>(ch) = state[channel];
+            ch.reportedOutput = outputAt(ch, cycles);
+            reschedule(channel, cycles);
+        }
+    }
+
+} // namespace IO
@@ -0,0 +1,133 @@
+#ifndef PIT_HPP
+#define PIT_HPP
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include "io.hpp"
+#include "../cpu/scheduler.hpp"
+
+namespace IO {
+
+    // Called when a channel's OUT line changes level
+    using TimerOutputHandler = std::function<void(bool high)>;
+
+    // 8253/8254 programmable interval timer on ports 40h-43h: three 16-bit
+    // down counters with modes 0-5, binary or BCD counting, counter latch
+    // and read-back commands. Channel 0 drives IRQ0.
+    //
+    // Nothing is ticked. Each channel remembers the cycle its count was
+    // loaded on, and its count and OUT level are worked out from the CPU's
+    // cycle counter when they're asked for, so a guest polling the timer
+    // only pays for its IN instructions. Only a channel with an output
+    // handler has events on the scheduler, one per change of OUT.
+    class PIT {
+    public:
+        // The 1.193182 MHz timer clock is the 4.77 MHz CPU clock divided by 4
+        static constexpr uint32_t CYCLES_PER_TICK = 4;
+
+        // cycles is the CPU's cycle counter, read whenever a port is
+        PIT(CPU::Scheduler &scheduler, const uint64_t &cycles);
+
+        // Take over the timer ports of io
+        void attach(IOController &io);
+
+        uint8_t read(uint16_t port);
+        void write(uint16_t port, uint8_t value);
+
+        // GATE input of a channel (high at power-up). On a PC only channel
+        // 2's is wired to anything.
+        void setGate(int channel, bool high);
+
+        // OUT line of a channel, as of now
+        bool getOutput(int channel);
+        void setOutputHandler(int channel, TimerOutputHandler handler);
+
+        // Back to the power-up state: every channel idle in mode 0
+        void reset();
+
+        enum class CounterState : uint8_t {
+            Idle,      // No count loaded yet, or waiting for a gate trigger
+            Counting,  // Counting from start
+            Paused     // Gate low in mode 0 or 4, stopped pausedTicks into the count
+        };
+
+        // What a channel has been programmed with and where its count is,
+        // for snapshots. Times are CPU cycles.
+        struct ChannelState {
+            uint8_t mode = 0;
+            uint8_t access = 3;        // 1 = LSB only, 2 = MSB only, 3 = LSB then MSB
+            bool bcd = false;
+
+            uint32_t reload = 0x10000; // Initial count, 0 written as the modulus
+            uint8_t lowByte = 0;       // LSB of a count being written
+            bool writeHigh = false;    // Next byte written is the MSB
+            bool readHigh = false;     // Next byte read is the MSB
+
+            CounterState state = CounterState::Idle;
+            uint64_t start = 0;        // Cycle the count was loaded on
+            uint64_t pausedTicks = 0;
+            uint32_t held = 0;         // Count shown while idle
+            bool idleOutput = false;   // OUT while idle
+
+            // A new count for mode 2 or 3 waits for the current period to end
+            bool hasNext = false;
+            uint32_t nextReload = 0;
+            uint64_t nextStart = 0;
+
+            bool countLatched = false;
+            uint16_t latchedCount = 0;
+            bool statusLatched = false;
+            uint8_t latchedStatus = 0;
+
+            bool gate = true;
+        };
+        using State = std::array<ChannelState, 3>;
+
+        State getState() const;
+        void setState(const State &state);
+
+    private:
+        struct Channel : ChannelState {
+            TimerOutputHandler handler;
+            bool reportedOutput = false;   // Level last given to handler
+            bool eventPending = false;
+            uint64_t eventDue = 0;
+            CPU::Scheduler::EventId event = 0;
+        };
+
+        CPU::Scheduler &scheduler;
+        const uint64_t &cycles;
+        std::array<Channel, 3> channels;
+
+        uint32_t modulus(const Channel &ch) const { return ch.bcd ? 10000 : 0x10000; }
+
+        // Ticks since the count in effect at cycle now was loaded, and
+        // that count (a pending one once its time has come)
+        uint64_t elapsed(const Channel &ch, uint64_t now, uint32_t &reload) const;
+        uint32_t countAt(const Channel &ch, uint64_t now) const;  // In binary, whatever the counting mode
+        uint16_t encode(const Channel &ch, uint32_t count) const;
+        bool outputAt(const Channel &ch, uint64_t now) const;
+        uint64_t nextChange(const Channel &ch, uint64_t now) const;  // Cycle OUT next changes, NEVER if it won't
+        uint8_t status(const Channel &ch, uint64_t now) const;
+
+        void control(uint8_t value);
+        void loadCount(Channel &ch, uint16_t value, uint64_t now);
+        void startCounting(Channel &ch, uint64_t now);
+
+        // Before a channel is changed at cycle now: deliver the changes of
+        // OUT due by then that the CPU hasn't got round to, and take up a
+        // pending count
+        void catchUp(int channel, uint64_t now);
+
+        // Tell the handler about a change of OUT and put the channel's next
+        // one on the scheduler, after anything that may have moved it
+        void update(int channel);
+        void report(Channel &ch, bool output);
+        void reschedule(int channel, uint64_t from);
+        void fire(int channel, uint64_t due);
+    };
+
+} // namespace IO
+
+#endif // PIT_HPP
@@ -11,6 +11,8 @@
 #include "assembler/assembler.hpp"
 #include "disassembler/disassembler.hpp"
 #include "cpu/cpu.hpp"
+#include "cpu/savestate.hpp"
+#include "runner/pool.hpp"
 
 // Print usage information
 void printUsage(const char* programName) {
@@ -21,6 +23,14 @@ void printUsage(const char* programName) {
               << "  -o <file>    Output binary file (default: examples/output/simple.bin)\n"
               << "  -d           Disassemble the binary file\n"
               << "  -e           Execute the binary file (default)\n"
+              << "  -m <mode>    Execution mode: threaded (default), jit or interp\n"
+              << "  --a20        Enable the A20 line, so addresses past 1MB reach the HMA\n"
+              << "  --save-state <file>  Save the machine state to a file once execution ends\n"
+              << "  --load-state <file>  Start from a saved machine state instead of assembling\n"
+              << "  --batch <manifest>   Run every binary listed in a manifest, in parallel\n"
+              << "  -j <threads>         Worker threads for --batch (default: one per core)\n"
+              << "  --results <file>     Write --batch results there instead of to stdout\n"
+              << "  --lockstep <lanes>   Run --batch jobs that share a binary and limits in lockstep, up to <lanes> at a time\n"
               << "  -h, --help   Show help message\n"
               << std::endl;
 }
@@ -82,6 +92,14 @@ int main(int argc, char** argv) {
         bool disassembleMode = false;
         bool executeMode = true;
         bool assembleMode = false;
+        CPU::ExecutionMode executionMode = CPU::ExecutionMode::Threaded;
+        bool a20Enabled = false;
+        std::string saveStateFile;
+        std::string loadStateFile;
+        std::string manifestFile;
+        std::string resultsFile;
+        unsigned threads = 0;
+        size_t lockstepLanes = 0;
         
         // Parse command line arguments
         for (int i = 1; i < argc; i++) {
@@ -107,6 +125,31 @@ int main(int argc, char** argv) {
                 } else {
                     executeMode = true;
                 }
+            } else if (arg == "-m" && i + 1 < argc) {
+                std::string mode = argv[++i];
+                if (mode == "interp") {
+                    executionMode = CPU::ExecutionMode::Interpreter;
+                } else if (mode == "threaded") {
+                    executionMode = CPU::ExecutionMode::Threaded;
+                } else if (mode == "jit") {
+                    executionMode = CPU::ExecutionMode::Jit;
+                } else {
+                    throw std::runtime_error("Unknown execution mode: " + mode);
+                }
+            } else if (arg == "--a20") {
+                a20Enabled = true;
+            } else if (arg == "--save-state" && i + 1 < argc) {
+                saveStateFile = argv[++i];
+            } else if (arg == "--load-state" && i + 1 < argc) {
+                loadStateFile = argv[++i];
+            } else if (arg == "--batch" && i + 1 < argc) {
+                manifestFile = argv[++i];
+            } else if (arg == "-j" && i + 1 < argc) {
+                threads = static_cast<unsigned>(std::stoul(argv[++i]));
+            } else if (arg == "--results" && i + 1 < argc) {
+                resultsFile = argv[++i];
+            } else if (arg == "--lockstep" && i + 1 < argc) {
+                lockstepLanes = std::stoul(argv[++i]);
             } else if (arg == "-h" || arg == "--help") {
                 printUsage(argv[0]);
                 return 0;
@@ -117,6 +160,51 @@ int main(int argc, char** argv) {
             }
         }
         
+        // Run a manifest of prebuilt binaries, one JSON line per finished job
+        if (!manifestFile.empty()) {
+            std::vector<Runner::Job> jobs = Runner::readManifest(manifestFile);
+            std::ofstream resultsStream;
+            if (!resultsFile.empty()) {
+                resultsStream.open(resultsFile);
+                if (!resultsStream.is_open()) {
+                    throw std::runtime_error("Failed to create results file: " + resultsFile);
+                }
+            }
+            std::ostream &results = resultsFile.empty() ? std::cout : resultsStream;
+
+            Runner::Pool pool(threads, executionMode, lockstepLanes);
+            pool.run(jobs, [&results](const Runner::JobResult &result) {
+                results << Runner::toJson(result) << std::endl;
+            });
+            return 0;
+        }
+
+        // Resume a saved machine instead of assembling and booting a program
+        if (!loadStateFile.empty()) {
+            // Sparse memory reads the state's pages in place from the mapped file
+            CPU::CPU cpu(true);
+            cpu.setExecutionMode(executionMode);
+
+            CPU::Snapshot state = CPU::loadState(loadStateFile);
+            state.halted = false;  // A machine saved after HLT carries on past it
+            cpu.restore(state);
+            std::cout << "Loaded machine state: " << loadStateFile << std::endl;
+
+            try {
+                std::cout << "\nExecution output:\n";
+                cpu.run();
+                std::cout << "\nExecution completed successfully" << std::endl;
+            } catch (const std::exception& e) {
+                std::cerr << "\nExecution error: " << e.what() << std::endl;
+                return 1;
+            }
+            if (!saveStateFile.empty()) {
+                CPU::saveState(cpu.snapshot(), saveStateFile);
+                std::cout << "Machine state saved to: " << saveStateFile << std::endl;
+            }
+            return 0;
+        }
+
         // If no arguments were provided, use the default
         if (argc == 1) {
             inputFile = "examples/simple.asm";
@@ -177,27 +265,39 @@ int main(int argc, char** argv) {
             std::cout << "\nDisassembly:\n" << disassembler.toString() << std::endl;
         }
         
-        // Execute if requested
-        if (executeMode) {
-            std::cout << "\nExecuting binary file: " << outputFile << std::endl;
+        // Execute if requested. A state can also be saved with the program
+        // loaded but not yet run (-e false).
+        if (executeMode || !saveStateFile.empty()) {
+            if (executeMode) {
+                std::cout << "\nExecuting binary file: " << outputFile << std::endl;
+            }
             
             // Load the binary file
             std::vector<uint8_t> binary = readBinaryFile(outputFile);
             
             // Create and initialize CPU
             CPU::CPU cpu;
+            cpu.setExecutionMode(executionMode);
+            cpu.setA20Enabled(a20Enabled);
             
             // Load binary into memory at the boot address (0x7C00)
             cpu.loadBootBinary(binary);
             
             // Execute CPU
-            try {
-                std::cout << "\nExecution output:\n";
-                cpu.run();
-                std::cout << "\nExecution completed successfully" << std::endl;
-            } catch (const std::exception& e) {
-                std::cerr << "\nExecution error: " << e.what() << std::endl;
-                return 1;
+            if (executeMode) {
+                try {
+                    std::cout << "\nExecution output:\n";
+                    cpu.run();
+                    std::cout << "\nExecution completed successfully" << std::endl;
+                } catch (const std::exception& e) {
+                    std::cerr << "\nExecution error: " << e.what() << std::endl;
+                    return 1;
+                }
+            }
+
+            if (!saveStateFile.empty()) {
+                CPU::saveState(cpu.snapshot(), saveStateFile);
+                std::cout << "Machine state saved to: " << saveStateFile << std::endl;
             }
         }
         
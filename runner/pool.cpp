@@ -0,0 +1,286 @@
+#include "pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+
+namespace Runner {
+
+    namespace {
+
+        std::vector<uint8_t> readBinary(const std::string &path) {
+            std::ifstream file(path, std::ios::binary);
+            if (!file.is_open()) {
+                throw std::runtime_error("Failed to open binary file: " + path);
+            }
+            return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+
+        const char* reasonName(CPU::StopReason reason) {
+            switch (reason) {
+                case CPU::StopReason::Halted:           return "halted";
+                case CPU::StopReason::InstructionLimit: return "instruction-limit";
+                case CPU::StopReason::CycleLimit:       return "cycle-limit";
+                case CPU::StopReason::Deadline:         return "deadline";
+                case CPU::StopReason::Fault:            return "fault";
+            }
+            return "unknown";
+        }
+
+        std::string jsonString(const std::string &text) {
+            std::ostringstream out;
+            out << '"';
+            for (unsigned char c : text) {
+                switch (c) {
+                    case '"':  out << "\\\""; break;
+                    case '\\': out << "\\\\"; break;
+                    case '\n': out << "\\n"; break;
+                    case '\r': out << "\\r"; break;
+                    case '\t': out << "\\t"; break;
+                    default:
+                        if (c < 0x20 || c >= 0x7F) {
+                            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+                        } else {
+                            out << c;
+                        }
+                }
+            }
+            out << '"';
+            return out.str();
+        }
+
+    } // namespace
+
+    std::vector<Job> readManifest(const std::string &path) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to open manifest: " + path);
+        }
+
+        std::vector<Job> jobs;
+        std::string line;
+        size_t lineNumber = 0;
+        while (std::getline(file, line)) {
+            lineNumber++;
+            std::istringstream fields(line);
+            Job job;
+            if (!(fields >> job.binary) || job.binary[0] == '#') {
+                continue;
+            }
+            std::string input;
+            if (fields >> input && input != "-") {
+                job.input = input;
+            }
+            fields >> job.maxInstructions >> job.maxCycles >> job.timeoutMs;
+            if (fields.fail() && !fields.eof()) {
+                throw std::runtime_error("Invalid limits on line " + std::to_string(lineNumber) + " of " + path);
+            }
+            job.id = jobs.size();
+            jobs.push_back(job);
+        }
+        return jobs;
+    }
+
+    std::string toJson(const JobResult &result) {
+        std::ostringstream out;
+        out << "{\"job\":" << result.job->id << ",\"binary\":" << jsonString(result.job->binary);
+        if (!result.error.empty()) {
+            out << ",\"reason\":\"error\",\"error\":" << jsonString(result.error) << "}";
+            return out.str();
+        }
+        out << ",\"reason\":\"" << reasonName(result.run.reason) << "\""
+            << ",\"instructions\":" << result.run.instructions
+            << ",\"cycles\":" << result.run.cycles;
+        if (result.run.reason == CPU::StopReason::Fault) {
+            out << ",\"fault\":" << jsonString(result.run.fault)
+                << ",\"cs\":" << result.run.faultCS << ",\"ip\":" << result.run.faultIP;
+        }
+        out << ",\"output\":" << jsonString(result.output) << "}";
+        return out.str();
+    }
+
+    Pool::Pool(unsigned threads, CPU::ExecutionMode mode, size_t lockstepLanes)
+        : threadCount(threads ? threads : std::max(1u, std::thread::hardware_concurrency())), mode(mode),
+          lockstepLanes(lockstepLanes) {
+        for (unsigned i = 0; i < threadCount; i++) {
+            queues.push_back(std::make_unique<Queue>());
+        }
+    }
+
+    void Pool::run(const std::vector<Job> &jobs, const ResultHandler &onResult) {
+        batches.clear();
+        if (lockstepLanes) {
+            // Batch up jobs with the same binary and limits, in manifest order
+            std::map<std::tuple<std::string, uint64_t, uint64_t, uint64_t>, size_t> filling;
+            for (const Job &job : jobs) {
+                auto key = std::make_tuple(job.binary, job.maxInstructions, job.maxCycles, job.timeoutMs);
+                auto batch = filling.find(key);
+                if (batch == filling.end() || batches[batch->second].size() == lockstepLanes) {
+                    batch = filling.insert_or_assign(key, batches.size()).first;
+                    batches.emplace_back();
+                }
+                batches[batch->second].push_back(&job);
+            }
+        } else {
+            for (const Job &job : jobs) {
+                batches.push_back({&job});
+            }
+        }
+        for (size_t i = 0; i < batches.size(); i++) {
+            queues[i % threadCount]->batches.push_back(&batches[i]);
+        }
+
+        std::vector<std::thread> workers;
+        for (unsigned worker = 0; worker < threadCount; worker++) {
+            workers.emplace_back(&Pool::work, this, worker, std::cref(onResult));
+        }
+        for (auto &thread : workers) {
+            thread.join();
+        }
+    }
+
+    const Pool::Batch* Pool::nextBatch(unsigned worker) {
+        {
+            Queue &own = *queues[worker];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (!own.batches.empty()) {
+                const Batch *batch = own.batches.front();
+                own.batches.pop_front();
+                return batch;
+            }
+        }
+        // Nothing is queued once the run has started, so when every queue
+        // is empty the worker is done
+        for (unsigned i = 1; i < threadCount; i++) {
+            Queue &victim = *queues[(worker + i) % threadCount];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.batches.empty()) {
+                const Batch *batch = victim.batches.back();
+                victim.batches.pop_back();
+                return batch;
+            }
+        }
+        return nullptr;
+    }
+
+    void Pool::work(unsigned worker, const ResultHandler &onResult) {
+        if (lockstepLanes) {
+            while (const Batch *batch = nextBatch(worker)) {
+                std::vector<JobResult> results = runLockstep(*batch);
+                std::lock_guard<std::mutex> guard(resultLock);
+                for (const JobResult &result : results) {
+                    onResult(result);
+                }
+            }
+            return;
+        }
+
+        // Reused for every job this worker runs; reset() only restores the
+        // memory the previous job touched
+        CPU::CPU cpu;
+        cpu.setExecutionMode(mode);
+
+        while (const Batch *batch = nextBatch(worker)) {
+            JobResult result = runJob(cpu, *batch->front());
+            std::lock_guard<std::mutex> guard(resultLock);
+            onResult(result);
+        }
+    }
+
+    JobResult Pool::runJob(CPU::CPU &cpu, const Job &job) {
+        JobResult result;
+        result.job = &job;
+        cpu.reset();
+
+        try {
+            std::vector<uint8_t> binary = readBinary(job.binary);
+            std::ifstream input;
+            if (!job.input.empty()) {
+                input.open(job.input, std::ios::binary);
+                if (!input.is_open()) {
+                    throw std::runtime_error("Failed to open input file: " + job.input);
+                }
+            }
+
+            std::ostringstream output;
+            cpu.setConsole(job.input.empty() ? nullptr : &input, output);
+            cpu.loadBootBinary(binary);
+
+            CPU::RunLimits limits;
+            limits.maxInstructions = job.maxInstructions;
+            limits.maxCycles = job.maxCycles;
+            if (job.timeoutMs) {
+                limits.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(job.timeoutMs);
+            }
+            result.run = cpu.run(limits);
+            result.output = output.str();
+        } catch (const std::exception &e) {
+            result.error = e.what();
+        }
+
+        // The streams go away with this call
+        cpu.setConsole(nullptr, std::cout);
+        return result;
+    }
+
+    std::vector<JobResult> Pool::runLockstep(const Batch &batch) const {
+        std::vector<JobResult> results(batch.size());
+        for (size_t i = 0; i < batch.size(); i++) {
+            results[i].job = batch[i];
+        }
+
+        std::vector<uint8_t> binary;
+        try {
+            binary = readBinary(batch.front()->binary);
+        } catch (const std::exception &e) {
+            for (JobResult &result : results) {
+                result.error = e.what();
+            }
+            return results;
+        }
+
+        // Jobs whose input can't be opened are left out of the run
+        std::vector<std::ifstream> inputs(batch.size());
+        std::vector<size_t> lanes;  // Position in the batch of each lane's job
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (!batch[i]->input.empty()) {
+                inputs[i].open(batch[i]->input, std::ios::binary);
+                if (!inputs[i].is_open()) {
+                    results[i].error = "Failed to open input file: " + batch[i]->input;
+                    continue;
+                }
+            }
+            lanes.push_back(i);
+        }
+
+        CPU::Lockstep lockstep(lanes.size());
+        std::vector<std::ostringstream> outputs(lanes.size());
+        for (size_t lane = 0; lane < lanes.size(); lane++) {
+            const Job &job = *batch[lanes[lane]];
+            CPU::CPU &cpu = lockstep.lane(lane);
+            cpu.setExecutionMode(mode);
+            cpu.setConsole(job.input.empty() ? nullptr : &inputs[lanes[lane]], outputs[lane]);
+            cpu.loadBootBinary(binary);
+        }
+
+        const Job &first = *batch.front();
+        CPU::RunLimits limits;
+        limits.maxInstructions = first.maxInstructions;
+        limits.maxCycles = first.maxCycles;
+        if (first.timeoutMs) {
+            limits.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(first.timeoutMs);
+        }
+        std::vector<CPU::RunResult> runs = lockstep.run(limits);
+        for (size_t lane = 0; lane < lanes.size(); lane++) {
+            results[lanes[lane]].run = runs[lane];
+            results[lanes[lane]].output = outputs[lane].str();
+        }
+        return results;
+    }
+
+} // namespace Runner
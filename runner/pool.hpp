@@ -0,0 +1,84 @@
+#ifndef POOL_HPP
+#define POOL_HPP
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "../cpu/cpu.hpp"
+#include "../cpu/lockstep.hpp"
+
+namespace Runner {
+
+    // One program to run: a binary loaded at the boot address, the bytes
+    // its keyboard reads return, and the budgets it runs under
+    struct Job {
+        size_t id = 0;                 // Position in the manifest
+        std::string binary;
+        std::string input;             // Input file, empty for none
+        uint64_t maxInstructions = 0;  // 0 = no limit
+        uint64_t maxCycles = 0;
+        uint64_t timeoutMs = 0;
+    };
+
+    struct JobResult {
+        const Job *job = nullptr;
+        CPU::RunResult run;
+        std::string output;  // Everything the guest printed
+        std::string error;   // Set when the job couldn't be started (unreadable binary, ...)
+    };
+
+    // Read a manifest: one job per line, as
+    //   <binary> [<input>|- [<max-instructions> [<max-cycles> [<timeout-ms>]]]]
+    // with 0 for no limit. Blank lines and lines starting with # are skipped.
+    std::vector<Job> readManifest(const std::string &path);
+
+    // A result as one line of JSON
+    std::string toJson(const JobResult &result);
+
+    // Runs jobs on a fixed set of worker threads, each with its own CPU that
+    // is reset between jobs. Jobs are dealt out round robin; a worker takes
+    // from the front of its own queue and, once that is empty, steals from
+    // the back of the others', so a guest that runs long only holds up the
+    // job it is running.
+    //
+    // With lockstepLanes set, jobs that run the same binary under the same
+    // limits are dealt out in batches of up to that many, and each batch is
+    // run on a CPU::Lockstep instead.
+    class Pool {
+    public:
+        using ResultHandler = std::function<void(const JobResult &result)>;
+
+        Pool(unsigned threads, CPU::ExecutionMode mode, size_t lockstepLanes = 0);
+
+        // Run every job and return when all are done. onResult is called as
+        // each one completes, never from two threads at once.
+        void run(const std::vector<Job> &jobs, const ResultHandler &onResult);
+
+    private:
+        using Batch = std::vector<const Job*>;  // A single job unless run in lockstep
+
+        struct Queue {
+            std::mutex lock;
+            std::deque<const Batch*> batches;
+        };
+
+        unsigned threadCount;
+        CPU::ExecutionMode mode;
+        size_t lockstepLanes;
+        std::vector<Batch> batches;
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::mutex resultLock;
+
+        const Batch* nextBatch(unsigned worker);
+        void work(unsigned worker, const ResultHandler &onResult);
+        static JobResult runJob(CPU::CPU &cpu, const Job &job);
+        std::vector<JobResult> runLockstep(const Batch &batch) const;
+    };
+
+} // namespace Runner
+
+#endif // POOL_HPP